@@ -0,0 +1,129 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <XrdSys/XrdSysLogger.hh>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sstream>
+
+#include "BenchmarkUtils.hh"
+
+extern "C"
+{
+  XrdOss* XrdOssGetStorageSystem(XrdOss* native_oss, XrdSysLogger* Logger,
+                                 const char* config_fn, const char* parms);
+}
+
+uint64_t
+nowUs(void)
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+
+  return (uint64_t) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+bool
+parseSize(const char *str, uint64_t &size)
+{
+  char *end;
+
+  size = strtoull(str, &end, 10);
+
+  switch (*end)
+  {
+    case 'G': size <<= 10;
+    case 'M': size <<= 10;
+    case 'K': size <<= 10;
+      end++;
+    default:
+      break;
+  }
+
+  return end != str && *end == '\0';
+}
+
+uint64_t
+percentile(const std::vector<uint64_t> &sorted, double fraction)
+{
+  if (sorted.empty())
+    return 0;
+
+  return sorted[std::min(sorted.size() - 1,
+                         (size_t) (sorted.size() * fraction))];
+}
+
+static int
+writeOssConf(const std::vector<std::string> &extraConf, std::string &path)
+{
+  char tmpPath[] = "/tmp/radososs-benchmark-XXXXXX";
+  int fd = mkstemp(tmpPath);
+
+  if (fd < 0)
+    return -errno;
+
+  std::ostringstream ossConf;
+  ossConf << "radososs.config /dev/null\n"
+          << "radososs.datapools /:benchdata\n"
+          << "radososs.metadatapools /:benchmtd\n";
+
+  for (size_t i = 0; i < extraConf.size(); i++)
+    ossConf << extraConf[i] << "\n";
+
+  std::string contents = ossConf.str();
+  int ret = write(fd, contents.c_str(), contents.length());
+  close(fd);
+
+  if (ret != (int) contents.length())
+  {
+    unlink(tmpPath);
+    return -EIO;
+  }
+
+  path = tmpPath;
+
+  return 0;
+}
+
+XrdOss *
+loadPlugin(const std::vector<std::string> &ossConf)
+{
+  static XrdSysLogger logger;
+  std::string confPath;
+
+  if (writeOssConf(ossConf, confPath) != 0)
+  {
+    fprintf(stderr, "Failed to write the plugin's configuration\n");
+    return 0;
+  }
+
+  XrdOss *oss = XrdOssGetStorageSystem(0, &logger, confPath.c_str(), 0);
+
+  unlink(confPath.c_str());
+
+  if (!oss)
+    fprintf(stderr, "Failed to initialize the plugin\n");
+
+  return oss;
+}
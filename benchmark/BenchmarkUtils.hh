@@ -0,0 +1,43 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __BENCHMARK_UTILS_HH__
+#define __BENCHMARK_UTILS_HH__
+
+#include <XrdOss/XrdOss.hh>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define BENCH_TIDENT "bench"
+#define BENCH_ENV "uid=0&gid=0"
+
+uint64_t nowUs(void);
+
+// Parses a number with an optional K, M or G suffix
+bool parseSize(const char *str, uint64_t &size);
+
+uint64_t percentile(const std::vector<uint64_t> &sorted, double fraction);
+
+// Initializes the plugin as XRootD does, with the given extra configuration
+// directives, against the in-memory RADOS
+XrdOss * loadPlugin(const std::vector<std::string> &ossConf);
+
+#endif /* __BENCHMARK_UTILS_HH__ */
@@ -0,0 +1,1361 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <XrdSys/XrdSysPthread.hh>
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <rados/librados.h>
+#include <libradosfs.hh>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "MemRados.hh"
+
+// The library's objects keep their state behind a private pointer, which may
+// be a plain or a smart pointer depending on the libradosfs version
+template <typename T>
+static void
+setPriv(T *&priv, T *value)
+{
+  priv = value;
+}
+
+template <typename P, typename T>
+static void
+setPriv(P &priv, T *value)
+{
+  priv.reset(value);
+}
+
+template <typename T>
+static void
+deletePriv(T *&priv)
+{
+  delete priv;
+  priv = 0;
+}
+
+template <typename P>
+static void
+deletePriv(P &priv)
+{
+  priv.reset();
+}
+
+template <typename T, typename P>
+static T *
+privOf(const P &priv)
+{
+  return &*priv;
+}
+
+static uint64_t latencyUs = 0;
+static uint64_t bandwidth = 0;
+static uint64_t clientBandwidth = 0;
+
+void
+memRadosSetLatency(uint64_t latency)
+{
+  latencyUs = latency;
+}
+
+void
+memRadosSetBandwidth(uint64_t bytesPerSec)
+{
+  bandwidth = bytesPerSec;
+}
+
+void
+memRadosSetClientBandwidth(uint64_t bytesPerSec)
+{
+  clientBandwidth = bytesPerSec;
+}
+
+// A client's messenger sends its messages one after the other, so the data
+// of all the operations of a client shares its bandwidth
+struct MemMessenger
+{
+  MemMessenger() : busyUntilUs(0) {}
+
+  XrdSysMutex mutex;
+  uint64_t busyUntilUs;
+};
+
+static std::map<const void *, MemMessenger *> messengers;
+static XrdSysMutex messengersMutex;
+
+static uint64_t
+messengerDelayUs(const void *client, size_t bytes)
+{
+  MemMessenger *messenger;
+  struct timeval now;
+
+  if (clientBandwidth == 0 || !client)
+    return 0;
+
+  messengersMutex.Lock();
+
+  if (messengers.count(client) == 0)
+    messengers[client] = new MemMessenger;
+
+  messenger = messengers[client];
+  messengersMutex.UnLock();
+
+  gettimeofday(&now, 0);
+
+  uint64_t nowUs = (uint64_t) now.tv_sec * 1000000 + now.tv_usec;
+  XrdSysMutexHelper lock(messenger->mutex);
+
+  messenger->busyUntilUs = std::max(messenger->busyUntilUs, nowUs) +
+                           (uint64_t) bytes * 1000000 / clientBandwidth;
+
+  return messenger->busyUntilUs - nowUs;
+}
+
+// Simulates a round trip to the cluster transferring the given bytes through
+// the messenger of the given client (a Filesystem)
+static void
+roundTrip(size_t bytes, const void *client=0)
+{
+  uint64_t us = latencyUs + messengerDelayUs(client, bytes);
+
+  if (bandwidth > 0)
+    us += (uint64_t) bytes * 1000000 / bandwidth;
+
+  if (us == 0)
+    return;
+
+  struct timespec delay;
+  delay.tv_sec = us / 1000000;
+  delay.tv_nsec = (us % 1000000) * 1000;
+
+  while (nanosleep(&delay, &delay) == -1 && errno == EINTR)
+    ;
+}
+
+struct MemObject
+{
+  bool isDir;
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+  // Kept by renames, like RadosFS's inodes
+  ino_t ino;
+  struct timespec mtime;
+  // The stripe size of a file, which RadosFS does not report
+  size_t chunkSize;
+  std::vector<char> data;
+  std::map<std::string, std::string> xattrs;
+};
+
+static ino_t sLastIno = 0;
+
+// The whole "cluster", shared by all the Filesystem instances. Directories
+// are keyed with a trailing '/' and have a log object with the same name,
+// in the format read by the plugin's directory cache.
+class MemCluster
+{
+public:
+  MemCluster()
+  {
+    MemObject *root = newObject(true, S_IFDIR | 0755, 0, 0);
+    mObjects["/"] = root;
+    mLogs["/"] = "";
+  }
+
+  static MemObject * newObject(bool isDir, mode_t mode, uid_t uid, gid_t gid)
+  {
+    MemObject *object = new MemObject;
+    object->isDir = isDir;
+    object->mode = mode;
+    object->uid = uid;
+    object->gid = gid;
+    object->ino = __sync_add_and_fetch(&sLastIno, 1);
+    clock_gettime(CLOCK_REALTIME, &object->mtime);
+    object->chunkSize = 0;
+    return object;
+  }
+
+  MemObject * find(const std::string &key)
+  {
+    std::map<std::string, MemObject *>::iterator it = mObjects.find(key);
+    return it == mObjects.end() ? 0 : (*it).second;
+  }
+
+  void logEntry(const std::string &key, bool add)
+  {
+    std::string parent = radosfs::Dir::getParent(key, 0);
+    std::string name = key.substr(parent.length());
+    std::string escaped;
+
+    for (size_t i = 0; i < name.length(); i++)
+    {
+      if (name[i] == '"')
+        escaped += '\\';
+      escaped += name[i];
+    }
+
+    mLogs[parent] += std::string(add ? "+" : "-") + "name=\"" + escaped +
+                     "\"\n";
+    mLogMtimes[parent] = time(0);
+    mEntries[parent].erase(name);
+
+    if (add)
+      mEntries[parent].insert(name);
+  }
+
+  XrdSysRWLock lock;
+  std::map<std::string, MemObject *> mObjects;
+  std::map<std::string, std::string> mLogs;
+  std::map<std::string, time_t> mLogMtimes;
+  std::map<std::string, std::set<std::string> > mEntries;
+  // serializes the data of all files; holders of the read lock copy it
+  XrdSysMutex dataMutex;
+};
+
+static MemCluster memCluster;
+
+static std::string
+normalizePath(const std::string &path)
+{
+  std::string normalized;
+
+  for (size_t i = 0; i < path.length(); i++)
+  {
+    if (path[i] == '/' && !normalized.empty() &&
+        normalized[normalized.length() - 1] == '/')
+      continue;
+
+    normalized += path[i];
+  }
+
+  if (normalized.empty() || normalized[0] != '/')
+    normalized = "/" + normalized;
+
+  return normalized;
+}
+
+static std::string
+dirKey(const std::string &path)
+{
+  std::string key = normalizePath(path);
+
+  if (key[key.length() - 1] != '/')
+    key += '/';
+
+  return key;
+}
+
+static std::string
+fileKey(const std::string &path)
+{
+  std::string key = normalizePath(path);
+
+  while (key.length() > 1 && key[key.length() - 1] == '/')
+    key.erase(key.length() - 1);
+
+  return key;
+}
+
+// Finds either a file or a directory with the given path; must be called
+// with the cluster locked
+static MemObject *
+findAny(const std::string &path, std::string *key)
+{
+  std::string candidate = fileKey(path);
+  MemObject *object = memCluster.find(candidate);
+
+  if (!object)
+  {
+    candidate = dirKey(path);
+    object = memCluster.find(candidate);
+  }
+
+  if (object && key)
+    *key = candidate;
+
+  return object;
+}
+
+static void
+fillStat(const MemObject *object, struct stat *buff)
+{
+  memset(buff, 0, sizeof(struct stat));
+  buff->st_mode = object->mode;
+  buff->st_uid = object->uid;
+  buff->st_gid = object->gid;
+  buff->st_size = object->data.size();
+  buff->st_nlink = 1;
+  buff->st_ino = object->ino;
+  buff->st_mtim = buff->st_ctim = buff->st_atim = object->mtime;
+}
+
+static int
+statPath(const std::string &path, struct stat *buff)
+{
+  XrdSysRWLockHelper lock(memCluster.lock, true);
+  MemObject *object = findAny(path, 0);
+
+  if (!object)
+    return -ENOENT;
+
+  fillStat(object, buff);
+
+  return 0;
+}
+
+namespace radosfs
+{
+
+class FilesystemPriv
+{
+public:
+  FilesystemPriv() : uid(0), gid(0), chunkSize(128 * 1024 * 1024) {}
+
+  uid_t uid;
+  gid_t gid;
+  size_t chunkSize;
+  // prefix -> pool
+  std::map<std::string, std::string> dataPools;
+  std::map<std::string, std::string> mtdPools;
+  std::map<std::string, size_t> poolSizes;
+};
+
+class FsObjPriv
+{
+public:
+  Filesystem *fs;
+  std::string path;
+};
+
+class FilePriv
+{
+public:
+  File::OpenMode mode;
+};
+
+class DirPriv
+{
+public:
+  std::vector<std::string> entries;
+};
+
+Filesystem::Filesystem()
+{
+  setPriv(mPriv, new FilesystemPriv);
+}
+
+Filesystem::~Filesystem()
+{
+  deletePriv(mPriv);
+}
+
+int
+Filesystem::init(const std::string &userName,
+                 const std::string &configurationFile)
+{
+  return 0;
+}
+
+int
+Filesystem::addDataPool(const std::string &name, const std::string &prefix,
+                        size_t size)
+{
+  FilesystemPriv *priv = privOf<FilesystemPriv>(mPriv);
+
+  priv->dataPools[prefix] = name;
+  priv->poolSizes[name] = size;
+
+  return 0;
+}
+
+int
+Filesystem::removeDataPool(const std::string &name)
+{
+  FilesystemPriv *priv = privOf<FilesystemPriv>(mPriv);
+  std::map<std::string, std::string>::iterator it = priv->dataPools.begin();
+
+  while (it != priv->dataPools.end())
+  {
+    if ((*it).second == name)
+      priv->dataPools.erase(it++);
+    else
+      it++;
+  }
+
+  return 0;
+}
+
+int
+Filesystem::addMetadataPool(const std::string &name, const std::string &prefix)
+{
+  privOf<FilesystemPriv>(mPriv)->mtdPools[prefix] = name;
+
+  return 0;
+}
+
+int
+Filesystem::removeMetadataPool(const std::string &name)
+{
+  FilesystemPriv *priv = privOf<FilesystemPriv>(mPriv);
+  std::map<std::string, std::string>::iterator it = priv->mtdPools.begin();
+
+  while (it != priv->mtdPools.end())
+  {
+    if ((*it).second == name)
+      priv->mtdPools.erase(it++);
+    else
+      it++;
+  }
+
+  return 0;
+}
+
+std::vector<std::string>
+Filesystem::allPoolsInCluster() const
+{
+  FilesystemPriv *priv = privOf<FilesystemPriv>(mPriv);
+  std::vector<std::string> pools;
+  std::map<std::string, std::string>::const_iterator it;
+
+  for (it = priv->dataPools.begin(); it != priv->dataPools.end(); it++)
+    pools.push_back((*it).second);
+
+  for (it = priv->mtdPools.begin(); it != priv->mtdPools.end(); it++)
+    pools.push_back((*it).second);
+
+  return pools;
+}
+
+int
+Filesystem::statCluster(uint64_t *totalSpaceKb, uint64_t *usedSpaceKb,
+                        uint64_t *availableSpaceKb, uint64_t *numberOfObjects)
+{
+  uint64_t used = 0, objects = 0;
+
+  roundTrip(0);
+
+  {
+    XrdSysRWLockHelper lock(memCluster.lock, true);
+    std::map<std::string, MemObject *>::const_iterator it;
+
+    for (it = memCluster.mObjects.begin(); it != memCluster.mObjects.end(); it++)
+    {
+      used += (*it).second->data.size();
+      objects++;
+    }
+  }
+
+  // a cluster of 1 PB
+  if (totalSpaceKb)
+    *totalSpaceKb = 1ULL << 40;
+  if (usedSpaceKb)
+    *usedSpaceKb = used / 1024;
+  if (availableSpaceKb)
+    *availableSpaceKb = (1ULL << 40) - used / 1024;
+  if (numberOfObjects)
+    *numberOfObjects = objects;
+
+  return 0;
+}
+
+void
+Filesystem::setIds(uid_t uid, gid_t gid)
+{
+  privOf<FilesystemPriv>(mPriv)->uid = uid;
+  privOf<FilesystemPriv>(mPriv)->gid = gid;
+}
+
+int
+Filesystem::stat(const std::string &path, struct stat *buff)
+{
+  roundTrip(0);
+
+  return statPath(path, buff);
+}
+
+std::vector<std::pair<int, struct stat> >
+Filesystem::stat(const std::vector<std::string> &paths)
+{
+  std::vector<std::pair<int, struct stat> > results(paths.size());
+
+  // the stats are sent in parallel
+  roundTrip(0);
+
+  for (size_t i = 0; i < paths.size(); i++)
+    results[i].first = statPath(paths[i], &results[i].second);
+
+  return results;
+}
+
+void
+Filesystem::setFileChunkSize(const size_t size)
+{
+  privOf<FilesystemPriv>(mPriv)->chunkSize = size;
+}
+
+size_t
+Filesystem::fileChunkSize() const
+{
+  return privOf<FilesystemPriv>(mPriv)->chunkSize;
+}
+
+FsObj *
+Filesystem::getFsObj(const std::string &path)
+{
+  struct stat buff;
+
+  if (stat(path, &buff) != 0)
+    return 0;
+
+  if (S_ISDIR(buff.st_mode))
+    return new Dir(this, path);
+
+  return new File(this, path);
+}
+
+FsObj::FsObj(Filesystem *radosFs, const std::string &path)
+{
+  FsObjPriv *priv = new FsObjPriv;
+  priv->fs = radosFs;
+  priv->path = normalizePath(path);
+  setPriv(mPriv, priv);
+}
+
+FsObj::~FsObj()
+{
+  deletePriv(mPriv);
+}
+
+std::string
+FsObj::path() const
+{
+  return privOf<FsObjPriv>(mPriv)->path;
+}
+
+void
+FsObj::setPath(const std::string &path)
+{
+  privOf<FsObjPriv>(mPriv)->path = normalizePath(path);
+}
+
+Filesystem *
+FsObj::filesystem() const
+{
+  return privOf<FsObjPriv>(mPriv)->fs;
+}
+
+bool
+FsObj::exists() const
+{
+  struct stat buff;
+
+  return filesystem()->stat(path(), &buff) == 0;
+}
+
+bool
+FsObj::isWritable()
+{
+  return true;
+}
+
+bool
+FsObj::isReadable()
+{
+  return true;
+}
+
+bool
+FsObj::isFile() const
+{
+  struct stat buff;
+
+  return statPath(path(), &buff) == 0 && !S_ISDIR(buff.st_mode);
+}
+
+bool
+FsObj::isDir() const
+{
+  struct stat buff;
+
+  return statPath(path(), &buff) == 0 && S_ISDIR(buff.st_mode);
+}
+
+int
+FsObj::stat(struct stat *buff)
+{
+  return filesystem()->stat(path(), buff);
+}
+
+void
+FsObj::update()
+{
+}
+
+int
+FsObj::chmod(long int permissions)
+{
+  roundTrip(0);
+
+  XrdSysRWLockHelper lock(memCluster.lock, false);
+  MemObject *object = findAny(path(), 0);
+
+  if (!object)
+    return -ENOENT;
+
+  object->mode = (object->mode & S_IFMT) | (permissions & ~S_IFMT);
+
+  return 0;
+}
+
+int
+FsObj::chown(uid_t uid, gid_t gid)
+{
+  roundTrip(0);
+
+  XrdSysRWLockHelper lock(memCluster.lock, false);
+  MemObject *object = findAny(path(), 0);
+
+  if (!object)
+    return -ENOENT;
+
+  object->uid = uid;
+  object->gid = gid;
+
+  return 0;
+}
+
+int
+FsObj::setUid(uid_t uid)
+{
+  struct stat buff;
+  int ret = stat(&buff);
+
+  return ret == 0 ? chown(uid, buff.st_gid) : ret;
+}
+
+int
+FsObj::setGid(gid_t gid)
+{
+  struct stat buff;
+  int ret = stat(&buff);
+
+  return ret == 0 ? chown(buff.st_uid, gid) : ret;
+}
+
+int
+FsObj::rename(const std::string &newPath)
+{
+  std::string key;
+
+  roundTrip(0);
+
+  XrdSysRWLockHelper lock(memCluster.lock, false);
+  MemObject *object = findAny(path(), &key);
+
+  if (!object)
+    return -ENOENT;
+
+  std::string newKey = object->isDir ? dirKey(newPath) : fileKey(newPath);
+
+  if (findAny(newPath, 0))
+    return -EEXIST;
+
+  if (!memCluster.find(Dir::getParent(newKey, 0)))
+    return -ENOENT;
+
+  // directories are moved together with everything under them
+  std::vector<std::string> keys;
+  std::map<std::string, MemObject *>::iterator it;
+
+  for (it = memCluster.mObjects.lower_bound(key);
+       it != memCluster.mObjects.end() &&
+       (*it).first.compare(0, key.length(), key) == 0;
+       it++)
+  {
+    if ((*it).first == key || object->isDir)
+      keys.push_back((*it).first);
+  }
+
+  for (size_t i = 0; i < keys.size(); i++)
+  {
+    std::string movedKey = newKey + keys[i].substr(key.length());
+
+    memCluster.mObjects[movedKey] = memCluster.mObjects[keys[i]];
+    memCluster.mObjects.erase(keys[i]);
+
+    if (memCluster.mLogs.count(keys[i]) > 0)
+    {
+      memCluster.mLogs[movedKey] = memCluster.mLogs[keys[i]];
+      memCluster.mEntries[movedKey] = memCluster.mEntries[keys[i]];
+      memCluster.mLogs.erase(keys[i]);
+      memCluster.mEntries.erase(keys[i]);
+    }
+  }
+
+  memCluster.logEntry(key, false);
+  memCluster.logEntry(newKey, true);
+  setPath(newKey);
+
+  return 0;
+}
+
+int
+FsObj::setXAttr(const std::string &attrName, const std::string &value)
+{
+  roundTrip(value.length());
+
+  XrdSysRWLockHelper lock(memCluster.lock, false);
+  MemObject *object = findAny(path(), 0);
+
+  if (!object)
+    return -ENOENT;
+
+  object->xattrs[attrName] = value;
+
+  return 0;
+}
+
+int
+FsObj::getXAttr(const std::string &attrName, std::string &value)
+{
+  roundTrip(0);
+
+  XrdSysRWLockHelper lock(memCluster.lock, true);
+  MemObject *object = findAny(path(), 0);
+
+  if (!object)
+    return -ENOENT;
+
+  if (object->xattrs.count(attrName) == 0)
+    return -ENODATA;
+
+  value = object->xattrs[attrName];
+
+  return value.length();
+}
+
+int
+FsObj::removeXAttr(const std::string &attrName)
+{
+  roundTrip(0);
+
+  XrdSysRWLockHelper lock(memCluster.lock, false);
+  MemObject *object = findAny(path(), 0);
+
+  if (!object)
+    return -ENOENT;
+
+  object->xattrs.erase(attrName);
+
+  return 0;
+}
+
+int
+FsObj::getXAttrsMap(std::map<std::string, std::string> &map)
+{
+  roundTrip(0);
+
+  XrdSysRWLockHelper lock(memCluster.lock, true);
+  MemObject *object = findAny(path(), 0);
+
+  if (!object)
+    return -ENOENT;
+
+  map = object->xattrs;
+
+  return 0;
+}
+
+File::File(Filesystem *radosFs, const std::string &path, OpenMode mode)
+  : FsObj(radosFs, fileKey(path))
+{
+  FilePriv *priv = new FilePriv;
+  priv->mode = mode;
+  setPriv(mPriv, priv);
+}
+
+File::~File()
+{
+  deletePriv(mPriv);
+}
+
+File::OpenMode
+File::mode() const
+{
+  return privOf<FilePriv>(mPriv)->mode;
+}
+
+ssize_t
+File::read(char *buff, off_t offset, size_t blen)
+{
+  ssize_t ret = 0;
+  size_t chunkSize;
+
+  {
+    XrdSysRWLockHelper lock(memCluster.lock, true);
+    MemObject *object = memCluster.find(path());
+
+    if (!object)
+      return -ENOENT;
+
+    XrdSysMutexHelper dataLock(memCluster.dataMutex);
+
+    chunkSize = object->chunkSize;
+
+    if (offset < (off_t) object->data.size())
+    {
+      ret = std::min(blen, (size_t) (object->data.size() - offset));
+      memcpy(buff, &object->data[offset], ret);
+    }
+  }
+
+  // Like RadosFS, the stripe objects covered by the read are read one after
+  // the other
+  off_t pos = offset;
+  off_t end = offset + std::max(ret, (ssize_t) 0);
+
+  do
+  {
+    off_t chunkEnd = std::min(end, pos - pos % (off_t) chunkSize +
+                                   (off_t) chunkSize);
+    roundTrip(chunkEnd - pos, filesystem());
+    pos = chunkEnd;
+  } while (pos < end);
+
+  return ret;
+}
+
+int
+File::writeSync(const char *buff, off_t offset, size_t blen)
+{
+  roundTrip(blen, filesystem());
+
+  XrdSysRWLockHelper lock(memCluster.lock, true);
+  MemObject *object = memCluster.find(path());
+
+  if (!object)
+    return -ENOENT;
+
+  XrdSysMutexHelper dataLock(memCluster.dataMutex);
+
+  if (offset + blen > object->data.size())
+    object->data.resize(offset + blen);
+
+  memcpy(&object->data[offset], buff, blen);
+  clock_gettime(CLOCK_REALTIME, &object->mtime);
+
+  return 0;
+}
+
+int
+File::write(const char *buff, off_t offset, size_t blen)
+{
+  return writeSync(buff, offset, blen);
+}
+
+int
+File::create(int permissions, const std::string pool, size_t chunk,
+             ssize_t inlineBufferSize)
+{
+  uid_t uid;
+  gid_t gid;
+
+  roundTrip(0);
+
+  filesystem()->getIds(&uid, &gid);
+
+  XrdSysRWLockHelper lock(memCluster.lock, false);
+
+  if (findAny(path(), 0))
+    return -EEXIST;
+
+  if (!memCluster.find(Dir::getParent(path(), 0)))
+    return -ENOENT;
+
+  if (permissions < 0)
+    permissions = 0644;
+
+  MemObject *object =
+      MemCluster::newObject(false, S_IFREG | (permissions & 07777), uid, gid);
+  object->chunkSize = chunk > 0 ? chunk : filesystem()->fileChunkSize();
+  memCluster.mObjects[path()] = object;
+  memCluster.logEntry(path(), true);
+
+  return 0;
+}
+
+int
+File::remove()
+{
+  size_t objects = 1;
+
+  {
+    XrdSysRWLockHelper lock(memCluster.lock, true);
+    MemObject *object = memCluster.find(path());
+
+    if (object)
+    {
+      size_t chunkSize = object->chunkSize;
+      XrdSysMutexHelper dataLock(memCluster.dataMutex);
+
+      objects += (object->data.size() + chunkSize - 1) / chunkSize;
+    }
+  }
+
+  // Like RadosFS, the metadata and then each stripe object are removed one
+  // after the other
+  for (size_t i = 0; i < objects; i++)
+    roundTrip(0);
+
+  XrdSysRWLockHelper lock(memCluster.lock, false);
+  MemObject *object = memCluster.find(path());
+
+  if (!object)
+    return -ENOENT;
+
+  delete object;
+  memCluster.mObjects.erase(path());
+  memCluster.logEntry(path(), false);
+
+  return 0;
+}
+
+int
+File::truncate(unsigned long long size)
+{
+  size_t objects = 1;
+
+  {
+    XrdSysRWLockHelper lock(memCluster.lock, true);
+    MemObject *object = memCluster.find(path());
+
+    if (object && object->data.size() > size)
+    {
+      size_t chunkSize = object->chunkSize;
+      XrdSysMutexHelper dataLock(memCluster.dataMutex);
+
+      objects += (object->data.size() + chunkSize - 1) / chunkSize -
+                 (size + chunkSize - 1) / chunkSize;
+    }
+  }
+
+  // Like RadosFS, the stripe objects past the new size are removed one after
+  // the other
+  for (size_t i = 0; i < objects; i++)
+    roundTrip(0);
+
+  XrdSysRWLockHelper lock(memCluster.lock, true);
+  MemObject *object = memCluster.find(path());
+
+  if (!object)
+    return -ENOENT;
+
+  XrdSysMutexHelper dataLock(memCluster.dataMutex);
+  object->data.resize(size);
+
+  return 0;
+}
+
+bool
+File::isWritable()
+{
+  return (mode() & MODE_WRITE) != 0;
+}
+
+bool
+File::isReadable()
+{
+  return (mode() & MODE_READ) != 0;
+}
+
+void
+File::update()
+{
+}
+
+void
+File::setPath(const std::string &path)
+{
+  FsObj::setPath(fileKey(path));
+}
+
+int
+File::stat(struct stat *buff)
+{
+  return FsObj::stat(buff);
+}
+
+int
+File::chmod(long int permissions)
+{
+  return FsObj::chmod(permissions);
+}
+
+int
+File::rename(const std::string &newPath)
+{
+  return FsObj::rename(newPath);
+}
+
+int
+File::sync()
+{
+  // Waiting for the cluster to acknowledge the writes
+  roundTrip(0);
+
+  return 0;
+}
+
+Dir::Dir(Filesystem *radosFs, const std::string &path)
+  : FsObj(radosFs, dirKey(path))
+{
+  setPriv(mPriv, new DirPriv);
+}
+
+Dir::~Dir()
+{
+  deletePriv(mPriv);
+}
+
+std::string
+Dir::getParent(const std::string &path, int *pos)
+{
+  size_t end = path.length();
+
+  while (end > 0 && path[end - 1] == '/')
+    end--;
+
+  if (end == 0)
+    return "";
+
+  size_t slash = path.rfind('/', end - 1);
+
+  if (slash == std::string::npos)
+    return "";
+
+  if (pos)
+    *pos = slash;
+
+  return path.substr(0, slash + 1);
+}
+
+int
+Dir::create(int mode, bool mkpath, int ownerUid, int ownerGid)
+{
+  std::string parent = getParent(path(), 0);
+  uid_t uid;
+  gid_t gid;
+
+  filesystem()->getIds(&uid, &gid);
+
+  if (ownerUid >= 0)
+    uid = ownerUid;
+  if (ownerGid >= 0)
+    gid = ownerGid;
+  if (mode < 0)
+    mode = 0755;
+
+  if (mkpath && parent != "")
+  {
+    Dir parentDir(filesystem(), parent);
+    int ret = parentDir.create(mode, true, ownerUid, ownerGid);
+
+    if (ret != 0 && ret != -EEXIST)
+      return ret;
+  }
+
+  roundTrip(0);
+
+  XrdSysRWLockHelper lock(memCluster.lock, false);
+
+  if (findAny(path(), 0))
+    return -EEXIST;
+
+  if (!memCluster.find(parent))
+    return -ENOENT;
+
+  memCluster.mObjects[path()] =
+      MemCluster::newObject(true, S_IFDIR | (mode & 07777), uid, gid);
+  memCluster.mLogs[path()] = "";
+  memCluster.logEntry(path(), true);
+
+  return 0;
+}
+
+int
+Dir::remove()
+{
+  roundTrip(0);
+
+  XrdSysRWLockHelper lock(memCluster.lock, false);
+  MemObject *object = memCluster.find(path());
+
+  if (!object)
+    return -ENOENT;
+
+  if (!memCluster.mEntries[path()].empty())
+    return -ENOTEMPTY;
+
+  if (path() == "/")
+    return -EPERM;
+
+  delete object;
+  memCluster.mObjects.erase(path());
+  memCluster.mLogs.erase(path());
+  memCluster.mEntries.erase(path());
+  memCluster.logEntry(path(), false);
+
+  return 0;
+}
+
+void
+Dir::update()
+{
+  refresh();
+}
+
+void
+Dir::refresh()
+{
+  DirPriv *priv = privOf<DirPriv>(mPriv);
+
+  roundTrip(0);
+
+  XrdSysRWLockHelper lock(memCluster.lock, true);
+  const std::set<std::string> &entries = memCluster.mEntries[path()];
+
+  priv->entries.assign(entries.begin(), entries.end());
+}
+
+int
+Dir::entryList(std::set<std::string> &entries)
+{
+  DirPriv *priv = privOf<DirPriv>(mPriv);
+
+  entries.clear();
+  entries.insert(priv->entries.begin(), priv->entries.end());
+
+  return 0;
+}
+
+int
+Dir::entry(int entryIndex, std::string &path)
+{
+  DirPriv *priv = privOf<DirPriv>(mPriv);
+
+  if (entryIndex < 0 || entryIndex >= (int) priv->entries.size())
+    path = "";
+  else
+    path = priv->entries[entryIndex];
+
+  return 0;
+}
+
+void
+Dir::setPath(const std::string &path)
+{
+  FsObj::setPath(dirKey(path));
+}
+
+bool
+Dir::isWritable()
+{
+  return true;
+}
+
+bool
+Dir::isReadable()
+{
+  return true;
+}
+
+int
+Dir::stat(struct stat *buff)
+{
+  return FsObj::stat(buff);
+}
+
+int
+Dir::chmod(long int permissions)
+{
+  return FsObj::chmod(permissions);
+}
+
+int
+Dir::rename(const std::string &newName)
+{
+  return FsObj::rename(newName);
+}
+
+void
+Filesystem::getIds(uid_t *uid, gid_t *gid) const
+{
+  *uid = privOf<FilesystemPriv>(mPriv)->uid;
+  *gid = privOf<FilesystemPriv>(mPriv)->gid;
+}
+
+} // namespace radosfs
+
+// The plugin's directory cache reads the directories' log objects directly
+// with librados, and its space monitor the pools' stats
+
+extern "C"
+{
+
+static int memRadosHandle;
+
+int
+rados_create(rados_t *cluster, const char * const id)
+{
+  *cluster = (rados_t) &memRadosHandle;
+  return 0;
+}
+
+int
+rados_conf_read_file(rados_t cluster, const char *path)
+{
+  return 0;
+}
+
+int
+rados_connect(rados_t cluster)
+{
+  return 0;
+}
+
+void
+rados_shutdown(rados_t cluster)
+{
+}
+
+int
+rados_ioctx_create(rados_t cluster, const char *pool_name,
+                   rados_ioctx_t *ioctx)
+{
+  *ioctx = (rados_ioctx_t) cluster;
+  return 0;
+}
+
+void
+rados_ioctx_destroy(rados_ioctx_t io)
+{
+}
+
+int
+rados_stat(rados_ioctx_t io, const char *o, uint64_t *psize, time_t *pmtime)
+{
+  roundTrip(0);
+
+  XrdSysRWLockHelper lock(memCluster.lock, true);
+  std::map<std::string, std::string>::const_iterator it;
+
+  it = memCluster.mLogs.find(o);
+
+  if (it == memCluster.mLogs.end())
+    return -ENOENT;
+
+  if (psize)
+    *psize = (*it).second.length();
+  if (pmtime)
+  {
+    std::map<std::string, time_t>::const_iterator mtime;
+    mtime = memCluster.mLogMtimes.find(o);
+    *pmtime = mtime == memCluster.mLogMtimes.end() ? 0 : (*mtime).second;
+  }
+
+  return 0;
+}
+
+// Data is not kept per pool, so every pool reports all of it
+int
+rados_ioctx_pool_stat(rados_ioctx_t io, struct rados_pool_stat_t *stats)
+{
+  uint64_t used = 0, objects = 0;
+
+  roundTrip(0);
+
+  XrdSysRWLockHelper lock(memCluster.lock, true);
+  std::map<std::string, MemObject *>::const_iterator it;
+
+  for (it = memCluster.mObjects.begin(); it != memCluster.mObjects.end(); it++)
+  {
+    used += (*it).second->data.size();
+    objects++;
+  }
+
+  memset(stats, 0, sizeof(*stats));
+  stats->num_bytes = used;
+  stats->num_kb = used / 1024;
+  stats->num_objects = objects;
+  stats->num_object_copies = objects;
+
+  return 0;
+}
+
+int
+rados_read(rados_ioctx_t io, const char *oid, char *buf, size_t len,
+           uint64_t off)
+{
+  int ret = 0;
+
+  {
+    XrdSysRWLockHelper lock(memCluster.lock, true);
+    std::map<std::string, std::string>::const_iterator it;
+
+    it = memCluster.mLogs.find(oid);
+
+    if (it == memCluster.mLogs.end())
+      return -ENOENT;
+
+    const std::string &log = (*it).second;
+
+    if (off < log.length())
+    {
+      ret = std::min(len, (size_t) (log.length() - off));
+      memcpy(buf, log.data() + off, ret);
+    }
+  }
+
+  roundTrip(ret);
+
+  return ret;
+}
+
+}
+
+void
+memRadosCompactDirLog(const char *dirPath)
+{
+  XrdSysRWLockHelper lock(memCluster.lock, false);
+  std::string key = dirKey(dirPath);
+  std::set<std::string> entries = memCluster.mEntries[key];
+  std::set<std::string>::const_iterator it;
+
+  memCluster.mLogs[key] = "";
+
+  for (it = entries.begin(); it != entries.end(); it++)
+    memCluster.logEntry(key + *it, true);
+}
@@ -0,0 +1,45 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __MEM_RADOS_HH__
+#define __MEM_RADOS_HH__
+
+#include <stdint.h>
+
+// In-memory stand-in for libradosfs and the parts of librados used by the
+// plugin, so it can be benchmarked without a Ceph cluster. Every operation
+// which would be a round trip to RADOS sleeps for the configured latency
+// plus the time needed to transfer its data at the configured bandwidth.
+
+// latency per operation, in microseconds
+void memRadosSetLatency(uint64_t latencyUs);
+
+// bytes per second, 0 means unlimited
+void memRadosSetBandwidth(uint64_t bytesPerSec);
+
+// bytes per second of each client (Filesystem instance), shared by all its
+// operations, 0 means unlimited
+void memRadosSetClientBandwidth(uint64_t bytesPerSec);
+
+// rewrites the log of a directory with only its current entries, as a
+// compaction of the log does
+void memRadosCompactDirLog(const char *dirPath);
+
+#endif /* __MEM_RADOS_HH__ */
@@ -0,0 +1,732 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+// Drives the plugin through the XrdOss interface against the in-memory
+// stand-in of RADOS and prints one JSON object per measurement, e.g.:
+//
+//   radososs-benchmark --threads 1,8 --file-sizes 4M --latency-us 500
+//
+// Run it with --help for all the options.
+
+#include <XrdOss/XrdOss.hh>
+#include <XrdOuc/XrdOucEnv.hh>
+#include <XrdSys/XrdSysPthread.hh>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "BenchmarkUtils.hh"
+#include "MemRados.hh"
+#include "RadosOssDefines.hh"
+#include "RadosOssFile.hh"
+
+typedef struct {
+  std::vector<size_t> threads;
+  std::vector<size_t> fileSizes;
+  std::vector<std::string> workloads;
+  std::vector<std::string> ossConf;
+  size_t blockSize;
+  size_t metadataOps;
+  size_t dirEntries;
+  size_t readdirIterations;
+  size_t readVOps;
+  size_t readVSegments;
+  size_t readVSegmentSize;
+  uint64_t latencyUs;
+  uint64_t bandwidth;
+  uint64_t clientBandwidth;
+  std::string output;
+} BenchConf;
+
+class Benchmark;
+struct Worker;
+
+typedef void (*WorkloadFn)(Worker &worker);
+
+// What every thread of a run does and measures
+struct Worker
+{
+  Benchmark *bench;
+  WorkloadFn fn;
+  size_t id;
+  size_t fileSize;
+  unsigned int seed;
+  uint64_t ops;
+  uint64_t bytes;
+  uint64_t errors;
+  std::vector<uint64_t> latencies;
+};
+
+static void
+recordOp(Worker &worker, uint64_t start, ssize_t ret)
+{
+  worker.latencies.push_back(nowUs() - start);
+  worker.ops++;
+
+  if (ret < 0)
+    worker.errors++;
+  else
+    worker.bytes += ret;
+}
+
+class Benchmark
+{
+public:
+  Benchmark(const BenchConf &conf, XrdOss *oss, FILE *output)
+    : conf(conf),
+      oss(oss),
+      env(BENCH_ENV),
+      mOutput(output),
+      mRun(0),
+      mDirPopulated(false)
+  {}
+
+  std::string dataFile(size_t fileSize, size_t id) const
+  {
+    std::ostringstream path;
+    path << "/bench/data/" << fileSize << "/f" << id;
+    return path.str();
+  }
+
+  std::string runDir(size_t id) const
+  {
+    std::ostringstream path;
+    path << "/bench/run" << mRun << "/t" << id << "/";
+    return path.str();
+  }
+
+  std::string metadataFile(size_t index) const
+  {
+    std::ostringstream path;
+    path << "/bench/meta/f" << index;
+    return path.str();
+  }
+
+  int prepare(size_t threads, size_t fileSize);
+  void run(const std::string &workload, WorkloadFn fn, size_t threads,
+           size_t fileSize);
+
+  const BenchConf &conf;
+  XrdOss *oss;
+  XrdOucEnv env;
+
+private:
+  static void * workerThread(void *worker);
+  int writeFile(const std::string &path, size_t size);
+  void report(const std::string &workload, size_t threads, size_t fileSize,
+              const std::vector<Worker> &workers, uint64_t elapsedUs);
+
+  FILE *mOutput;
+  size_t mRun;
+  bool mDirPopulated;
+};
+
+int
+Benchmark::writeFile(const std::string &path, size_t size)
+{
+  std::vector<char> block(conf.blockSize, 'x');
+  int ret = oss->Create(BENCH_TIDENT, path.c_str(), 0644, env, XRDOSS_mkpath);
+
+  if (ret != 0 && ret != -EEXIST)
+    return ret;
+
+  XrdOssDF *file = oss->newFile(BENCH_TIDENT);
+  ret = file->Open(path.c_str(), O_RDWR, 0644, env);
+
+  for (size_t offset = 0; ret == 0 && offset < size; offset += block.size())
+  {
+    size_t length = std::min(block.size(), size - offset);
+    ssize_t written = file->Write(&block[0], offset, length);
+
+    if (written < 0)
+      ret = written;
+  }
+
+  file->Close();
+  delete file;
+
+  return ret;
+}
+
+// Creates the files the read and metadata workloads need; this is done
+// without the injected latency
+int
+Benchmark::prepare(size_t threads, size_t fileSize)
+{
+  struct stat buff;
+  int ret = 0;
+
+  memRadosSetLatency(0);
+  memRadosSetBandwidth(0);
+  memRadosSetClientBandwidth(0);
+
+  for (size_t i = 0; ret == 0 && fileSize > 0 && i < threads; i++)
+  {
+    if (oss->Stat(dataFile(fileSize, i).c_str(), &buff, 0, &env) != 0)
+      ret = writeFile(dataFile(fileSize, i), fileSize);
+  }
+
+  for (size_t i = 0; ret == 0 && fileSize == 0 && !mDirPopulated &&
+       i < conf.dirEntries; i++)
+  {
+    ret = oss->Create(BENCH_TIDENT, metadataFile(i).c_str(), 0644, env,
+                      XRDOSS_mkpath);
+  }
+
+  if (fileSize == 0)
+    mDirPopulated = ret == 0;
+
+  memRadosSetLatency(conf.latencyUs);
+  memRadosSetBandwidth(conf.bandwidth);
+  memRadosSetClientBandwidth(conf.clientBandwidth);
+
+  return ret;
+}
+
+void *
+Benchmark::workerThread(void *worker)
+{
+  Worker *w = (Worker *) worker;
+
+  w->fn(*w);
+
+  return 0;
+}
+
+void
+Benchmark::run(const std::string &workload, WorkloadFn fn, size_t threads,
+               size_t fileSize)
+{
+  std::vector<Worker> workers(threads);
+  std::vector<pthread_t> tids(threads);
+  uint64_t start;
+
+  mRun++;
+
+  for (size_t i = 0; i < threads; i++)
+  {
+    workers[i].bench = this;
+    workers[i].fn = fn;
+    workers[i].id = i;
+    workers[i].fileSize = fileSize;
+    workers[i].seed = i + 1;
+    workers[i].ops = workers[i].bytes = workers[i].errors = 0;
+  }
+
+  start = nowUs();
+
+  for (size_t i = 0; i < threads; i++)
+    XrdSysThread::Run(&tids[i], Benchmark::workerThread, &workers[i],
+                      XRDSYSTHREAD_HOLD, "RadosOss benchmark");
+
+  for (size_t i = 0; i < threads; i++)
+    XrdSysThread::Join(tids[i], 0);
+
+  report(workload, threads, fileSize, workers, nowUs() - start);
+}
+
+void
+Benchmark::report(const std::string &workload, size_t threads,
+                  size_t fileSize, const std::vector<Worker> &workers,
+                  uint64_t elapsedUs)
+{
+  std::vector<uint64_t> latencies;
+  uint64_t ops = 0, bytes = 0, errors = 0;
+  double seconds = elapsedUs / 1000000.0;
+
+  for (size_t i = 0; i < workers.size(); i++)
+  {
+    ops += workers[i].ops;
+    bytes += workers[i].bytes;
+    errors += workers[i].errors;
+    latencies.insert(latencies.end(), workers[i].latencies.begin(),
+                     workers[i].latencies.end());
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+
+  if (seconds <= 0)
+    seconds = 0.000001;
+
+  fprintf(mOutput, "{\"workload\": \"%s\", \"threads\": %lu, "
+          "\"file_size\": %lu, \"block_size\": %lu, \"latency_us\": %llu, "
+          "\"bandwidth\": %llu, \"client_bandwidth\": %llu, "
+          "\"ops\": %llu, \"errors\": %llu, "
+          "\"bytes\": %llu, \"seconds\": %.6f, \"ops_per_sec\": %.1f, "
+          "\"mb_per_sec\": %.2f, \"p50_us\": %llu, \"p90_us\": %llu, "
+          "\"p99_us\": %llu, \"max_us\": %llu}\n",
+          workload.c_str(), (unsigned long) threads,
+          (unsigned long) fileSize, (unsigned long) conf.blockSize,
+          (unsigned long long) conf.latencyUs,
+          (unsigned long long) conf.bandwidth,
+          (unsigned long long) conf.clientBandwidth, (unsigned long long) ops,
+          (unsigned long long) errors, (unsigned long long) bytes, seconds,
+          ops / seconds, bytes / seconds / (1024 * 1024),
+          (unsigned long long) percentile(latencies, 0.5),
+          (unsigned long long) percentile(latencies, 0.9),
+          (unsigned long long) percentile(latencies, 0.99),
+          (unsigned long long) (latencies.empty() ? 0 : latencies.back()));
+  fflush(mOutput);
+}
+
+static void
+seqWrite(Worker &worker)
+{
+  Benchmark *bench = worker.bench;
+  std::vector<char> block(bench->conf.blockSize, 'w');
+  std::string path = bench->runDir(worker.id) + "file";
+  uint64_t start = nowUs();
+  int ret = bench->oss->Create(BENCH_TIDENT, path.c_str(), 0644, bench->env,
+                               XRDOSS_mkpath);
+  XrdOssDF *file = bench->oss->newFile(BENCH_TIDENT);
+
+  if (ret == 0)
+    ret = file->Open(path.c_str(), O_RDWR, 0644, bench->env);
+
+  recordOp(worker, start, ret < 0 ? ret : 0);
+
+  for (off_t offset = 0; ret == 0 && offset < (off_t) worker.fileSize;
+       offset += block.size())
+  {
+    size_t length = std::min(block.size(), worker.fileSize - offset);
+
+    start = nowUs();
+    recordOp(worker, start, file->Write(&block[0], offset, length));
+  }
+
+  // Closing flushes whatever is still buffered so it counts too
+  start = nowUs();
+  recordOp(worker, start, file->Close());
+  delete file;
+
+  bench->oss->Unlink(path.c_str(), 0, &bench->env);
+}
+
+static void
+readFile(Worker &worker, bool sequential, bool pageChecksums)
+{
+  Benchmark *bench = worker.bench;
+  std::vector<char> block(bench->conf.blockSize);
+  std::vector<uint32_t> csvec(block.size() / PGIO_PAGE_SIZE + 2);
+  std::string path = bench->dataFile(worker.fileSize, worker.id);
+  size_t numBlocks = (worker.fileSize + block.size() - 1) / block.size();
+  XrdOssDF *file = bench->oss->newFile(BENCH_TIDENT);
+  int ret = file->Open(path.c_str(), O_RDONLY, 0, bench->env);
+
+  for (size_t i = 0; ret == 0 && i < numBlocks; i++)
+  {
+    size_t blockIndex = sequential ? i : rand_r(&worker.seed) % numBlocks;
+    off_t offset = blockIndex * block.size();
+    uint64_t start = nowUs();
+
+    if (pageChecksums)
+      recordOp(worker, start,
+               static_cast<RadosOssFile *>(file)->pgRead(&block[0], offset,
+                                                         block.size(),
+                                                         &csvec[0], 0));
+    else
+      recordOp(worker, start, file->Read(&block[0], offset, block.size()));
+  }
+
+  if (ret != 0)
+    recordOp(worker, nowUs(), ret);
+
+  file->Close();
+  delete file;
+}
+
+static void
+seqRead(Worker &worker)
+{
+  readFile(worker, true, false);
+}
+
+static void
+randRead(Worker &worker)
+{
+  readFile(worker, false, false);
+}
+
+static void
+pgRead(Worker &worker)
+{
+  readFile(worker, true, true);
+}
+
+static void
+randWrite(Worker &worker)
+{
+  Benchmark *bench = worker.bench;
+  std::vector<char> block(bench->conf.blockSize, 'r');
+  std::string path = bench->dataFile(worker.fileSize, worker.id);
+  size_t numBlocks = worker.fileSize / block.size();
+  XrdOssDF *file = bench->oss->newFile(BENCH_TIDENT);
+  int ret = file->Open(path.c_str(), O_RDWR, 0, bench->env);
+  uint64_t start;
+
+  for (size_t i = 0; ret == 0 && i < numBlocks; i++)
+  {
+    size_t blockIndex = rand_r(&worker.seed) % numBlocks;
+
+    start = nowUs();
+    recordOp(worker, start, file->Write(&block[0], blockIndex * block.size(),
+                                        block.size()));
+  }
+
+  start = nowUs();
+  recordOp(worker, start, ret == 0 ? file->Close() : ret);
+  delete file;
+}
+
+static void
+readV(Worker &worker)
+{
+  Benchmark *bench = worker.bench;
+  const BenchConf &conf = bench->conf;
+  std::vector<char> buff(conf.readVSegments * conf.readVSegmentSize);
+  std::vector<XrdOucIOVec> segments(conf.readVSegments);
+  std::string path = bench->dataFile(worker.fileSize, worker.id);
+  size_t maxOffset = worker.fileSize > conf.readVSegmentSize ?
+                     worker.fileSize - conf.readVSegmentSize : 0;
+  XrdOssDF *file = bench->oss->newFile(BENCH_TIDENT);
+  int ret = file->Open(path.c_str(), O_RDONLY, 0, bench->env);
+
+  for (size_t i = 0; ret == 0 && i < conf.readVOps; i++)
+  {
+    for (size_t j = 0; j < segments.size(); j++)
+    {
+      segments[j].offset = maxOffset ? rand_r(&worker.seed) % maxOffset : 0;
+      segments[j].size = conf.readVSegmentSize;
+      segments[j].info = 0;
+      segments[j].data = &buff[j * conf.readVSegmentSize];
+    }
+
+    uint64_t start = nowUs();
+    recordOp(worker, start, file->ReadV(&segments[0], segments.size()));
+  }
+
+  if (ret != 0)
+    recordOp(worker, nowUs(), ret);
+
+  file->Close();
+  delete file;
+}
+
+static void
+statFiles(Worker &worker)
+{
+  Benchmark *bench = worker.bench;
+  struct stat buff;
+
+  for (size_t i = 0; i < bench->conf.metadataOps; i++)
+  {
+    size_t index = rand_r(&worker.seed) % bench->conf.dirEntries;
+    std::string path = bench->metadataFile(index);
+    uint64_t start = nowUs();
+    int ret = bench->oss->Stat(path.c_str(), &buff, 0, &bench->env);
+
+    recordOp(worker, start, ret < 0 ? ret : 0);
+  }
+}
+
+static void
+createUnlink(Worker &worker)
+{
+  Benchmark *bench = worker.bench;
+
+  for (size_t i = 0; i < bench->conf.metadataOps / 2; i++)
+  {
+    std::ostringstream path;
+    path << bench->runDir(worker.id) << "f" << i;
+
+    uint64_t start = nowUs();
+    int ret = bench->oss->Create(BENCH_TIDENT, path.str().c_str(), 0644,
+                                 bench->env, XRDOSS_mkpath);
+    recordOp(worker, start, ret < 0 ? ret : 0);
+
+    start = nowUs();
+    ret = bench->oss->Unlink(path.str().c_str(), 0, &bench->env);
+    recordOp(worker, start, ret < 0 ? ret : 0);
+  }
+}
+
+// Every op is a whole listing of the directory
+static void
+listDir(Worker &worker)
+{
+  Benchmark *bench = worker.bench;
+  char name[1024];
+
+  for (size_t i = 0; i < bench->conf.readdirIterations; i++)
+  {
+    XrdOssDF *dir = bench->oss->newDir(BENCH_TIDENT);
+    uint64_t start = nowUs();
+    int ret = dir->Opendir("/bench/meta/", bench->env);
+
+    while (ret == 0)
+    {
+      ret = dir->Readdir(name, sizeof(name));
+
+      if (name[0] == '\0')
+        break;
+    }
+
+    dir->Close();
+    recordOp(worker, start, ret < 0 ? ret : 0);
+    delete dir;
+  }
+}
+
+typedef struct {
+  const char *name;
+  WorkloadFn fn;
+  bool perFileSize;
+} Workload;
+
+static const Workload workloads[] = {
+  {"seqwrite", seqWrite, true},
+  {"seqread", seqRead, true},
+  {"randread", randRead, true},
+  {"pgread", pgRead, true},
+  {"randwrite", randWrite, true},
+  {"readv", readV, true},
+  {"stat", statFiles, false},
+  {"createunlink", createUnlink, false},
+  {"readdir", listDir, false},
+  {0, 0, false}
+};
+
+static bool
+parseSizeList(const char *str, std::vector<size_t> &sizes)
+{
+  std::string item;
+  std::istringstream list(str);
+
+  sizes.clear();
+
+  while (std::getline(list, item, ','))
+  {
+    uint64_t size;
+
+    if (!parseSize(item.c_str(), size) || size == 0)
+      return false;
+
+    sizes.push_back(size);
+  }
+
+  return !sizes.empty();
+}
+
+static void
+usage(const char *program)
+{
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --workloads LIST          comma separated, from: seqwrite, seqread,\n"
+          "                            randread, pgread, randwrite, readv,\n"
+          "                            stat, createunlink, readdir\n"
+          "                            (default: all)\n"
+          "  --threads LIST            thread counts (default: 1,4,16)\n"
+          "  --file-sizes LIST         file sizes (default: 4M,64M)\n"
+          "  --block-size SIZE         size of reads and writes (default: 1M)\n"
+          "  --latency-us N            latency of every RADOS operation\n"
+          "                            (default: 500)\n"
+          "  --bandwidth SIZE          bytes per second per operation, 0 for\n"
+          "                            unlimited (default: 0)\n"
+          "  --client-bandwidth SIZE   bytes per second of each RADOS client,\n"
+          "                            shared by its operations, 0 for\n"
+          "                            unlimited (default: 0)\n"
+          "  --metadata-ops N          stat and create/unlink ops per thread\n"
+          "                            (default: 2000)\n"
+          "  --dir-entries N           entries of the listed directory\n"
+          "                            (default: 10000)\n"
+          "  --readdir-iterations N    listings per thread (default: 10)\n"
+          "  --readv-ops N             ReadV calls per thread (default: 200)\n"
+          "  --readv-segments N        segments per ReadV (default: 16)\n"
+          "  --readv-segment-size SIZE size of the segments (default: 4K)\n"
+          "  --conf 'DIRECTIVE VALUE'  extra plugin configuration, may be\n"
+          "                            repeated\n"
+          "  --output FILE             where to write the results (default:\n"
+          "                            stdout)\n"
+          "Sizes accept the K, M and G suffixes. Every result is printed as a\n"
+          "JSON object in its own line.\n", program);
+}
+
+static bool
+parseArgs(int argc, char **argv, BenchConf &conf)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    uint64_t value;
+
+    if (arg == "--help" || arg == "-h" || i + 1 >= argc)
+      return false;
+
+    const char *param = argv[++i];
+
+    if (arg == "--workloads")
+    {
+      std::string item;
+      std::istringstream list(param);
+
+      conf.workloads.clear();
+      while (std::getline(list, item, ','))
+        conf.workloads.push_back(item);
+    }
+    else if (arg == "--threads")
+    {
+      if (!parseSizeList(param, conf.threads))
+        return false;
+    }
+    else if (arg == "--file-sizes")
+    {
+      if (!parseSizeList(param, conf.fileSizes))
+        return false;
+    }
+    else if (arg == "--conf")
+    {
+      conf.ossConf.push_back(param);
+    }
+    else if (arg == "--output")
+    {
+      conf.output = param;
+    }
+    else if (!parseSize(param, value))
+    {
+      return false;
+    }
+    else if (arg == "--block-size" && value > 0)
+      conf.blockSize = value;
+    else if (arg == "--latency-us")
+      conf.latencyUs = value;
+    else if (arg == "--bandwidth")
+      conf.bandwidth = value;
+    else if (arg == "--client-bandwidth")
+      conf.clientBandwidth = value;
+    else if (arg == "--metadata-ops")
+      conf.metadataOps = value;
+    else if (arg == "--dir-entries" && value > 0)
+      conf.dirEntries = value;
+    else if (arg == "--readdir-iterations")
+      conf.readdirIterations = value;
+    else if (arg == "--readv-ops")
+      conf.readVOps = value;
+    else if (arg == "--readv-segments" && value > 0)
+      conf.readVSegments = value;
+    else if (arg == "--readv-segment-size" && value > 0)
+      conf.readVSegmentSize = value;
+    else
+      return false;
+  }
+
+  return true;
+}
+
+int
+main(int argc, char **argv)
+{
+  BenchConf conf;
+  FILE *output = stdout;
+
+  conf.blockSize = 1024 * 1024;
+  conf.metadataOps = 2000;
+  conf.dirEntries = 10000;
+  conf.readdirIterations = 10;
+  conf.readVOps = 200;
+  conf.readVSegments = 16;
+  conf.readVSegmentSize = 4096;
+  conf.latencyUs = 500;
+  conf.bandwidth = 0;
+  conf.clientBandwidth = 0;
+  parseSizeList("1,4,16", conf.threads);
+  parseSizeList("4M,64M", conf.fileSizes);
+
+  for (int i = 0; workloads[i].name; i++)
+    conf.workloads.push_back(workloads[i].name);
+
+  if (!parseArgs(argc, argv, conf))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (conf.output != "" && !(output = fopen(conf.output.c_str(), "w")))
+  {
+    fprintf(stderr, "Failed to open %s: %s\n", conf.output.c_str(),
+            strerror(errno));
+    return 1;
+  }
+
+  XrdOss *oss = loadPlugin(conf.ossConf);
+
+  if (!oss)
+    return 1;
+
+  Benchmark bench(conf, oss, output);
+
+  for (size_t w = 0; w < conf.workloads.size(); w++)
+  {
+    const Workload *workload = workloads;
+
+    while (workload->name && conf.workloads[w] != workload->name)
+      workload++;
+
+    if (!workload->name)
+    {
+      fprintf(stderr, "Unknown workload %s\n", conf.workloads[w].c_str());
+      return 1;
+    }
+
+    std::vector<size_t> fileSizes(1, 0);
+
+    if (workload->perFileSize)
+      fileSizes = conf.fileSizes;
+
+    for (size_t s = 0; s < fileSizes.size(); s++)
+    {
+      for (size_t t = 0; t < conf.threads.size(); t++)
+      {
+        if (bench.prepare(conf.threads[t], fileSizes[s]) != 0)
+        {
+          fprintf(stderr, "Failed to prepare the %s workload\n",
+                  workload->name);
+          return 1;
+        }
+
+        bench.run(workload->name, workload->fn, conf.threads[t],
+                  fileSizes[s]);
+      }
+    }
+  }
+
+  if (output != stdout)
+    fclose(output);
+
+  return 0;
+}
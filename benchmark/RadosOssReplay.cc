@@ -0,0 +1,840 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+// Replays a trace written by the plugin (radososs.trace.file) against the
+// plugin and the in-memory stand-in of RADOS, e.g.:
+//
+//   radososs-replay --trace radososs.trace --conf "radososs.readahead.depth 8"
+//
+// Every thread of the trace gets its own thread which issues the same calls
+// in the same order, at the same times (or as fast as possible with --fast).
+// As traces only keep hashes of the paths, every path becomes a file
+// (/replay/f<hash>) or directory (/replay/d<hash>/) which is created
+// beforehand, as big as the reads it gets and with as many entries as were
+// listed. The results are printed as one JSON object per operation.
+
+#include <XrdOss/XrdOss.hh>
+#include <XrdOuc/XrdOucEnv.hh>
+#include <XrdSys/XrdSysPthread.hh>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "BenchmarkUtils.hh"
+#include "MemRados.hh"
+#include "RadosOssDefines.hh"
+#include "RadosOssFile.hh"
+#include "RadosOssMetrics.hh"
+
+typedef struct {
+  std::string traceFile;
+  std::vector<std::string> ossConf;
+  bool fast;
+  double speed;
+  uint64_t latencyUs;
+  uint64_t bandwidth;
+  std::string output;
+} ReplayConf;
+
+struct ReplayOp
+{
+  RadosOssTraceRecord record;
+  // Where the segments of a ReadV start in Replay::segments
+  size_t firstSegment;
+};
+
+// Replay results of one kind of operation
+struct OpResults
+{
+  uint64_t count;
+  uint64_t errors;
+  uint64_t tracedErrors;
+  uint64_t skipped;
+  std::vector<uint64_t> latencies;
+  std::vector<uint64_t> tracedLatencies;
+
+  OpResults() : count(0), errors(0), tracedErrors(0), skipped(0) {}
+};
+
+class Replay;
+
+struct ReplayThread
+{
+  Replay *replay;
+  std::vector<size_t> ops;
+  std::map<int, OpResults> results;
+  uint64_t maxLagUs;
+};
+
+// An open file or directory of the trace; it is deleted once closed and
+// no longer used by any thread
+struct ReplayHandle
+{
+  XrdOssDF *df;
+  int refs;
+};
+
+class Replay
+{
+public:
+  Replay(const ReplayConf &conf)
+    : conf(conf),
+      env(BENCH_ENV),
+      oss(0),
+      traceStart(0),
+      replayStart(0)
+  {}
+
+  int load(void);
+  int prepare(void);
+  void run(FILE *output);
+
+  std::string filePath(uint64_t hash) const;
+  std::string dirPath(uint64_t hash) const;
+  std::string path(uint64_t hash) const;
+
+  XrdOssDF * acquireHandle(uint64_t handle);
+  void releaseHandle(uint64_t handle, XrdOssDF *df, bool close);
+  void addHandle(uint64_t handle, XrdOssDF *df);
+
+  const ReplayConf &conf;
+  XrdOucEnv env;
+  XrdOss *oss;
+  std::vector<ReplayOp> ops;
+  std::vector<XrdOucIOVec> segments;
+  std::set<uint64_t> dirs;
+  uint64_t traceStart;
+  uint64_t replayStart;
+
+private:
+  static void * replayThread(void *thread);
+  void replayOps(ReplayThread &thread);
+  int replayOp(const ReplayOp &op, std::vector<char> &buff);
+  void report(FILE *output, const std::vector<ReplayThread> &threads,
+              uint64_t elapsedUs);
+
+  std::map<uint32_t, std::vector<size_t> > mThreadOps;
+  XrdSysMutex mHandlesMutex;
+  std::map<uint64_t, ReplayHandle> mHandles;
+};
+
+int
+Replay::load()
+{
+  RadosOssTraceHeader header;
+  RadosOssTraceRecord record;
+  FILE *trace = fopen(conf.traceFile.c_str(), "r");
+
+  if (!trace)
+    return -errno;
+
+  if (fread(&header, sizeof(header), 1, trace) != 1 ||
+      memcmp(header.magic, RADOS_OSS_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != RADOS_OSS_TRACE_VERSION ||
+      header.recordSize != sizeof(RadosOssTraceRecord))
+  {
+    fclose(trace);
+    return -EINVAL;
+  }
+
+  // A trace which is still being written may end with a partial record,
+  // which is ignored
+  while (fread(&record, sizeof(record), 1, trace) == 1)
+  {
+    if (record.op == RADOS_OSS_TRACE_SEGMENT)
+    {
+      XrdOucIOVec segment;
+
+      memset(&segment, 0, sizeof(segment));
+      segment.offset = record.offset;
+      segment.size = record.length;
+      segments.push_back(segment);
+      continue;
+    }
+
+    if (record.op >= RADOS_OSS_NUM_OPS)
+      continue;
+
+    ReplayOp op;
+    op.record = record;
+    op.firstSegment = segments.size();
+    ops.push_back(op);
+
+    if (traceStart == 0 || record.start < traceStart)
+      traceStart = record.start;
+  }
+
+  fclose(trace);
+
+  // Only the segments of the last ReadV can be missing, if the trace was cut
+  if (!ops.empty() && ops.back().record.op == RADOS_OSS_OP_READV)
+    ops.back().record.flags = segments.size() - ops.back().firstSegment;
+
+  // Records are written when the operations finish, so they are sorted by
+  // their start for each thread to replay them in the original order
+  std::vector<std::pair<uint64_t, size_t> > order(ops.size());
+
+  for (size_t i = 0; i < ops.size(); i++)
+    order[i] = std::make_pair(ops[i].record.start, i);
+
+  std::stable_sort(order.begin(), order.end());
+
+  for (size_t i = 0; i < order.size(); i++)
+  {
+    const RadosOssTraceRecord &record = ops[order[i].second].record;
+
+    mThreadOps[record.thread].push_back(order[i].second);
+
+    if (record.op == RADOS_OSS_OP_OPENDIR || record.op == RADOS_OSS_OP_MKDIR ||
+        record.op == RADOS_OSS_OP_REMDIR)
+      dirs.insert(record.pathHash);
+  }
+
+  return 0;
+}
+
+std::string
+Replay::filePath(uint64_t hash) const
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/replay/f%016llx", (unsigned long long) hash);
+
+  return path;
+}
+
+std::string
+Replay::dirPath(uint64_t hash) const
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/replay/d%016llx/", (unsigned long long) hash);
+
+  return path;
+}
+
+std::string
+Replay::path(uint64_t hash) const
+{
+  if (dirs.count(hash))
+    return dirPath(hash);
+
+  return filePath(hash);
+}
+
+// Creates what the traced operations expect to exist: a file or directory
+// for every path unless the trace shows it was created or did not exist at
+// first, files as big as the furthest byte read from them and directories
+// with as many entries as the longest listing. This is done without the
+// injected latency.
+int
+Replay::prepare()
+{
+  std::map<uint64_t, bool> create;
+  std::map<uint64_t, uint64_t> fileSizes;
+  std::map<uint64_t, size_t> handleEntries;
+  std::map<uint64_t, uint64_t> handlePaths;
+  std::map<uint64_t, size_t> dirEntries;
+  int ret = 0;
+
+  memRadosSetLatency(0);
+  memRadosSetBandwidth(0);
+
+  for (size_t i = 0; i < ops.size(); i++)
+  {
+    const RadosOssTraceRecord &record = ops[i].record;
+    uint64_t end = 0;
+
+    if (create.count(record.pathHash) == 0)
+    {
+      bool created = record.op == RADOS_OSS_OP_CREATE ||
+                     record.op == RADOS_OSS_OP_MKDIR ||
+                     (record.op == RADOS_OSS_OP_OPEN &&
+                      (record.flags & O_CREAT));
+
+      create[record.pathHash] = !created && record.result != -ENOENT;
+    }
+
+    switch (record.op)
+    {
+      case RADOS_OSS_OP_READ:
+      case RADOS_OSS_OP_AIO_READ:
+      case RADOS_OSS_OP_PGREAD:
+      case RADOS_OSS_OP_PREREAD:
+        end = record.offset + record.length;
+        break;
+      case RADOS_OSS_OP_READV:
+        for (size_t j = 0; j < record.flags; j++)
+        {
+          const XrdOucIOVec &segment = segments[ops[i].firstSegment + j];
+          end = std::max(end, (uint64_t) (segment.offset + segment.size));
+        }
+        break;
+      case RADOS_OSS_OP_OPENDIR:
+        handlePaths[record.handle] = record.pathHash;
+        break;
+      case RADOS_OSS_OP_READDIR:
+        handleEntries[record.handle]++;
+        break;
+      default:
+        break;
+    }
+
+    if (end > fileSizes[record.pathHash])
+      fileSizes[record.pathHash] = end;
+  }
+
+  // The last Readdir of a listing returns no entry
+  std::map<uint64_t, size_t>::const_iterator it;
+  for (it = handleEntries.begin(); it != handleEntries.end(); it++)
+  {
+    uint64_t hash = handlePaths[(*it).first];
+    size_t entries = (*it).second > 0 ? (*it).second - 1 : 0;
+
+    dirEntries[hash] = std::max(dirEntries[hash], entries);
+  }
+
+  std::vector<char> block(1024 * 1024, 'r');
+  std::map<uint64_t, bool>::const_iterator createIt;
+
+  for (createIt = create.begin(); ret == 0 && createIt != create.end();
+       createIt++)
+  {
+    uint64_t hash = (*createIt).first;
+
+    if (!(*createIt).second)
+      continue;
+
+    if (dirs.count(hash))
+    {
+      ret = oss->Mkdir(dirPath(hash).c_str(), 0755, 1, &env);
+
+      for (size_t i = 0; ret == 0 && i < dirEntries[hash]; i++)
+      {
+        char entry[32];
+        snprintf(entry, sizeof(entry), "e%lu", (unsigned long) i);
+        ret = oss->Create(BENCH_TIDENT, (dirPath(hash) + entry).c_str(), 0644,
+                          env, XRDOSS_mkpath);
+      }
+
+      continue;
+    }
+
+    std::string path = filePath(hash);
+    uint64_t size = fileSizes[hash];
+    ret = oss->Create(BENCH_TIDENT, path.c_str(), 0644, env, XRDOSS_mkpath);
+
+    if (ret != 0 || size == 0)
+      continue;
+
+    XrdOssDF *file = oss->newFile(BENCH_TIDENT);
+    ret = file->Open(path.c_str(), O_RDWR, 0644, env);
+
+    for (uint64_t offset = 0; ret == 0 && offset < size;
+         offset += block.size())
+    {
+      ssize_t written = file->Write(&block[0], offset,
+                                    std::min((uint64_t) block.size(),
+                                             size - offset));
+      if (written < 0)
+        ret = written;
+    }
+
+    file->Close();
+    delete file;
+  }
+
+  memRadosSetLatency(conf.latencyUs);
+  memRadosSetBandwidth(conf.bandwidth);
+
+  return ret;
+}
+
+void
+Replay::addHandle(uint64_t handle, XrdOssDF *df)
+{
+  XrdSysMutexHelper lock(mHandlesMutex);
+  ReplayHandle &replayHandle = mHandles[handle];
+
+  replayHandle.df = df;
+  replayHandle.refs = 1;
+}
+
+XrdOssDF *
+Replay::acquireHandle(uint64_t handle)
+{
+  XrdSysMutexHelper lock(mHandlesMutex);
+  std::map<uint64_t, ReplayHandle>::iterator it = mHandles.find(handle);
+
+  if (it == mHandles.end())
+    return 0;
+
+  (*it).second.refs++;
+
+  return (*it).second.df;
+}
+
+void
+Replay::releaseHandle(uint64_t handle, XrdOssDF *df, bool close)
+{
+  XrdSysMutexHelper lock(mHandlesMutex);
+  std::map<uint64_t, ReplayHandle>::iterator it = mHandles.find(handle);
+
+  if (it == mHandles.end() || (*it).second.df != df)
+    return;
+
+  // Closing also drops the reference taken when the handle was opened
+  if (close)
+    (*it).second.refs--;
+
+  if (--(*it).second.refs == 0)
+  {
+    delete df;
+    mHandles.erase(it);
+  }
+}
+
+// Returns the result of the operation or 1 if it could not be replayed
+// (e.g. its handle was not opened)
+int
+Replay::replayOp(const ReplayOp &op, std::vector<char> &buff)
+{
+  const RadosOssTraceRecord &record = op.record;
+  std::string path = this->path(record.pathHash);
+  XrdOssDF *df = 0;
+  struct stat statBuff;
+  ssize_t ret = 0;
+
+  if (record.handle != 0 && record.op != RADOS_OSS_OP_OPEN &&
+      record.op != RADOS_OSS_OP_OPENDIR)
+  {
+    df = acquireHandle(record.handle);
+
+    if (!df)
+      return 1;
+  }
+
+  if (buff.size() < record.length || buff.empty())
+    buff.resize(std::max(record.length, (uint64_t) 1));
+
+  switch (record.op)
+  {
+    case RADOS_OSS_OP_STAT:
+      ret = oss->Stat(path.c_str(), &statBuff, 0, &env);
+      break;
+    case RADOS_OSS_OP_STATFS:
+    {
+      char statFs[1024];
+      int blen = sizeof(statFs);
+      ret = oss->StatFS(path.c_str(), statFs, blen, &env);
+      break;
+    }
+    case RADOS_OSS_OP_CREATE:
+      ret = oss->Create(BENCH_TIDENT, path.c_str(), record.length, env,
+                        record.flags);
+      break;
+    case RADOS_OSS_OP_MKDIR:
+      ret = oss->Mkdir(path.c_str(), record.length, record.flags, &env);
+      break;
+    case RADOS_OSS_OP_REMDIR:
+      ret = oss->Remdir(path.c_str(), 0, &env);
+      break;
+    case RADOS_OSS_OP_UNLINK:
+      ret = oss->Unlink(path.c_str(), 0, &env);
+      break;
+    case RADOS_OSS_OP_TRUNCATE:
+      ret = oss->Truncate(path.c_str(), record.offset, &env);
+      break;
+    case RADOS_OSS_OP_CHMOD:
+      ret = oss->Chmod(path.c_str(), record.length, &env);
+      break;
+    case RADOS_OSS_OP_RENAME:
+      ret = oss->Rename(path.c_str(), this->path(record.offset).c_str(),
+                        &env, &env);
+      break;
+    case RADOS_OSS_OP_OPEN:
+      df = oss->newFile(BENCH_TIDENT);
+      ret = df->Open(path.c_str(), record.flags, record.length, env);
+      break;
+    case RADOS_OSS_OP_OPENDIR:
+      df = oss->newDir(BENCH_TIDENT);
+      ret = df->Opendir(path.c_str(), env);
+      break;
+    case RADOS_OSS_OP_CLOSE:
+    case RADOS_OSS_OP_CLOSEDIR:
+      ret = df->Close();
+      break;
+    case RADOS_OSS_OP_READ:
+    case RADOS_OSS_OP_AIO_READ:
+      ret = df->Read(&buff[0], record.offset, record.length);
+      break;
+    case RADOS_OSS_OP_PREREAD:
+      ret = df->Read(record.offset, record.length);
+      break;
+    case RADOS_OSS_OP_READV:
+    {
+      std::vector<XrdOucIOVec> readV(segments.begin() + op.firstSegment,
+                                     segments.begin() + op.firstSegment +
+                                     record.flags);
+      size_t pos = 0;
+
+      for (size_t i = 0; i < readV.size(); i++)
+      {
+        readV[i].data = &buff[pos];
+        pos += readV[i].size;
+      }
+
+      ret = df->ReadV(&readV[0], readV.size());
+      break;
+    }
+    case RADOS_OSS_OP_WRITE:
+    case RADOS_OSS_OP_AIO_WRITE:
+      ret = df->Write(&buff[0], record.offset, record.length);
+      break;
+    case RADOS_OSS_OP_PGREAD:
+    case RADOS_OSS_OP_PGWRITE:
+    {
+      std::vector<uint32_t> csvec(record.length / PGIO_PAGE_SIZE + 2);
+      RadosOssFile *file = static_cast<RadosOssFile *>(df);
+
+      if (record.op == RADOS_OSS_OP_PGREAD)
+        ret = file->pgRead(&buff[0], record.offset, record.length, &csvec[0],
+                           0);
+      else
+        ret = file->pgWrite(&buff[0], record.offset, record.length,
+                            &csvec[0], RadosOssFile::doCalc);
+      break;
+    }
+    case RADOS_OSS_OP_FSYNC:
+      ret = df->Fsync();
+      break;
+    case RADOS_OSS_OP_FSTAT:
+      ret = df->Fstat(&statBuff);
+      break;
+    case RADOS_OSS_OP_READDIR:
+    {
+      char name[1024];
+      ret = df->Readdir(name, sizeof(name));
+      break;
+    }
+    default:
+      ret = 1;
+      break;
+  }
+
+  if (record.op == RADOS_OSS_OP_OPEN || record.op == RADOS_OSS_OP_OPENDIR)
+  {
+    if (ret == 0)
+      addHandle(record.handle, df);
+    else
+      delete df;
+  }
+  else if (df)
+  {
+    releaseHandle(record.handle, df, record.op == RADOS_OSS_OP_CLOSE ||
+                                     record.op == RADOS_OSS_OP_CLOSEDIR);
+  }
+
+  return ret < 0 ? ret : 0;
+}
+
+void *
+Replay::replayThread(void *thread)
+{
+  ReplayThread *replayThread = (ReplayThread *) thread;
+
+  replayThread->replay->replayOps(*replayThread);
+
+  return 0;
+}
+
+void
+Replay::replayOps(ReplayThread &thread)
+{
+  std::vector<char> buff;
+
+  for (size_t i = 0; i < thread.ops.size(); i++)
+  {
+    const ReplayOp &op = ops[thread.ops[i]];
+    const RadosOssTraceRecord &record = op.record;
+    OpResults &results = thread.results[record.op];
+
+    if (!conf.fast)
+    {
+      uint64_t due = replayStart +
+                     (uint64_t) ((record.start - traceStart) / conf.speed);
+      uint64_t now = nowUs();
+
+      if (due > now)
+      {
+        struct timespec wait;
+        wait.tv_sec = (due - now) / 1000000;
+        wait.tv_nsec = ((due - now) % 1000000) * 1000;
+        nanosleep(&wait, 0);
+      }
+      else if (now - due > thread.maxLagUs)
+      {
+        thread.maxLagUs = now - due;
+      }
+    }
+
+    uint64_t start = nowUs();
+    int ret = replayOp(op, buff);
+
+    if (ret == 1)
+    {
+      results.skipped++;
+      continue;
+    }
+
+    results.latencies.push_back(nowUs() - start);
+    results.tracedLatencies.push_back(record.duration);
+    results.count++;
+
+    if (ret < 0)
+      results.errors++;
+
+    if (record.result < 0)
+      results.tracedErrors++;
+  }
+}
+
+void
+Replay::run(FILE *output)
+{
+  std::vector<ReplayThread> threads(mThreadOps.size());
+  std::vector<pthread_t> tids(threads.size());
+  std::map<uint32_t, std::vector<size_t> >::iterator it = mThreadOps.begin();
+
+  for (size_t i = 0; i < threads.size(); i++, it++)
+  {
+    threads[i].replay = this;
+    threads[i].ops.swap((*it).second);
+    threads[i].maxLagUs = 0;
+  }
+
+  replayStart = nowUs();
+
+  for (size_t i = 0; i < threads.size(); i++)
+    XrdSysThread::Run(&tids[i], Replay::replayThread, &threads[i],
+                      XRDSYSTHREAD_HOLD, "RadosOss replay");
+
+  for (size_t i = 0; i < threads.size(); i++)
+    XrdSysThread::Join(tids[i], 0);
+
+  report(output, threads, nowUs() - replayStart);
+}
+
+void
+Replay::report(FILE *output, const std::vector<ReplayThread> &threads,
+               uint64_t elapsedUs)
+{
+  std::map<int, OpResults> results;
+  uint64_t traceEnd = traceStart;
+  uint64_t maxLagUs = 0;
+
+  for (size_t i = 0; i < ops.size(); i++)
+  {
+    const RadosOssTraceRecord &record = ops[i].record;
+    traceEnd = std::max(traceEnd, record.start + record.duration);
+  }
+
+  for (size_t i = 0; i < threads.size(); i++)
+  {
+    std::map<int, OpResults>::const_iterator it;
+
+    maxLagUs = std::max(maxLagUs, threads[i].maxLagUs);
+
+    for (it = threads[i].results.begin(); it != threads[i].results.end(); it++)
+    {
+      const OpResults &threadResults = (*it).second;
+      OpResults &opResults = results[(*it).first];
+
+      opResults.count += threadResults.count;
+      opResults.errors += threadResults.errors;
+      opResults.tracedErrors += threadResults.tracedErrors;
+      opResults.skipped += threadResults.skipped;
+      opResults.latencies.insert(opResults.latencies.end(),
+                                 threadResults.latencies.begin(),
+                                 threadResults.latencies.end());
+      opResults.tracedLatencies.insert(opResults.tracedLatencies.end(),
+                                       threadResults.tracedLatencies.begin(),
+                                       threadResults.tracedLatencies.end());
+    }
+  }
+
+  std::map<int, OpResults>::iterator it;
+  for (it = results.begin(); it != results.end(); it++)
+  {
+    OpResults &opResults = (*it).second;
+
+    std::sort(opResults.latencies.begin(), opResults.latencies.end());
+    std::sort(opResults.tracedLatencies.begin(),
+              opResults.tracedLatencies.end());
+
+    fprintf(output, "{\"op\": \"%s\", \"count\": %llu, \"errors\": %llu, "
+            "\"traced_errors\": %llu, \"skipped\": %llu, \"p50_us\": %llu, "
+            "\"p99_us\": %llu, \"traced_p50_us\": %llu, "
+            "\"traced_p99_us\": %llu}\n",
+            RadosOssMetrics::opName((RadosOssOp) (*it).first),
+            (unsigned long long) opResults.count,
+            (unsigned long long) opResults.errors,
+            (unsigned long long) opResults.tracedErrors,
+            (unsigned long long) opResults.skipped,
+            (unsigned long long) percentile(opResults.latencies, 0.5),
+            (unsigned long long) percentile(opResults.latencies, 0.99),
+            (unsigned long long) percentile(opResults.tracedLatencies, 0.5),
+            (unsigned long long) percentile(opResults.tracedLatencies, 0.99));
+  }
+
+  fprintf(output, "{\"op\": \"total\", \"count\": %llu, \"threads\": %lu, "
+          "\"fast\": %s, \"speed\": %.2f, \"latency_us\": %llu, "
+          "\"traced_seconds\": %.6f, \"replay_seconds\": %.6f, "
+          "\"max_lag_us\": %llu}\n",
+          (unsigned long long) ops.size(), (unsigned long) threads.size(),
+          conf.fast ? "true" : "false", conf.speed,
+          (unsigned long long) conf.latencyUs,
+          (traceEnd - traceStart) / 1000000.0, elapsedUs / 1000000.0,
+          (unsigned long long) maxLagUs);
+  fflush(output);
+}
+
+static void
+usage(const char *program)
+{
+  fprintf(stderr,
+          "Usage: %s --trace FILE [options]\n"
+          "  --fast                    issue the calls as fast as possible\n"
+          "                            instead of at their traced times\n"
+          "  --speed FACTOR            replay faster (> 1) or slower (< 1)\n"
+          "                            than traced (default: 1)\n"
+          "  --latency-us N            latency of every RADOS operation\n"
+          "                            (default: 500)\n"
+          "  --bandwidth SIZE          bytes per second per operation, 0 for\n"
+          "                            unlimited (default: 0)\n"
+          "  --conf 'DIRECTIVE VALUE'  extra plugin configuration, may be\n"
+          "                            repeated\n"
+          "  --output FILE             where to write the results (default:\n"
+          "                            stdout)\n", program);
+}
+
+static bool
+parseArgs(int argc, char **argv, ReplayConf &conf)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+
+    if (arg == "--fast")
+    {
+      conf.fast = true;
+      continue;
+    }
+
+    if (arg == "--help" || arg == "-h" || i + 1 >= argc)
+      return false;
+
+    const char *param = argv[++i];
+
+    if (arg == "--trace")
+      conf.traceFile = param;
+    else if (arg == "--conf")
+      conf.ossConf.push_back(param);
+    else if (arg == "--output")
+      conf.output = param;
+    else if (arg == "--speed")
+      conf.speed = atof(param);
+    else if (arg == "--latency-us")
+    {
+      if (!parseSize(param, conf.latencyUs))
+        return false;
+    }
+    else if (arg == "--bandwidth")
+    {
+      if (!parseSize(param, conf.bandwidth))
+        return false;
+    }
+    else
+      return false;
+  }
+
+  return conf.traceFile != "" && conf.speed > 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  ReplayConf conf;
+  FILE *output = stdout;
+
+  conf.fast = false;
+  conf.speed = 1;
+  conf.latencyUs = 500;
+  conf.bandwidth = 0;
+
+  if (!parseArgs(argc, argv, conf))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  Replay replay(conf);
+  int ret = replay.load();
+
+  if (ret != 0)
+  {
+    fprintf(stderr, "Failed to load the trace %s: %s\n",
+            conf.traceFile.c_str(), strerror(-ret));
+    return 1;
+  }
+
+  if (conf.output != "" && !(output = fopen(conf.output.c_str(), "w")))
+  {
+    fprintf(stderr, "Failed to open %s: %s\n", conf.output.c_str(),
+            strerror(errno));
+    return 1;
+  }
+
+  replay.oss = loadPlugin(conf.ossConf);
+
+  if (!replay.oss)
+    return 1;
+
+  if (replay.prepare() != 0)
+  {
+    fprintf(stderr, "Failed to prepare the files of the trace\n");
+    return 1;
+  }
+
+  replay.run(output);
+
+  if (output != stdout)
+    fclose(output);
+
+  return 0;
+}
@@ -18,131 +18,268 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
  ************************************************************************/
 
-#include <XrdOuc/XrdOucString.hh>
 #include <fcntl.h>
-#include "RadosOss.hh"
+#include <string.h>
+#include <algorithm>
 #include "DirInfo.hh"
 #include "RadosOssDefines.hh"
 
+namespace
+{
+// Orders the indexes of the log operations by entry name
+class LogOpNameLess
+{
+public:
+  LogOpNameLess(const std::vector<std::string *> &names) : mNames(names) {}
+
+  bool operator()(size_t a, size_t b) const
+  {
+    return *mNames[a] < *mNames[b];
+  }
+
+private:
+  const std::vector<std::string *> &mNames;
+};
+}
+
 DirInfo::DirInfo(const std::string &dirpath, rados_ioctx_t ioctx)
   : mPath(dirpath),
     mIoctx(ioctx),
     mLastCachedSize(0),
-    mLastReadByte(0)
+    mLastMtime(0),
+    mLastReadByte(0),
+    mVersion(0),
+    mMemory(0)
 {}
 
 DirInfo::DirInfo()
   : mPath(""),
     mIoctx(0),
     mLastCachedSize(0),
-    mLastReadByte(0)
+    mLastMtime(0),
+    mLastReadByte(0),
+    mVersion(0),
+    mMemory(0)
 {}
 
 DirInfo::~DirInfo() {};
 
-void
-DirInfo::parseContents(char *buff, int length)
+// Parses the complete lines in buff and returns how many bytes they take,
+// so an incomplete last line can be read again with the next chunk.
+size_t
+DirInfo::parseContents(const char *buff, size_t length,
+                       std::vector<LogOp> &ops)
 {
-  XrdOucString line;
-  XrdOucString contents(buff);
+  // we add the name key's length + 2 because we count
+  // the operation char (+ or -) and the "
+  const size_t namePos = strlen(INDEX_NAME_KEY) + 2;
+  const char *pos = buff;
+  const char *end = buff + length;
+  const char *lineEnd;
 
-  int i = 0;
-  while ((i = contents.tokenize(line, i, '\n')) != -1)
+  while ((lineEnd = (const char *) memchr(pos, '\n', end - pos)) != 0)
   {
-    bool add = true;
-    // we add the name key's length + 2 because we count
-    // the operation char (+ or -) and the "
-    int namePos = strlen(INDEX_NAME_KEY) + 2;
+    const char *line = pos;
+    const size_t lineLength = lineEnd - line;
 
-    if (line.length() < namePos)
+    pos = lineEnd + 1;
+
+    // we need at least the name's closing " after the name key
+    if (lineLength <= namePos)
       continue;
 
-    // we avoid including the last two chars because they are "\n
-    XrdOucString entry(line, namePos, line.length() - 2);
-    entry.replace("\\\"", "\"");
+    ops.push_back(LogOp());
+    LogOp &op = ops.back();
+    op.add = line[0] != '-';
+
+    // we avoid including the last char because it is the closing "
+    const char *name = line + namePos;
+    const char *nameEnd = lineEnd - 1;
 
-    if (mContentsMap.count(entry.c_str()) > 0)
+    if (memchr(name, '\\', nameEnd - name) == 0)
     {
-      if (line[0] == '-')
-      {
-	mContentsMap.erase(entry.c_str());
-      }
+      op.name.assign(name, nameEnd);
+      continue;
+    }
+
+    op.name.reserve(nameEnd - name);
+
+    for (const char *c = name; c < nameEnd; c++)
+    {
+      if (c[0] == '\\' && c + 1 < nameEnd && c[1] == '"')
+        c++;
+
+      op.name += *c;
     }
-    else
-      mContentsMap[entry.c_str()] = 1;
   }
+
+  return pos - buff;
 }
 
-int
-DirInfo::update()
+// Merges the operations read from the log into the sorted entries. Only the
+// last operation on each name counts, and removals are applied as tombstones
+// while the entries are copied into their new place.
+void
+DirInfo::applyOps(std::vector<LogOp> &ops)
 {
-  struct stat statBuff;
-  int ret = RadosOss::genericStat(mIoctx, mPath.c_str(), &statBuff);
+  std::vector<std::string *> names(ops.size());
+  std::vector<size_t> order(ops.size());
 
-  if (ret != 0)
-    return ret;
+  for (size_t i = 0; i < ops.size(); i++)
+  {
+    names[i] = &ops[i].name;
+    order[i] = i;
+  }
 
-  mUid = statBuff.st_uid;
-  mGid = statBuff.st_gid;
-  mMode = statBuff.st_mode;
+  std::stable_sort(order.begin(), order.end(), LogOpNameLess(names));
 
-  if (statBuff.st_size == mLastCachedSize)
-    return 0;
+  std::vector<std::string> merged;
+  merged.reserve(mEntries.size() + ops.size());
 
-  uint64_t buffLength = statBuff.st_size - mLastCachedSize;
-  char buff[buffLength];
+  size_t entry = 0;
+  size_t i = 0;
 
-  ret = rados_read(mIoctx, mPath.c_str(), buff, buffLength, mLastReadByte);
+  while (i < order.size())
+  {
+    // skip to the last operation on this name
+    size_t last = i;
+    while (last + 1 < order.size() &&
+           ops[order[last + 1]].name == ops[order[i]].name)
+      last++;
 
-  if (ret != 0)
+    LogOp &op = ops[order[last]];
+    i = last + 1;
+
+    while (entry < mEntries.size() && mEntries[entry] < op.name)
+    {
+      merged.push_back(std::string());
+      merged.back().swap(mEntries[entry++]);
+    }
+
+    if (entry < mEntries.size() && mEntries[entry] == op.name)
+      entry++;
+
+    if (op.add)
+    {
+      merged.push_back(std::string());
+      merged.back().swap(op.name);
+    }
+  }
+
+  while (entry < mEntries.size())
   {
-    mLastReadByte = ret;
-    buff[buffLength - 1] = '\0';
-    parseContents(buff, buffLength);
+    merged.push_back(std::string());
+    merged.back().swap(mEntries[entry++]);
   }
 
-  mLastCachedSize = mLastReadByte = statBuff.st_size;
+  mEntries.swap(merged);
 
-  return 0;
+  mMemory = mEntries.capacity() * sizeof(std::string);
+  for (size_t j = 0; j < mEntries.size(); j++)
+    mMemory += mEntries[j].capacity();
 }
 
-const std::string
-DirInfo::getEntry(int index)
+void
+DirInfo::reset()
 {
-  const int size = (int) mContentsMap.size();
+  mEntries.clear();
+  mMemory = 0;
+  mLastCachedSize = mLastReadByte = 0;
+  mTail.clear();
+}
 
-  if (index >= size)
-    return "";
+int
+DirInfo::update()
+{
+  uint64_t size;
+  time_t mtime;
+  int ret = rados_stat(mIoctx, mPath.c_str(), &size, &mtime);
 
-  std::map<std::string, int>::iterator it = mContentsMap.begin();
-  std::advance(it, index);
+  if (ret != 0)
+    return ret;
 
-  return (*it).first;
-}
+  if (size == mLastCachedSize && mtime == mLastMtime)
+    return 0;
 
-bool
-DirInfo::hasPermission(uid_t uid, gid_t gid, mode_t mode)
-{
-  if (uid == ROOT_UID)
-    return true;
+  bool changed = false;
 
-  mode_t usrPerm = S_IRUSR;
-  mode_t grpPerm = S_IRGRP;
-  mode_t othPerm = S_IROTH;
+  // The log was compacted (rewritten) so it needs to be read from scratch
+  if (size < mLastReadByte)
+  {
+    reset();
+    changed = true;
+  }
 
-  if ((mode & O_RDONLY) == 0)
+  std::vector<char> buff(std::min(size - mLastReadByte + mTail.size(),
+                                  (uint64_t) DIR_LOG_READ_CHUNK));
+  std::vector<LogOp> ops;
+  // The first read starts with the bytes already read, to check them
+  size_t check = mTail.size();
+  uint64_t offset = mLastReadByte - check;
+
+  while (offset < size)
   {
-    usrPerm = S_IWUSR;
-    grpPerm = S_IWGRP;
-    othPerm = S_IWOTH;
+    size_t length = std::min((uint64_t) buff.size(), size - offset);
+
+    ret = rados_read(mIoctx, mPath.c_str(), &buff[0], length, offset);
+
+    if (ret < 0)
+      return ret;
+
+    if (check > 0 && ((size_t) ret < check ||
+                      memcmp(&buff[0], mTail.data(), check) != 0))
+    {
+      reset();
+      ops.clear();
+      changed = true;
+      check = 0;
+      offset = 0;
+      buff.resize(std::min(size, (uint64_t) DIR_LOG_READ_CHUNK));
+      continue;
+    }
+
+    size_t parsed = parseContents(&buff[check], ret - check, ops);
+
+    if (parsed == 0)
+    {
+      // the rest of the log is an incomplete line
+      if ((size_t) ret < length || length == size - offset)
+      {
+        offset += check;
+        break;
+      }
+
+      // a line which does not fit in the buffer
+      buff.resize(buff.size() * 2);
+      continue;
+    }
+
+    size_t end = check + parsed;
+    size_t tailLength = std::min(end, (size_t) DIR_LOG_TAIL_CHECK);
+
+    mTail.assign(&buff[end - tailLength], tailLength);
+    offset += end;
+    check = 0;
   }
 
-  if (mUid == uid && (mMode & usrPerm))
-    return true;
-  if (mGid == gid && (mMode & grpPerm))
-    return true;
-  if (mMode & othPerm)
-    return true;
+  if (!ops.empty())
+    applyOps(ops);
+
+  if (changed || !ops.empty())
+    mVersion++;
+
+  mLastReadByte = offset;
+  mLastCachedSize = size;
+  mLastMtime = mtime;
+
+  return 0;
+}
+
+const std::string
+DirInfo::getEntry(int index)
+{
+  if (index < 0 || index >= (int) mEntries.size())
+    return "";
 
-  return false;
+  return mEntries[index];
 }
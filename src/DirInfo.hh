@@ -0,0 +1,76 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __DIR_INFO_HH__
+#define __DIR_INFO_HH__
+
+#include <rados/librados.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+// Contents of a directory, kept up to date by reading only what was appended
+// to the directory's log object since the last update. The last bytes read
+// are read again with the new ones: if they changed, the log was compacted
+// (rewritten) and it is read again from the start.
+// The entries are kept sorted in a contiguous vector so they can be accessed
+// by index in constant time; the operations read from the log are merged
+// into it in a single pass at the end of every update.
+class DirInfo
+{
+public:
+  DirInfo(const std::string &dirpath, rados_ioctx_t ioctx);
+  DirInfo();
+  virtual ~DirInfo();
+
+  int update(void);
+  const std::string getEntry(int index);
+  size_t numEntries(void) const { return mEntries.size(); }
+  uint64_t version(void) const { return mVersion; }
+  const std::vector<std::string> & entries(void) const { return mEntries; }
+  // Approximate memory used by the entries, in bytes
+  size_t memory(void) const { return mMemory; }
+
+private:
+  struct LogOp
+  {
+    bool add;
+    std::string name;
+  };
+
+  size_t parseContents(const char *buff, size_t length,
+                       std::vector<LogOp> &ops);
+  void applyOps(std::vector<LogOp> &ops);
+  void reset(void);
+
+  std::string mPath;
+  rados_ioctx_t mIoctx;
+  std::vector<std::string> mEntries;
+  uint64_t mLastCachedSize;
+  time_t mLastMtime;
+  uint64_t mLastReadByte;
+  // The bytes of the log right before mLastReadByte
+  std::string mTail;
+  uint64_t mVersion;
+  size_t mMemory;
+};
+
+#endif /* __DIR_INFO_HH__ */
@@ -18,12 +18,14 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
  ************************************************************************/
 
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sstream>
+#include <algorithm>
 #include <XrdSys/XrdSysError.hh>
 #include <XrdOuc/XrdOucEnv.hh>
 #include <XrdOuc/XrdOucString.hh>
@@ -34,9 +36,13 @@
 #include "RadosOssFile.hh"
 #include "RadosOssDir.hh"
 #include "RadosOssDefines.hh"
+#include "RadosOssHash.hh"
+#include "RadosOssMetrics.hh"
 
 extern XrdSysError OssEroute;
 
+RadosOss *OssInstance = 0;
+
 #define LOG_PREFIX "--- Ceph Oss Rados --- "
 
 extern "C"
@@ -51,23 +57,89 @@ extern "C"
     OssEroute.logger(Logger);
     RadosOss* cephOss = new RadosOss();
 
-    return (cephOss->Init(Logger, config_fn) ? 0 : (XrdOss*) cephOss);
+    if (cephOss->Init(Logger, config_fn) != 0)
+      return 0;
+
+    OssInstance = cephOss;
+
+    return (XrdOss*) cephOss;
   }
 }
 
 RadosOss::RadosOss()
+  : mNumClients(DEFAULT_CLIENTS),
+    mClientsRoundRobin(false),
+    mNextClient(0),
+    mStripeSize(0),
+    mCluster(0),
+    mAioThreads(DEFAULT_AIO_THREADS),
+    mOpThreads(DEFAULT_OP_THREADS),
+    mReadMaxInFlight(DEFAULT_READ_MAX_IN_FLIGHT),
+    mReadVMaxGap(DEFAULT_READV_MAX_GAP),
+    mReaddirPageSize(DEFAULT_READDIR_PAGE_SIZE),
+    mPoolTable(0),
+    mConfigMtime(0),
+    mPoolsReloadInterval(DEFAULT_POOLS_RELOAD_INTERVAL),
+    mPoolsReloaderCond(0),
+    mPoolsReloaderRunning(false),
+    mStopping(false),
+    mMetricsInterval(DEFAULT_METRICS_INTERVAL),
+    mDurabilityInterval(DEFAULT_DURABILITY_INTERVAL),
+    mStatFSInterval(DEFAULT_STATFS_INTERVAL)
 {
+  mStatCache.setMaxEntries(DEFAULT_STAT_CACHE_SIZE);
+  mStatCache.setTtl(DEFAULT_STAT_CACHE_TTL);
+  mStatCache.setMaxMissingEntries(DEFAULT_NEG_STAT_CACHE_SIZE);
+  mStatCache.setMissingTtl(DEFAULT_NEG_STAT_CACHE_TTL);
+  mReadaheadConf.depth = DEFAULT_READAHEAD_DEPTH;
+  mReadaheadConf.blockSize = DEFAULT_READAHEAD_BLOCK_SIZE;
+  mReadaheadConf.handleMemory = DEFAULT_READAHEAD_HANDLE_MEM;
+  mReadaheadBudget.setLimit(DEFAULT_READAHEAD_GLOBAL_MEM);
+  mBlockCache.setMaxSize(DEFAULT_BLOCK_CACHE_SIZE);
+  mBlockCache.setBlockSize(DEFAULT_BLOCK_CACHE_BLOCK_SIZE);
+  mWriteBehindConf.enabled = false;
+  mWriteBehindConf.bufferSize = DEFAULT_WRITE_BEHIND_BUFFER_SIZE;
+  mWriteBehindConf.maxInFlight = DEFAULT_WRITE_BEHIND_MAX_IN_FLIGHT;
+  mDirCache.setMaxDirs(DEFAULT_DIR_CACHE_SIZE);
+  mDirCache.setMaxMemory(DEFAULT_DIR_CACHE_MEMORY);
+  mKnownDirs.setMaxDirs(DEFAULT_KNOWN_DIRS_SIZE);
+  mReaper.setNumThreads(DEFAULT_UNLINK_REAPERS);
 }
 
 RadosOss::~RadosOss()
 {
+  // The files still to be synced need the thread pools
+  mFlusher.stop();
+  mReaper.stop();
+  mSpaceMonitor.stop();
+  mScheduler.stop();
+  stopPoolsReloader();
+  OssMetrics.stopExporter();
+  OssTrace.stop();
+
+  if (mPoolTable)
+    mPoolTable->unref();
+
+  std::map<std::string, rados_ioctx_t>::iterator it;
+  for (it = mMtdIoctxs.begin(); it != mMtdIoctxs.end(); it++)
+    rados_ioctx_destroy((*it).second);
+
+  if (mCluster)
+    rados_shutdown(mCluster);
+
+  std::vector<radosfs::Filesystem *>::iterator shardIt;
+  for (shardIt = mRadosFsShards.begin(); shardIt != mRadosFsShards.end();
+       shardIt++)
+    delete *shardIt;
 }
 
 int
 RadosOss::Init(XrdSysLogger *logger, const char *configFn)
 {
   std::string userName, configPath;
-  int ret = loadInfoFromConfig(configFn, configPath, userName);
+  std::vector<RadosOssPool> pools;
+  struct stat configStat;
+  int ret = loadInfoFromConfig(configFn, configPath, userName, pools);
 
   if (ret != 0)
   {
@@ -76,58 +148,503 @@ RadosOss::Init(XrdSysLogger *logger, const char *configFn)
     return ret;
   }
 
-  ret = mRadosFs.init(userName, configPath);
+  ret = initRadosFs(userName, configPath);
+
+  if (ret != 0)
+    return ret;
+
+  std::vector<RadosOssPool>::iterator it;
+  for (it = pools.begin(); it != pools.end(); it++)
+    addPoolToFs(*it);
+
+  mPoolTable = new RadosOssPoolTable(pools);
+  mConfigFn = configFn;
+
+  if (stat(configFn, &configStat) == 0)
+    mConfigMtime = configStat.st_mtime;
+
+  if (initCluster(userName, configPath) != 0 && mDirCache.enabled())
+  {
+    OssEroute.Emsg("Disabling the directory cache", "");
+    mDirCache.setMaxDirs(0);
+  }
+
+  // RadosFS has no asynchronous reads and writes, so every aio request
+  // takes one of these threads until RADOS completes it; at most
+  // mAioThreads of them are in flight and the others wait in the queue
+  ret = mIoPool.start(mAioThreads);
+
+  if (ret == 0)
+    ret = mOpPool.start(mOpThreads);
+
+  if (ret != 0)
+  {
+    OssEroute.Emsg("Failed to start the I/O threads", ":",
+                   strerror(abs(ret)));
+    return ret;
+  }
+
+  ret = mFlusher.start(this, mDurabilityInterval);
+
+  if (ret == 0 && mReaper.enabled())
+    ret = mReaper.start(this);
+
+  if (ret == 0)
+    ret = mSpaceMonitor.start(this, mStatFSInterval);
+
+  if (ret == 0 && mScheduler.enabled())
+    ret = mScheduler.start();
 
   if (ret != 0)
   {
-    OssEroute.Emsg("Problem when reading RadosFs config file",
-                   configPath.c_str(), ":", strerror(abs(ret)));
+    OssEroute.Emsg("Failed to start the background threads", ":",
+                   strerror(abs(ret)));
     return ret;
   }
 
-  std::vector<RadosOssPool>::iterator it = mPools.begin();
+  if (mPoolsReloadInterval > 0)
+    ret = startPoolsReloader();
 
-  while (it != mPools.end())
+  if (ret == 0 && mMetricsFile != "")
   {
-    int ret;
-    const RadosOssPool &pool = *it;
+    ret = OssMetrics.startExporter(mMetricsFile, mMetricsInterval);
 
-    if (pool.isMtdPool)
+    if (ret != 0)
     {
-      OssEroute.Say(LOG_PREFIX "Adding metadata pool ", pool.name.c_str(),
-                    "...");
-      ret = mRadosFs.addMetadataPool(pool.name, pool.prefix);
+      OssEroute.Emsg("Failed to start the metrics exporter", ":",
+                     strerror(abs(ret)));
+    }
+  }
 
-      if (ret != 0)
-      {
-        OssEroute.Emsg("Failed to add metadata pool", pool.name.c_str(), ":",
-                       strerror(abs(ret)));
-      }
+  if (ret == 0 && mTraceFile != "")
+  {
+    ret = OssTrace.start(mTraceFile);
+
+    if (ret != 0)
+    {
+      OssEroute.Emsg("Failed to start tracing to", mTraceFile.c_str(), ":",
+                     strerror(abs(ret)));
     }
-    else
+  }
+
+  return ret;
+}
+
+// Each filesystem has its own librados client, so the requests are not all
+// funneled through the messenger threads of a single one
+int
+RadosOss::initRadosFs(const std::string &userName,
+                      const std::string &configPath)
+{
+  for (size_t i = 0; i < mNumClients; i++)
+  {
+    radosfs::Filesystem *radosFs = new radosfs::Filesystem;
+    mRadosFsShards.push_back(radosFs);
+
+    int ret = radosFs->init(userName, configPath);
+
+    if (ret != 0)
     {
-      OssEroute.Say(LOG_PREFIX "Adding data pool ", pool.name.c_str(),
-                    "...");
+      OssEroute.Emsg("Problem when reading RadosFs config file",
+                     configPath.c_str(), ":", strerror(abs(ret)));
+      return ret;
+    }
 
-      ret = mRadosFs.addDataPool(pool.name, pool.prefix, pool.size);
+    // The filesystems are shared by all the requests so they are never
+    // switched to the clients' ids; their permissions are checked by the
+    // plugin instead
+    radosFs->setIds(ROOT_UID, ROOT_UID);
 
-      if (ret != 0)
-      {
-        OssEroute.Emsg("Failed to add data pool", pool.name.c_str(), ":",
-                       strerror(abs(ret)));
-      }
+    if (mStripeSize > 0)
+      radosFs->setFileChunkSize(mStripeSize);
+  }
+
+  return 0;
+}
+
+// All the operations on a path go through the same filesystem
+radosfs::Filesystem *
+RadosOss::radosFs(const std::string &path)
+{
+  if (mRadosFsShards.size() == 1)
+    return mRadosFsShards[0];
+
+  return mRadosFsShards[radosOssPathHash(path) %
+                        mRadosFsShards.size()];
+}
+
+radosfs::Filesystem *
+RadosOss::handleRadosFs(const std::string &path)
+{
+  if (!mClientsRoundRobin || mRadosFsShards.size() == 1)
+    return radosFs(path);
+
+  return mRadosFsShards[__sync_fetch_and_add(&mNextClient, 1) %
+                        mRadosFsShards.size()];
+}
+
+void
+RadosOss::addPoolToFs(const RadosOssPool &pool)
+{
+  std::vector<radosfs::Filesystem *>::iterator it;
+  int ret = 0;
+
+  if (pool.isMtdPool)
+  {
+    OssEroute.Say(LOG_PREFIX "Adding metadata pool ", pool.name.c_str(),
+                  "...");
+    for (it = mRadosFsShards.begin(); it != mRadosFsShards.end() && ret == 0;
+         it++)
+      ret = (*it)->addMetadataPool(pool.name, pool.prefix);
+
+    if (ret != 0)
+    {
+      OssEroute.Emsg("Failed to add metadata pool", pool.name.c_str(), ":",
+                     strerror(abs(ret)));
     }
+  }
+  else
+  {
+    OssEroute.Say(LOG_PREFIX "Adding data pool ", pool.name.c_str(),
+                  "...");
 
-    it++;
+    for (it = mRadosFsShards.begin(); it != mRadosFsShards.end() && ret == 0;
+         it++)
+      ret = (*it)->addDataPool(pool.name, pool.prefix, pool.size);
+
+    if (ret != 0)
+    {
+      OssEroute.Emsg("Failed to add data pool", pool.name.c_str(), ":",
+                     strerror(abs(ret)));
+    }
   }
+}
 
-  return ret;
+void
+RadosOss::removePoolFromFs(const RadosOssPool &pool)
+{
+  std::vector<radosfs::Filesystem *>::iterator it;
+  int ret = 0;
+
+  OssEroute.Say(LOG_PREFIX "Removing ", (pool.isMtdPool ? "metadata" : "data"),
+                " pool ", pool.name.c_str(), "...");
+
+  for (it = mRadosFsShards.begin(); it != mRadosFsShards.end(); it++)
+  {
+    int shardRet;
+
+    if (pool.isMtdPool)
+      shardRet = (*it)->removeMetadataPool(pool.name);
+    else
+      shardRet = (*it)->removeDataPool(pool.name);
+
+    if (shardRet != 0)
+      ret = shardRet;
+  }
+
+  if (ret != 0)
+  {
+    OssEroute.Emsg("Failed to remove pool", pool.name.c_str(), ":",
+                   strerror(abs(ret)));
+  }
+}
+
+static bool
+hasPool(const std::vector<RadosOssPool> &pools, const RadosOssPool &pool,
+        bool sameNameOnly)
+{
+  std::vector<RadosOssPool>::const_iterator it;
+  for (it = pools.begin(); it != pools.end(); it++)
+  {
+    if (sameNameOnly ? (*it).name == pool.name &&
+                       (*it).isMtdPool == pool.isMtdPool
+                     : *it == pool)
+      return true;
+  }
+
+  return false;
+}
+
+// Reads the pools from the configuration file again and, if they changed,
+// replaces the routing table. Requests which already took the previous table
+// keep using it until they finish.
+int
+RadosOss::reloadPools()
+{
+  XrdSysMutexHelper reloadLock(mPoolsReloadMutex);
+  std::vector<RadosOssPool> pools;
+  std::vector<RadosOssPool> removed, added;
+  int ret = loadPoolsFromConfig(mConfigFn.c_str(), pools);
+
+  if (ret != 0)
+  {
+    OssEroute.Emsg("Problem when reloading the pools from", mConfigFn.c_str(),
+                   ":", strerror(abs(ret)));
+    return ret;
+  }
+
+  if (pools.empty())
+  {
+    OssEroute.Emsg("Not reloading the pools: none configured in",
+                   mConfigFn.c_str());
+    return -EINVAL;
+  }
+
+  const std::vector<RadosOssPool> &current = mPoolTable->pools();
+  std::vector<RadosOssPool>::const_iterator it;
+
+  for (it = current.begin(); it != current.end(); it++)
+  {
+    if (!hasPool(pools, *it, false))
+      removed.push_back(*it);
+  }
+
+  for (it = pools.begin(); it != pools.end(); it++)
+  {
+    if (!hasPool(current, *it, false))
+      added.push_back(*it);
+  }
+
+  if (removed.empty() && added.empty())
+    return 0;
+
+  OssEroute.Say(LOG_PREFIX "Reloading the pools from ", mConfigFn.c_str());
+
+  // Pools are removed from the filesystem by name, so the ones which are
+  // being re-added (e.g. with another prefix) go before adding them and the
+  // others only after the new pools are in place
+  for (it = removed.begin(); it != removed.end(); it++)
+  {
+    if (hasPool(added, *it, true))
+      removePoolFromFs(*it);
+  }
+
+  for (it = added.begin(); it != added.end(); it++)
+  {
+    addPoolToFs(*it);
+
+    if ((*it).isMtdPool && mCluster)
+      openMetadataIoctx(*it);
+  }
+
+  for (it = removed.begin(); it != removed.end(); it++)
+  {
+    if (!hasPool(added, *it, true))
+      removePoolFromFs(*it);
+  }
+
+  RadosOssPoolTable *table = new RadosOssPoolTable(pools);
+  RadosOssPoolTable *oldTable;
+
+  mPoolTableMutex.Lock();
+  oldTable = mPoolTable;
+  mPoolTable = table;
+  mPoolTableMutex.UnLock();
+
+  oldTable->unref();
+
+  return 0;
+}
+
+int
+RadosOss::startPoolsReloader()
+{
+  int ret = XrdSysThread::Run(&mPoolsReloaderThread,
+                              RadosOss::poolsReloaderThread, (void *) this,
+                              XRDSYSTHREAD_HOLD, "RadosOss pools reloader");
+
+  if (ret != 0)
+  {
+    OssEroute.Emsg("Failed to start the pools reloader", ":", strerror(ret));
+    return -ret;
+  }
+
+  mPoolsReloaderRunning = true;
+
+  return 0;
+}
+
+void
+RadosOss::stopPoolsReloader()
+{
+  if (!mPoolsReloaderRunning)
+    return;
+
+  mPoolsReloaderCond.Lock();
+  mStopping = true;
+  mPoolsReloaderCond.Broadcast();
+  mPoolsReloaderCond.UnLock();
+
+  XrdSysThread::Join(mPoolsReloaderThread, 0);
+  mPoolsReloaderRunning = false;
+}
+
+void *
+RadosOss::poolsReloaderThread(void *oss)
+{
+  ((RadosOss *) oss)->watchPoolsConfig();
+  return 0;
+}
+
+// Reloads the pools whenever the configuration file is modified
+void
+RadosOss::watchPoolsConfig()
+{
+  mPoolsReloaderCond.Lock();
+
+  while (!mStopping)
+  {
+    struct stat configStat;
+
+    mPoolsReloaderCond.Wait(mPoolsReloadInterval);
+
+    if (mStopping)
+      break;
+
+    if (stat(mConfigFn.c_str(), &configStat) != 0 ||
+        configStat.st_mtime == mConfigMtime)
+      continue;
+
+    mConfigMtime = configStat.st_mtime;
+
+    mPoolsReloaderCond.UnLock();
+    reloadPools();
+    mPoolsReloaderCond.Lock();
+  }
+
+  mPoolsReloaderCond.UnLock();
+}
+
+// The directory cache reads the directories' log objects directly and the
+// space monitor the pools' stats, so they need their own connection to the
+// cluster
+int
+RadosOss::initCluster(const std::string &userName,
+                      const std::string &configPath)
+{
+  int ret = rados_create(&mCluster, userName == "" ? 0 : userName.c_str());
+
+  if (ret == 0)
+    ret = rados_conf_read_file(mCluster, configPath.c_str());
+
+  if (ret == 0)
+    ret = rados_connect(mCluster);
+
+  if (ret != 0)
+  {
+    OssEroute.Emsg("Failed to connect to the cluster", ":",
+                   strerror(abs(ret)));
+    return ret;
+  }
+
+  const std::vector<RadosOssPool> &pools = mPoolTable->pools();
+  std::vector<RadosOssPool>::const_iterator it;
+
+  for (it = pools.begin(); it != pools.end(); it++)
+  {
+    if (!(*it).isMtdPool)
+      continue;
+
+    ret = openMetadataIoctx(*it);
+
+    if (ret != 0)
+      return ret;
+  }
+
+  return 0;
+}
+
+int
+RadosOss::openMetadataIoctx(const RadosOssPool &pool)
+{
+  XrdSysMutexHelper lock(mMtdIoctxsMutex);
+  rados_ioctx_t ioctx;
+
+  if (mMtdIoctxs.count(pool.name) > 0)
+    return 0;
+
+  int ret = rados_ioctx_create(mCluster, pool.name.c_str(), &ioctx);
+
+  if (ret != 0)
+  {
+    OssEroute.Emsg("Failed to open metadata pool", pool.name.c_str(), ":",
+                   strerror(abs(ret)));
+    return ret;
+  }
+
+  mMtdIoctxs[pool.name] = ioctx;
+
+  return 0;
+}
+
+RadosOssPoolTable *
+RadosOss::acquirePoolTable()
+{
+  XrdSysMutexHelper lock(mPoolTableMutex);
+
+  mPoolTable->ref();
+
+  return mPoolTable;
+}
+
+bool
+RadosOss::getPoolFromPath(const std::string &path, RadosOssPool &pool)
+{
+  RadosOssPoolTable *table = acquirePoolTable();
+  const RadosOssPool *match = table->find(path, false);
+
+  if (match)
+    pool = *match;
+
+  table->unref();
+
+  return match != 0;
+}
+
+void
+RadosOss::getPools(std::vector<RadosOssPool> &pools)
+{
+  RadosOssPoolTable *table = acquirePoolTable();
+
+  pools = table->pools();
+
+  table->unref();
+}
+
+bool
+RadosOss::getMetadataPoolFromPath(const std::string &path, RadosOssPool &pool)
+{
+  RadosOssPoolTable *table = acquirePoolTable();
+  const RadosOssPool *match = table->find(path, true);
+
+  if (match)
+    pool = *match;
+
+  table->unref();
+
+  return match != 0;
+}
+
+rados_ioctx_t
+RadosOss::metadataIoctx(const std::string &path)
+{
+  RadosOssPool pool;
+
+  if (!getMetadataPoolFromPath(path, pool))
+    return 0;
+
+  XrdSysMutexHelper lock(mMtdIoctxsMutex);
+
+  if (mMtdIoctxs.count(pool.name) == 0)
+    return 0;
+
+  return mMtdIoctxs[pool.name];
 }
 
 std::string
 RadosOss::getDefaultPoolName() const
 {
-  std::vector<std::string> pools(mRadosFs.allPoolsInCluster());
+  std::vector<std::string> pools(mRadosFsShards[0]->allPoolsInCluster());
 
   if (pools.size())
     return pools[0];
@@ -135,57 +652,321 @@ RadosOss::getDefaultPoolName() const
   return "";
 }
 
+static bool
+getConfigNumber(XrdOucStream &config, const char *directive,
+                unsigned long long &value)
+{
+  char *end;
+  const char *word = config.GetWord();
+
+  if (!word)
+  {
+    OssEroute.Emsg("Missing value for", directive);
+    return false;
+  }
+
+  value = strtoull(word, &end, 10);
+
+  if (*end != '\0')
+  {
+    OssEroute.Emsg("Illegal value configured for", directive, ":", word);
+    return false;
+  }
+
+  OssEroute.Say(LOG_PREFIX "Set ", directive, " to ", word);
+
+  return true;
+}
+
 int
 RadosOss::loadInfoFromConfig(const char *pluginConf,
                              std::string &configPath,
-                             std::string &userName)
+                             std::string &userName,
+                             std::vector<RadosOssPool> &pools)
 {
   XrdOucStream Config;
   int cfgFD;
   char *var;
+  unsigned long long value;
 
   configPath = "";
   userName = "";
 
   if ((cfgFD = open(pluginConf, O_RDONLY, 0)) < 0)
-    return cfgFD;
+    return cfgFD;
+
+  Config.Attach(cfgFD);
+  while ((var = Config.GetMyFirstWord()))
+  {
+    if (configPath == "" && strcmp(var, RADOS_CONFIG) == 0)
+    {
+      configPath = Config.GetWord();
+    }
+    else if (userName == "" && strcmp(var, RADOS_CONFIG_USER) == 0)
+    {
+      userName = Config.GetWord();
+    }
+    else if (strcmp(var, RADOS_CONFIG_DATA_POOLS) == 0)
+    {
+      const char *pool;
+      while (pool = Config.GetWord())
+        addPoolFromConfStr(pool, false, pools);
+    }
+    else if (strcmp(var, RADOS_CONFIG_MTD_POOLS) == 0)
+    {
+      const char *pool;
+      while (pool = Config.GetWord())
+        addPoolFromConfStr(pool, true, pools);
+    }
+    else if (strcmp(var, RADOS_CONFIG_POOLS_RELOAD) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mPoolsReloadInterval = value;
+    }
+    else if (strcmp(var, RADOS_CONFIG_METRICS_FILE) == 0)
+    {
+      const char *metricsFile = Config.GetWord();
+
+      if (metricsFile)
+        mMetricsFile = metricsFile;
+    }
+    else if (strcmp(var, RADOS_CONFIG_METRICS_INTERVAL) == 0)
+    {
+      if (getConfigNumber(Config, var, value) && value > 0)
+        mMetricsInterval = value;
+    }
+    else if (strcmp(var, RADOS_CONFIG_UNLINK_REAPERS) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mReaper.setNumThreads(value);
+    }
+    else if (strcmp(var, RADOS_CONFIG_DURABILITY_INTERVAL) == 0)
+    {
+      if (getConfigNumber(Config, var, value) && value > 0)
+        mDurabilityInterval = value;
+    }
+    else if (strcmp(var, RADOS_CONFIG_STATFS_INTERVAL) == 0)
+    {
+      if (getConfigNumber(Config, var, value) && value > 0)
+        mStatFSInterval = value;
+    }
+    else if (strcmp(var, RADOS_CONFIG_TRACE_FILE) == 0)
+    {
+      const char *traceFile = Config.GetWord();
+
+      if (traceFile)
+        mTraceFile = traceFile;
+    }
+    else if (strcmp(var, RADOS_CONFIG_CHECKSUMS) == 0)
+    {
+      const char *name;
+      RadosOssChecksumType type;
+
+      while ((name = Config.GetWord()))
+      {
+        if (!RadosOssChecksum::fromName(name, type))
+        {
+          OssEroute.Say(LOG_PREFIX "Unsupported checksum ", name);
+          continue;
+        }
+
+        if (std::find(mChecksums.begin(), mChecksums.end(), type) ==
+            mChecksums.end())
+          mChecksums.push_back(type);
+      }
+    }
+    else if (strcmp(var, RADOS_CONFIG_DEFAULT_STRIPESIZE) == 0)
+    {
+      char* sstripe = Config.GetWord();
+      if ( sstripe ) {
+	size_t stripe = (size_t) strtoull(sstripe,0,10);
+	if (!validStripeSize(stripe)) {
+	  fprintf(stderr,"error: illegal default stripesize configured %s='%s'\n", RADOS_CONFIG_DEFAULT_STRIPESIZE, sstripe);
+	  Config.Close();
+	  return -1;
+	} 
+	mStripeSize = stripe;
+	OssEroute.Say(LOG_PREFIX "Set default stripesize ", sstripe);
+      }
+    }
+    else if (strcmp(var, RADOS_CONFIG_CLIENTS) == 0)
+    {
+      if (getConfigNumber(Config, var, value) && value > 0)
+        mNumClients = value;
+    }
+    else if (strcmp(var, RADOS_CONFIG_CLIENTS_POLICY) == 0)
+    {
+      const char *policy = Config.GetWord();
+
+      if (policy && strcmp(policy, "roundrobin") == 0)
+        mClientsRoundRobin = true;
+      else if (policy && strcmp(policy, "hash") == 0)
+        mClientsRoundRobin = false;
+      else
+        OssEroute.Emsg("Illegal value configured for", var, ":",
+                       policy ? policy : "");
+    }
+    else if (strcmp(var, RADOS_CONFIG_ANONYMOUS_UID) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        RadosOssCred::setAnonymous(value, RadosOssCred().gid);
+    }
+    else if (strcmp(var, RADOS_CONFIG_ANONYMOUS_GID) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        RadosOssCred::setAnonymous(RadosOssCred().uid, value);
+    }
+    else if (strcmp(var, RADOS_CONFIG_AIO_THREADS) == 0)
+    {
+      if (getConfigNumber(Config, var, value) && value > 0)
+        mAioThreads = value;
+    }
+    else if (strcmp(var, RADOS_CONFIG_OP_THREADS) == 0)
+    {
+      if (getConfigNumber(Config, var, value) && value > 0)
+        mOpThreads = value;
+    }
+    else if (strcmp(var, RADOS_CONFIG_SCHED_MAX_IN_FLIGHT) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mScheduler.setMaxInFlight(value);
+    }
+    else if (strcmp(var, RADOS_CONFIG_SCHED_USERS) == 0 ||
+             strcmp(var, RADOS_CONFIG_SCHED_POOLS) == 0)
+    {
+      bool isPool = strcmp(var, RADOS_CONFIG_SCHED_POOLS) == 0;
+      const char *conf;
+
+      while ((conf = Config.GetWord()))
+        addSchedConfFromStr(conf, isPool);
+    }
+    else if (strcmp(var, RADOS_CONFIG_READ_MAX_IN_FLIGHT) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mReadMaxInFlight = value;
+    }
+    else if (strcmp(var, RADOS_CONFIG_READV_MAX_GAP) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mReadVMaxGap = value;
+    }
+    else if (strcmp(var, RADOS_CONFIG_READDIR_PAGE_SIZE) == 0)
+    {
+      if (getConfigNumber(Config, var, value) && value > 0)
+        mReaddirPageSize = value;
+    }
+    else if (strcmp(var, RADOS_CONFIG_DIR_CACHE_SIZE) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mDirCache.setMaxDirs(value);
+    }
+    else if (strcmp(var, RADOS_CONFIG_DIR_CACHE_MEMORY) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mDirCache.setMaxMemory(value);
+    }
+    else if (strcmp(var, RADOS_CONFIG_KNOWN_DIRS_SIZE) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mKnownDirs.setMaxDirs(value);
+    }
+    else if (strcmp(var, RADOS_CONFIG_STAT_CACHE_SIZE) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mStatCache.setMaxEntries(value);
+    }
+    else if (strcmp(var, RADOS_CONFIG_STAT_CACHE_TTL) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mStatCache.setTtl(value);
+    }
+    else if (strcmp(var, RADOS_CONFIG_NEG_STAT_CACHE_SIZE) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mStatCache.setMaxMissingEntries(value);
+    }
+    else if (strcmp(var, RADOS_CONFIG_NEG_STAT_CACHE_TTL) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mStatCache.setMissingTtl(value);
+    }
+    else if (strcmp(var, RADOS_CONFIG_READAHEAD_DEPTH) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mReadaheadConf.depth = value;
+    }
+    else if (strcmp(var, RADOS_CONFIG_READAHEAD_BLOCK_SIZE) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mReadaheadConf.blockSize = value;
+    }
+    else if (strcmp(var, RADOS_CONFIG_READAHEAD_HANDLE_MEM) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mReadaheadConf.handleMemory = value;
+    }
+    else if (strcmp(var, RADOS_CONFIG_READAHEAD_GLOBAL_MEM) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mReadaheadBudget.setLimit(value);
+    }
+    else if (strcmp(var, RADOS_CONFIG_BLOCK_CACHE_SIZE) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mBlockCache.setMaxSize(value);
+    }
+    else if (strcmp(var, RADOS_CONFIG_BLOCK_CACHE_BLOCK_SIZE) == 0)
+    {
+      if (getConfigNumber(Config, var, value) && value > 0)
+        mBlockCache.setBlockSize(value);
+    }
+    else if (strcmp(var, RADOS_CONFIG_WRITE_BEHIND) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mWriteBehindConf.enabled = value != 0;
+    }
+    else if (strcmp(var, RADOS_CONFIG_WRITE_BEHIND_BUFFER_SIZE) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mWriteBehindConf.bufferSize = value;
+    }
+    else if (strcmp(var, RADOS_CONFIG_WRITE_BEHIND_MAX_IN_FLIGHT) == 0)
+    {
+      if (getConfigNumber(Config, var, value))
+        mWriteBehindConf.maxInFlight = value;
+    }
+  }
+
+  Config.Close();
+
+  return 0;
+}
+
+int
+RadosOss::loadPoolsFromConfig(const char *pluginConf,
+                              std::vector<RadosOssPool> &pools)
+{
+  XrdOucStream Config;
+  int cfgFD;
+  char *var;
+
+  if ((cfgFD = open(pluginConf, O_RDONLY, 0)) < 0)
+    return -errno;
 
   Config.Attach(cfgFD);
   while ((var = Config.GetMyFirstWord()))
   {
-    if (configPath == "" && strcmp(var, RADOS_CONFIG) == 0)
-    {
-      configPath = Config.GetWord();
-    }
-    else if (userName == "" && strcmp(var, RADOS_CONFIG_USER) == 0)
-    {
-      userName = Config.GetWord();
-    }
-    else if (strcmp(var, RADOS_CONFIG_DATA_POOLS) == 0)
+    const char *pool;
+
+    if (strcmp(var, RADOS_CONFIG_DATA_POOLS) == 0)
     {
-      const char *pool;
-      while (pool = Config.GetWord())
-        addPoolFromConfStr(pool, false);
+      while ((pool = Config.GetWord()))
+        addPoolFromConfStr(pool, false, pools);
     }
     else if (strcmp(var, RADOS_CONFIG_MTD_POOLS) == 0)
     {
-      const char *pool;
-      while (pool = Config.GetWord())
-        addPoolFromConfStr(pool, true);
-    }
-    else if (strcmp(var, RADOS_CONFIG_DEFAULT_STRIPESIZE) == 0)
-    {
-      char* sstripe = Config.GetWord();
-      if ( sstripe ) {
-	size_t stripe = (size_t) strtoull(sstripe,0,10);
-	if (!stripe) {
-	  fprintf(stderr,"error: illegal default stripesize configured %s='%s'\n", RADOS_CONFIG_DEFAULT_STRIPESIZE, sstripe);
-	  Config.Close();
-	  return -1;
-	} 
-	mRadosFs.setFileChunkSize(stripe);
-	OssEroute.Say(LOG_PREFIX "Set default stripesize ", sstripe);
-      }
+      while ((pool = Config.GetWord()))
+        addPoolFromConfStr(pool, true, pools);
     }
   }
 
@@ -195,7 +976,8 @@ RadosOss::loadInfoFromConfig(const char *pluginConf,
 }
 
 void
-RadosOss::addPoolFromConfStr(const char *confStr, bool isMtdPool)
+RadosOss::addPoolFromConfStr(const char *confStr, bool isMtdPool,
+                             std::vector<RadosOssPool> &pools)
 {
   int delimeterIndex;
   XrdOucString str(confStr);
@@ -212,6 +994,9 @@ RadosOss::addPoolFromConfStr(const char *confStr, bool isMtdPool)
   RadosOssPool pool;
   XrdOucString poolPrefix(str, 0, delimeterIndex - 1);
   XrdOucString poolName(str, delimeterIndex + 1);
+  XrdOucString durability("");
+
+  pool.durability = RADOS_OSS_DURABILITY_CLOSE;
 
   delimeterIndex = poolName.find(':');
   if (delimeterIndex == STR_NPOS || delimeterIndex == 0 ||
@@ -223,12 +1008,35 @@ RadosOss::addPoolFromConfStr(const char *confStr, bool isMtdPool)
   {
     poolSize = XrdOucString(poolName, delimeterIndex + 1);
     poolName.erase(delimeterIndex, poolName.length() - delimeterIndex);
+
+    // The size may be followed by the durability mode, e.g. /:data:100:async
+    delimeterIndex = poolSize.find(':');
+    if (delimeterIndex != STR_NPOS)
+    {
+      durability = XrdOucString(poolSize, delimeterIndex + 1);
+      poolSize.erase(delimeterIndex, poolSize.length() - delimeterIndex);
+    }
+
     pool.size = atoi(poolSize.c_str());
 
     if (pool.size == 0)
       pool.size = DEFAULT_POOL_FILE_SIZE;
   }
 
+  if (durability == "interval")
+  {
+    pool.durability = RADOS_OSS_DURABILITY_INTERVAL;
+  }
+  else if (durability == "async")
+  {
+    pool.durability = RADOS_OSS_DURABILITY_ASYNC;
+  }
+  else if (durability != "" && durability != "close")
+  {
+    OssEroute.Emsg("Unknown durability mode", durability.c_str(),
+                   "for pool", poolName.c_str());
+  }
+
   pool.isMtdPool = isMtdPool;
   pool.name = poolName.c_str();
   pool.prefix = poolPrefix.c_str();
@@ -241,18 +1049,241 @@ RadosOss::addPoolFromConfStr(const char *confStr, bool isMtdPool)
     OssEroute.Say(LOG_PREFIX "... and size configured to ", poolSize.c_str(),
                   " MB");
 
-  mPools.push_back(pool);
+  if (pool.durability != RADOS_OSS_DURABILITY_CLOSE)
+    OssEroute.Say(LOG_PREFIX "... and files synced ",
+                  (pool.durability == RADOS_OSS_DURABILITY_ASYNC ?
+                   "asynchronously" : "periodically"), " after closing");
+
+  pools.push_back(pool);
 }
 
+// Users are configured as name:weight:bandwidth:iops and pools as
+// name:bandwidth:iops; empty or missing values are 0 (unlimited), e.g.
+// bulk:1:104857600 or analysis:4 or scratchpool::500
 void
-RadosOss::setIdsFromEnv(XrdOucEnv *env)
+RadosOss::addSchedConfFromStr(const char *confStr, bool isPool)
+{
+  std::vector<uint64_t> values;
+  std::string str(confStr);
+  size_t pos = str.find(':');
+  std::string name = str.substr(0, pos);
+
+  while (pos != std::string::npos)
+  {
+    size_t next = str.find(':', pos + 1);
+    std::string value = str.substr(pos + 1, next == std::string::npos ?
+                                            std::string::npos :
+                                            next - pos - 1);
+    char *end;
+
+    values.push_back(strtoull(value.c_str(), &end, 10));
+
+    if (*end != '\0')
+    {
+      OssEroute.Emsg("Illegal scheduler conf", confStr);
+      return;
+    }
+
+    pos = next;
+  }
+
+  if (name == "" || values.empty() || values.size() > (isPool ? 2 : 3))
+  {
+    OssEroute.Emsg("Error splitting the scheduler conf str", confStr);
+    return;
+  }
+
+  RadosOssSchedConf conf;
+  conf.weight = 1;
+
+  if (!isPool)
+  {
+    conf.weight = values[0];
+    values.erase(values.begin());
+  }
+
+  values.resize(2, 0);
+  conf.bandwidth = values[0];
+  conf.iops = values[1];
+
+  OssEroute.Say(LOG_PREFIX "Found scheduler conf for ",
+                (isPool ? "pool " : "user "), confStr);
+
+  if (isPool)
+    mScheduler.setPoolConf(name, conf);
+  else
+    mScheduler.setUserConf(name, conf);
+}
+
+int
+RadosOss::checkAccess(const RadosOssCred &cred, const std::string &path,
+                      int mode)
 {
-  if (env)
+  struct stat statBuff;
+
+  if (cred.isRoot())
+    return 0;
+
+  int ret = checkSearchAccess(cred, path);
+
+  if (ret == 0)
+    ret = statPath(path, &statBuff);
+
+  if (ret != 0)
+    return ret;
+
+  return cred.canAccess(statBuff, mode) ? 0 : -EACCES;
+}
+
+// Checks that the user may add or remove entries in the parent directory of
+// path. If nearestExisting is true, the closest ancestor which exists is
+// checked instead (for when the missing parents are going to be created).
+int
+RadosOss::checkParentAccess(const RadosOssCred &cred, const std::string &path,
+                            bool nearestExisting)
+{
+  struct stat statBuff;
+  std::string parent = radosfs::Dir::getParent(path, 0);
+
+  if (cred.isRoot())
+    return 0;
+
+  while (!parent.empty())
+  {
+    int ret = statPermissions(parent, &statBuff);
+
+    if (ret == -ENOENT && nearestExisting)
+    {
+      parent = radosfs::Dir::getParent(parent, 0);
+      continue;
+    }
+
+    if (ret != 0)
+      return ret;
+
+    if (!S_ISDIR(statBuff.st_mode))
+      return -ENOTDIR;
+
+    if (!cred.canAccess(statBuff, W_OK | X_OK))
+      return -EACCES;
+
+    return checkSearchAccess(cred, parent);
+  }
+
+  return -ENOENT;
+}
+
+// Checks that the user may traverse all the ancestors of path, from the
+// root down, as a lookup of path would
+int
+RadosOss::checkSearchAccess(const RadosOssCred &cred, const std::string &path)
+{
+  struct stat statBuff;
+  std::vector<std::string> ancestors;
+  std::string parent = radosfs::Dir::getParent(path, 0);
+
+  if (cred.isRoot())
+    return 0;
+
+  while (!parent.empty())
+  {
+    ancestors.push_back(parent);
+    parent = radosfs::Dir::getParent(parent, 0);
+  }
+
+  for (int i = ancestors.size() - 1; i >= 0; i--)
   {
-    uid_t uid = env->GetInt("uid");
-    gid_t gid = env->GetInt("gid");
+    int ret = statPermissions(ancestors[i], &statBuff);
+
+    if (ret != 0)
+      return ret;
+
+    if (!S_ISDIR(statBuff.st_mode))
+      return -ENOTDIR;
+
+    if (!cred.canAccess(statBuff, X_OK))
+      return -EACCES;
+  }
+
+  return 0;
+}
+
+bool
+RadosOss::validStripeSize(unsigned long long size)
+{
+  return size >= MIN_STRIPE_SIZE && size <= MAX_STRIPE_SIZE;
+}
+
+// The stripe size a client asks a new file to have (rfs.stripe), 0 for the
+// filesystem's default
+int
+RadosOss::requestedStripeSize(XrdOucEnv &env, size_t &size)
+{
+  const char *value = env.Get("rfs.stripe");
+  char *end;
+
+  size = 0;
+
+  if (!value)
+    return 0;
+
+  unsigned long long stripe = strtoull(value, &end, 10);
+
+  if (*end != '\0' || !validStripeSize(stripe))
+    return -EINVAL;
+
+  size = stripe;
+
+  return 0;
+}
+
+int
+RadosOss::statPath(const std::string &path, struct stat *buff)
+{
+  if (mStatCache.get(path, buff))
+    return 0;
+
+  if (mStatCache.isMissing(path))
+    return -ENOENT;
+
+  uint64_t generation = mStatCache.generation(path);
+  RadosOssOpTimer timer(RADOS_OSS_OP_RADOS_STAT);
+  int ret = timer.done(radosFs(path)->stat(path, buff));
+
+  if (ret == 0)
+    mStatCache.put(path, *buff, generation);
+  else if (ret == -ENOENT)
+    mStatCache.putMissing(path, generation);
+
+  return ret;
+}
+
+// Permission checks only need the mode and owner of the ancestors, which
+// stay cached while their entries change
+int
+RadosOss::statPermissions(const std::string &path, struct stat *buff)
+{
+  if (mStatCache.getPermissions(path, buff))
+    return 0;
+
+  return statPath(path, buff);
+}
+
+// Drops the cached stat of path and the size and times of its parent
+// directory, whose entries changed. When ancestors were created (mkpath), all
+// of them are dropped so no stale negative entry survives.
+void
+RadosOss::invalidateStat(const std::string &path, bool allAncestors)
+{
+  std::string parent = radosfs::Dir::getParent(path, 0);
+
+  mStatCache.invalidate(path);
+  mStatCache.invalidateAttributes(parent);
 
-    mRadosFs.setIds(uid, gid);
+  while (allAncestors && !parent.empty())
+  {
+    parent = radosfs::Dir::getParent(parent, 0);
+    mStatCache.invalidate(parent);
   }
 }
 
@@ -262,81 +1293,135 @@ RadosOss::Stat(const char* path,
                int opts,
                XrdOucEnv* env)
 {
-  setIdsFromEnv(env);
+  RadosOssOpTimer timer(RADOS_OSS_OP_STAT);
+  timer.tracePath(path);
+
+  // Reports the failure to sync a file closed without syncing it
+  int ret = mFlusher.flushPath(path);
+
+  if (ret != 0)
+    return timer.done(ret);
+
+  RadosOssCred cred(env);
+  ret = checkSearchAccess(cred, path);
+
+  if (ret != 0)
+    return timer.done(ret);
 
-  return mRadosFs.stat(path, buff);
+  return timer.done(statPath(path, buff));
 }
 
 int
 RadosOss::Mkdir(const char *path, mode_t mode, int mkpath, XrdOucEnv *env)
 {
+  RadosOssOpTimer timer(RADOS_OSS_OP_MKDIR);
+  timer.tracePath(path, 0, mode, mkpath);
   int ret;
-  uid_t uid = 0;
-  gid_t gid = 0;
-  int owner = uid;
-  int group = gid;
+  RadosOssCred cred(env);
+  int owner = cred.uid;
+  int group = cred.gid;
 
-  if (env)
+  if (env && cred.isRoot())
   {
-    uid = owner = env->GetInt("uid");
-    gid = group = env->GetInt("gid");
+    owner = env->GetInt("owner");
+    if (owner < 0)
+      owner = cred.uid;
 
-    mRadosFs.setIds(uid, gid);
+    group = env->GetInt("group");
+    if (group < 0)
+      group = cred.gid;
+  }
 
-    if (uid == ROOT_UID)
-    {
-      owner = env->GetInt("owner");
-      if (owner < 0)
-        owner = uid;
+  ret = checkParentAccess(cred, path, mkpath);
 
-      group = env->GetInt("group");
-      if (group < 0)
-        group = gid;
-    }
-  }
+  if (ret != 0)
+    return timer.done(ret);
 
-  radosfs::Dir dir(&mRadosFs, path);
+  radosfs::Dir dir(radosFs(path), path);
   ret = dir.create(mode, mkpath, owner, group);
+  invalidateStat(path, mkpath);
 
   if (ret != 0)
   {
     OssEroute.Emsg("Couldn't create directory", path, ":", strerror(-ret));
-    return ret;
+    return timer.done(ret);
   }
 
-  return XrdOssOK;
+  mKnownDirs.add(path);
+
+  return timer.done(XrdOssOK);
 }
 
 int
 RadosOss::Remdir(const char *path, int Opts, XrdOucEnv *env)
 {
+  RadosOssOpTimer timer(RADOS_OSS_OP_REMDIR);
+  timer.tracePath(path);
   int ret;
+  RadosOssCred cred(env);
 
-  setIdsFromEnv(env);
+  ret = checkParentAccess(cred, path, false);
 
-  radosfs::Dir dir(&mRadosFs, path);
+  if (ret != 0)
+    return timer.done(ret);
+
+  radosfs::Dir dir(radosFs(path), path);
   ret = dir.remove();
+  invalidateStat(path);
+  mDirCache.invalidate(path);
+  mKnownDirs.invalidate(path);
 
   if (ret != 0)
     OssEroute.Emsg("Problem removing directory", strerror(ret));
 
-  return ret;
+  return timer.done(ret);
 }
 
 int
 RadosOss::Unlink(const char *path, int Opts, XrdOucEnv *env)
 {
+  RadosOssOpTimer timer(RADOS_OSS_OP_UNLINK);
+  timer.tracePath(path);
   int ret;
+  RadosOssCred cred(env);
+
+  ret = checkParentAccess(cred, path, false);
+
+  if (ret != 0)
+    return timer.done(ret);
+
+  // Data still being synced must not land after the removal; whether it
+  // could be synced does not matter anymore
+  mFlusher.flushPath(path);
+
+  if (mReaper.enabled())
+  {
+    struct stat statBuff;
+
+    // The file is moved to the trash now and its data removed by the reaper
+    ret = statPath(path, &statBuff);
+
+    if (ret == 0 && S_ISDIR(statBuff.st_mode))
+      ret = -EISDIR;
+
+    if (ret == 0)
+      ret = mReaper.remove(path);
 
-  setIdsFromEnv(env);
+    invalidateStat(path);
+    mBlockCache.invalidate(path);
 
-  radosfs::File file(&mRadosFs, path, radosfs::File::MODE_WRITE);
+    return timer.done(ret);
+  }
+
+  radosfs::File file(radosFs(path), path, radosfs::File::MODE_WRITE);
   ret = file.remove();
+  invalidateStat(path);
+  mBlockCache.invalidate(path);
 
   if (ret != 0)
     OssEroute.Emsg("Failed to remove file %s: %s", path, strerror(-ret));
 
-  return ret;
+  return timer.done(ret);
 }
 
 int
@@ -344,29 +1429,86 @@ RadosOss::Truncate(const char* path,
                    unsigned long long size,
                    XrdOucEnv* env)
 {
+  RadosOssOpTimer timer(RADOS_OSS_OP_TRUNCATE);
+  timer.tracePath(path, size);
   int ret;
+  RadosOssCred cred(env);
+
+  ret = mFlusher.flushPath(path);
 
-  setIdsFromEnv(env);
+  if (ret == 0)
+    ret = checkAccess(cred, path, W_OK);
 
-  radosfs::File file(&mRadosFs, path, radosfs::File::MODE_WRITE);
-  ret = file.truncate(size);
+  if (ret != 0)
+    return timer.done(ret);
+
+  ret = truncatePath(path, size);
+  mStatCache.invalidate(path);
+  mBlockCache.invalidate(path);
 
   if (ret != 0)
     OssEroute.Emsg("Failed to truncate file %s: %s", path, strerror(-ret));
 
-  return ret;
+  return timer.done(ret);
+}
+
+// Files spanning several stripe objects which keep at most
+// TRUNCATE_SWAP_MAX_COPY bytes are handed to the reaper, unless they are open
+// in this server (whose handles must keep using the same file)
+int
+RadosOss::truncatePath(const std::string &path, unsigned long long size)
+{
+  struct stat statBuff;
+  off_t stripeSize = radosFs(path)->fileChunkSize();
+
+  if (mReaper.enabled() && size <= TRUNCATE_SWAP_MAX_COPY &&
+      statPath(path, &statBuff) == 0 && S_ISREG(statBuff.st_mode) &&
+      statBuff.st_size > stripeSize && (off_t) size < statBuff.st_size)
+  {
+    bool isOpen;
+
+    mOpenFilesMutex.Lock();
+    isOpen = mOpenFiles.count(path) > 0;
+    mOpenFilesMutex.UnLock();
+
+    if (!isOpen && mReaper.truncate(path, size, statBuff) == 0)
+      return 0;
+  }
+
+  radosfs::File file(radosFs(path), path, radosfs::File::MODE_WRITE);
+
+  return file.truncate(size);
+}
+
+void
+RadosOss::addOpenFile(const std::string &path)
+{
+  XrdSysMutexHelper lock(mOpenFilesMutex);
+
+  mOpenFiles[path]++;
+}
+
+void
+RadosOss::removeOpenFile(const std::string &path)
+{
+  XrdSysMutexHelper lock(mOpenFilesMutex);
+
+  std::map<std::string, size_t>::iterator it = mOpenFiles.find(path);
+
+  if (it != mOpenFiles.end() && --(*it).second == 0)
+    mOpenFiles.erase(it);
 }
 
 XrdOssDF *
 RadosOss::newFile(const char *tident)
 {
-  return dynamic_cast<XrdOssDF *>(new RadosOssFile(&mRadosFs, OssEroute));
+  return dynamic_cast<XrdOssDF *>(new RadosOssFile(this, OssEroute, tident));
 }
 
 XrdOssDF *
 RadosOss::newDir(const char *tident)
 {
-  return dynamic_cast<XrdOssDF *>(new RadosOssDir(&mRadosFs, OssEroute));
+  return dynamic_cast<XrdOssDF *>(new RadosOssDir(this, OssEroute));
 }
 
 static bool
@@ -387,78 +1529,253 @@ int
 RadosOss::Create(const char *tident, const char *path, mode_t access_mode,
                  XrdOucEnv &env, int Opts)
 {
+  RadosOssOpTimer timer(RADOS_OSS_OP_CREATE);
+  timer.tracePath(path, 0, access_mode, Opts);
   int ret;
+  RadosOssCred cred(&env);
+
+  size_t stripeSize;
+
+  ret = requestedStripeSize(env, stripeSize);
+
+  if (ret == 0)
+    ret = checkParentAccess(cred, path, Opts & XRDOSS_mkpath);
 
-  setIdsFromEnv(&env);
+  if (ret != 0)
+    return timer.done(ret);
+
+  std::string dirPath = radosfs::Dir::getParent(path, 0);
+  // Creating the parents walks the whole path in RADOS, so it is skipped
+  // for the directories known to exist
+  bool mkpath = (Opts & XRDOSS_mkpath) && !mKnownDirs.contains(dirPath);
 
-  if (Opts & XRDOSS_mkpath)
+  if (mkpath)
   {
-    std::string dirPath = radosfs::Dir::getParent(path, 0);
-    radosfs::Dir dir(&mRadosFs, dirPath);
+    ret = createParentDirs(path, dirPath, cred);
 
-    ret = dir.create(-1, true);
+    if (ret != 0)
+      return timer.done(ret);
+  }
 
-    if (ret != 0 && ret != -EEXIST)
-    {
-      OssEroute.Emsg("Failed to create parent dirs for file", path, ":",
-                     strerror(abs(ret)));
-      return ret;
-    }
+  radosfs::File file(radosFs(path), path, radosfs::File::MODE_WRITE);
+  ret = file.create(access_mode, std::string(""), stripeSize);
+
+  // The parent was removed elsewhere since it became known
+  if (ret == -ENOENT && (Opts & XRDOSS_mkpath) && !mkpath)
+  {
+    mKnownDirs.invalidate(dirPath);
+    ret = createParentDirs(path, dirPath, cred);
+
+    if (ret == 0)
+      ret = file.create(access_mode, std::string(""), stripeSize);
+  }
+
+  // RadosFS creates files owned by root, so one which cannot be given to
+  // the user is removed rather than left behind
+  if (ret == 0 && !cred.isRoot())
+  {
+    ret = file.chown(cred.uid, cred.gid);
+
+    if (ret != 0)
+      file.remove();
   }
 
-  radosfs::File file(&mRadosFs, path, radosfs::File::MODE_WRITE);
-  ret = file.create(access_mode, std::string(""), env.Get("rfs.stripe") ? atoi(env.Get("rfs.stripe")) : 0);
+  invalidateStat(path);
 
   if (ret != 0)
     OssEroute.Emsg("Failed to create file ", path, ":", strerror(-ret));
 
-  return ret;
+  return timer.done(ret);
+}
+
+int
+RadosOss::createParentDirs(const char *path, const std::string &dirPath,
+                           const RadosOssCred &cred)
+{
+  radosfs::Dir dir(radosFs(dirPath), dirPath);
+  int ret = dir.create(-1, true, cred.uid, cred.gid);
+
+  invalidateStat(dirPath, true);
+
+  if (ret != 0 && ret != -EEXIST)
+  {
+    OssEroute.Emsg("Failed to create parent dirs for file", path, ":",
+                   strerror(abs(ret)));
+    return ret;
+  }
+
+  mKnownDirs.add(dirPath);
+
+  return 0;
 }
 
 int
 RadosOss::StatFS(const char *path, char *buff, int &blen, XrdOucEnv *eP)
 {
-  uint64_t total, used;
-  int valid = mRadosFs.statCluster(&total, &used, 0, 0);
+  RadosOssOpTimer timer(RADOS_OSS_OP_STATFS);
+  timer.tracePath(path);
+  RadosOssPool pool;
+  long long freeMb = 0;
+  int usage = 0;
+
+  // Served from the space monitor's snapshot so it never waits on the
+  // monitors
+  RadosOssSpace space =
+    mSpaceMonitor.space(getPoolFromPath(path, pool) ? pool.name : "");
+
+  if (space.valid)
+  {
+    freeMb = (space.totalKb - space.usedKb) / 1024;
+
+    if (space.totalKb > 0)
+      usage = space.usedKb * 100 / space.totalKb;
+  }
+
+  // Nothing is staged, so the staging space (the last three values) is
+  // reported as invalid
+  blen = snprintf(buff, blen, "%d %lld %d %d %lld %d",
+                  space.valid, freeMb, usage, 0, 0LL, 0);
+
+  return timer.done(XrdOssOK);
+}
+
+int
+RadosOss::Stats(char *buff, int blen)
+{
+  RadosOssOpStats opStats;
+  std::ostringstream stats;
+
+  OssMetrics.snapshot(opStats);
+
+  stats << "<stats id=\"radososs\"><statcache>"
+        << "<hits>" << mStatCache.hits() << "</hits>"
+        << "<misses>" << mStatCache.misses() << "</misses>"
+        << "<neghits>" << mStatCache.missingHits() << "</neghits>"
+        << "<permhits>" << mStatCache.permissionHits() << "</permhits>"
+        << "</statcache><blockcache>"
+        << "<hits>" << mBlockCache.hits() << "</hits>"
+        << "<misses>" << mBlockCache.misses() << "</misses>"
+        << "<bytes>" << mBlockCache.usedSize() << "</bytes>"
+        << "</blockcache><knowndirs>"
+        << "<hits>" << mKnownDirs.hits() << "</hits>"
+        << "<misses>" << mKnownDirs.misses() << "</misses>"
+        << "</knowndirs><reaper>"
+        << "<pending>" << mReaper.pending() << "</pending>"
+        << "</reaper><aio>"
+        << "<queued>" << mIoPool.queued() << "</queued>"
+        << "</aio><sched>"
+        << "<queued>" << mScheduler.queued() << "</queued>"
+        << "</sched><ops>";
+
+  for (int i = 0; i < RADOS_OSS_NUM_OPS; i++)
+  {
+    RadosOssOp op = (RadosOssOp) i;
+
+    if (opStats.count[op] == 0)
+      continue;
+
+    stats << "<op id=\"" << RadosOssMetrics::opName(op) << "\">"
+          << "<n>" << opStats.count[op] << "</n>"
+          << "<err>" << opStats.errors[op] << "</err>"
+          << "<bytes>" << opStats.bytes[op] << "</bytes>"
+          << "<us>" << opStats.totalUs[op] << "</us>"
+          << "<p50>" << RadosOssMetrics::percentile(opStats, op, 0.5)
+          << "</p50>"
+          << "<p99>" << RadosOssMetrics::percentile(opStats, op, 0.99)
+          << "</p99></op>";
+  }
+
+  stats << "</ops></stats>";
 
-  blen = snprintf(buff, blen, "%d %llu %llu %d %llu %llu",
-                  valid, (valid ? total : 0LL), (valid ? used : 0LL),
-                  valid, (valid ? total : 0LL), (valid ? used : 0LL));
+  int len = snprintf(buff, blen, "%s", stats.str().c_str());
 
-  return XrdOssOK;
+  return (len < blen ? len : 0);
 }
 
 int
 RadosOss::Chmod(const char *path, mode_t mode, XrdOucEnv *env)
 {
-  setIdsFromEnv(env);
+  RadosOssOpTimer timer(RADOS_OSS_OP_CHMOD);
+  timer.tracePath(path, 0, mode);
+  RadosOssCred cred(env);
+  int ret = 0;
+
+  // Only the owner may change the mode, once the path can be looked up
+  if (!cred.isRoot())
+  {
+    struct stat statBuff;
 
-  radosfs::FsObj *fsObj = mRadosFs.getFsObj(path);
+    ret = checkSearchAccess(cred, path);
+
+    if (ret == 0)
+      ret = statPath(path, &statBuff);
+
+    if (ret == 0 && statBuff.st_uid != cred.uid)
+      ret = -EPERM;
+
+    if (ret != 0)
+      return timer.done(ret);
+  }
+
+  radosfs::FsObj *fsObj = radosFs(path)->getFsObj(path);
 
   if (!fsObj)
   {
     OssEroute.Emsg("Failed to chmod %s. Path does not exist.", path);
-    return -ENOENT;
+    return timer.done(-ENOENT);
   }
 
-  return fsObj->chmod((long int) mode);
+  ret = fsObj->chmod((long int) mode);
+  mStatCache.invalidate(path);
+
+  return timer.done(ret);
 }
 
 int
 RadosOss::Rename(const char *path, const char *newPath,
                  XrdOucEnv *env, XrdOucEnv *env2)
 {
-  setIdsFromEnv(env);
+  RadosOssOpTimer timer(RADOS_OSS_OP_RENAME);
+  int ret;
 
-  radosfs::FsObj *fsObj = mRadosFs.getFsObj(path);
+  if (OssTrace.enabled())
+    timer.tracePath(path, radosOssPathHash(newPath));
+
+  RadosOssCred cred(env);
+
+  ret = mFlusher.flushPath(path);
+
+  if (ret == 0)
+    ret = checkParentAccess(cred, path, false);
+
+  if (ret == 0)
+    ret = checkParentAccess(cred, newPath, false);
+
+  if (ret != 0)
+    return timer.done(ret);
+
+  radosfs::FsObj *fsObj = radosFs(path)->getFsObj(path);
 
   if (!fsObj)
   {
     OssEroute.Emsg("Failed to rename %s. Path does not exist.", path);
-    return -ENOENT;
+    return timer.done(-ENOENT);
   }
 
-  return fsObj->rename(newPath);
+  ret = fsObj->rename(newPath);
+  // A renamed directory takes the entries under it along
+  mStatCache.invalidatePrefix(path);
+  mStatCache.invalidatePrefix(newPath);
+  invalidateStat(path);
+  invalidateStat(newPath);
+  mDirCache.invalidate(path);
+  mDirCache.invalidate(newPath);
+  mBlockCache.invalidate(path, true);
+  mBlockCache.invalidate(newPath, true);
+  mKnownDirs.invalidate(path);
+  mKnownDirs.invalidate(newPath);
+
+  return timer.done(ret);
 }
 
 XrdVERSIONINFO(XrdOssGetStorageSystem, RadosOss);
@@ -24,18 +24,28 @@
 #include <XrdOss/XrdOss.hh>
 #include <XrdSys/XrdSysPthread.hh>
 #include <stdio.h>
+#include <time.h>
+#include <map>
 #include <vector>
 #include <string>
 #include <vector>
 
 #include <libradosfs.hh>
 
-typedef struct {
-  std::string name;
-  std::string prefix;
-  int size;
-  bool isMtdPool;
-} RadosOssPool;
+#include "RadosOssBlockCache.hh"
+#include "RadosOssChecksum.hh"
+#include "RadosOssCred.hh"
+#include "RadosOssDirCache.hh"
+#include "RadosOssFlusher.hh"
+#include "RadosOssKnownDirs.hh"
+#include "RadosOssPoolTable.hh"
+#include "RadosOssReaper.hh"
+#include "RadosOssScheduler.hh"
+#include "RadosOssSpaceMonitor.hh"
+#include "RadosOssStatCache.hh"
+#include "RadosOssThreadPool.hh"
+#include "RadosOssReadahead.hh"
+#include "RadosOssWriteBehind.hh"
 
 class RadosOss : public XrdOss
 {
@@ -54,10 +64,50 @@ public:
                          XrdOucEnv *eP1=0, XrdOucEnv *eP2=0);
   virtual int     Stat(const char *, struct stat *, int opts=0, XrdOucEnv *eP=0);
   virtual int     StatFS(const char *path, char *buff, int &blen, XrdOucEnv *eP=0);
+  virtual int     Stats(char *buff, int blen);
   virtual int     Truncate(const char *, unsigned long long, XrdOucEnv *eP=0);
   virtual int     Unlink(const char *path, int Opts=0, XrdOucEnv *eP=0);
 
-  const RadosOssPool * getPoolFromPath(const std::string &path);
+  bool getPoolFromPath(const std::string &path, RadosOssPool &pool);
+  bool getMetadataPoolFromPath(const std::string &path, RadosOssPool &pool);
+  void getPools(std::vector<RadosOssPool> &pools);
+  int reloadPools(void);
+  rados_ioctx_t metadataIoctx(const std::string &path);
+  RadosOssDirCache * dirCache(void) { return &mDirCache; }
+  int statPath(const std::string &path, struct stat *buff);
+  int statPermissions(const std::string &path, struct stat *buff);
+  static bool validStripeSize(unsigned long long size);
+  static int requestedStripeSize(XrdOucEnv &env, size_t &size);
+  int truncatePath(const std::string &path, unsigned long long size);
+  void addOpenFile(const std::string &path);
+  void removeOpenFile(const std::string &path);
+  void invalidateStat(const std::string &path, bool allAncestors=false);
+  RadosOssStatCache * statCache(void) { return &mStatCache; }
+  int checkAccess(const RadosOssCred &cred, const std::string &path, int mode);
+  int checkParentAccess(const RadosOssCred &cred, const std::string &path,
+                        bool nearestExisting);
+  int checkSearchAccess(const RadosOssCred &cred, const std::string &path);
+  RadosOssThreadPool * ioPool(void) { return &mIoPool; }
+  RadosOssThreadPool * opPool(void) { return &mOpPool; }
+  size_t readMaxInFlight(void) const { return mReadMaxInFlight; }
+  size_t readVMaxGap(void) const { return mReadVMaxGap; }
+  size_t readdirPageSize(void) const { return mReaddirPageSize; }
+  const RadosOssReadaheadConf & readaheadConf(void) const
+  { return mReadaheadConf; }
+  RadosOssMemoryBudget * readaheadBudget(void) { return &mReadaheadBudget; }
+  RadosOssBlockCache * blockCache(void) { return &mBlockCache; }
+  RadosOssFlusher * flusher(void) { return &mFlusher; }
+  RadosOssReaper * reaper(void) { return &mReaper; }
+  RadosOssScheduler * scheduler(void) { return &mScheduler; }
+  const RadosOssWriteBehindConf & writeBehindConf(void) const
+  { return mWriteBehindConf; }
+  const std::vector<RadosOssChecksumType> & checksums(void) const
+  { return mChecksums; }
+  radosfs::Filesystem * radosFs(const std::string &path);
+  radosfs::Filesystem * handleRadosFs(const std::string &path);
+  // For what is not specific to a path (e.g. the cluster's stats)
+  radosfs::Filesystem * radosFs(void) { return mRadosFsShards[0]; }
+  rados_t cluster(void) { return mCluster; }
 
   RadosOss();
   virtual ~RadosOss();
@@ -66,15 +116,84 @@ public:
 private:
   int loadInfoFromConfig(const char *pluginConf,
                          std::string &configPath,
-                         std::string &userName);
-  void addPoolFromConfStr(const char *confStr, bool isMtdPool);
-  void initIoctxInPools(void);
+                         std::string &userName,
+                         std::vector<RadosOssPool> &pools);
+  int loadPoolsFromConfig(const char *pluginConf,
+                          std::vector<RadosOssPool> &pools);
+  void addPoolFromConfStr(const char *confStr, bool isMtdPool,
+                          std::vector<RadosOssPool> &pools);
+  void addPoolToFs(const RadosOssPool &pool);
+  void removePoolFromFs(const RadosOssPool &pool);
+  RadosOssPoolTable * acquirePoolTable(void);
+  int initRadosFs(const std::string &userName, const std::string &configPath);
+  int initCluster(const std::string &userName, const std::string &configPath);
+  int openMetadataIoctx(const RadosOssPool &pool);
+  int startPoolsReloader(void);
+  void stopPoolsReloader(void);
+  static void * poolsReloaderThread(void *oss);
+  void watchPoolsConfig(void);
   std::string getDefaultPoolName(void) const;
-  void setIdsFromEnv(XrdOucEnv *env);
+  int createParentDirs(const char *path, const std::string &dirPath,
+                       const RadosOssCred &cred);
+  void addSchedConfFromStr(const char *confStr, bool isPool);
 
-  radosfs::Filesystem mRadosFs;
+  // Paths are spread over the filesystems by their hash; file and directory
+  // handles may instead take them in turns (mClientsRoundRobin)
+  std::vector<radosfs::Filesystem *> mRadosFsShards;
+  size_t mNumClients;
+  bool mClientsRoundRobin;
+  size_t mNextClient;
+  size_t mStripeSize;
+  RadosOssStatCache mStatCache;
+  RadosOssDirCache mDirCache;
+  rados_t mCluster;
+  std::map<std::string, rados_ioctx_t> mMtdIoctxs;
+  XrdSysMutex mMtdIoctxsMutex;
+  // Requests coming from XRootD (e.g. aio) run on mIoPool and may split
+  // themselves into single RADOS operations which run on mOpPool; the latter
+  // must never wait on other jobs so the two pools cannot deadlock.
+  RadosOssThreadPool mIoPool;
+  RadosOssThreadPool mOpPool;
+  size_t mAioThreads;
+  size_t mOpThreads;
+  size_t mReadMaxInFlight;
+  size_t mReadVMaxGap;
+  size_t mReaddirPageSize;
+  RadosOssReadaheadConf mReadaheadConf;
+  RadosOssMemoryBudget mReadaheadBudget;
+  RadosOssBlockCache mBlockCache;
+  RadosOssKnownDirs mKnownDirs;
+  RadosOssWriteBehindConf mWriteBehindConf;
 
-  std::vector<RadosOssPool> mPools;
+  // The pools' routing table is replaced as a whole when the configuration
+  // is reloaded; readers only hold mPoolTableMutex to take a reference.
+  RadosOssPoolTable *mPoolTable;
+  XrdSysMutex mPoolTableMutex;
+  XrdSysMutex mPoolsReloadMutex;
+  std::string mConfigFn;
+  time_t mConfigMtime;
+  size_t mPoolsReloadInterval;
+  XrdSysCondVar mPoolsReloaderCond;
+  pthread_t mPoolsReloaderThread;
+  bool mPoolsReloaderRunning;
+  bool mStopping;
+  std::string mMetricsFile;
+  size_t mMetricsInterval;
+  RadosOssFlusher mFlusher;
+  RadosOssReaper mReaper;
+  // Paths with handles open in this server, which truncatePath never
+  // replaces by a new file
+  std::map<std::string, size_t> mOpenFiles;
+  XrdSysMutex mOpenFilesMutex;
+  size_t mDurabilityInterval;
+  RadosOssSpaceMonitor mSpaceMonitor;
+  RadosOssScheduler mScheduler;
+  size_t mStatFSInterval;
+  std::string mTraceFile;
+  std::vector<RadosOssChecksumType> mChecksums;
 };
 
+// The plugin's instance, used by the checksum plugin to access the files
+extern RadosOss *OssInstance;
+
 #endif /* __RADOS_OSS_HH__ */
@@ -0,0 +1,565 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "RadosOssBlockCache.hh"
+#include "RadosOssMetrics.hh"
+
+class RadosOssReadPartJob : public RadosOssJob
+{
+public:
+  RadosOssReadPartJob(RadosOssFileReader *reader,
+                      RadosOssFileReader::Part *part)
+    : mReader(reader),
+      mPart(part)
+  {}
+
+  virtual void run(void)
+  {
+    mReader->partFinished(mPart, mReader->readDirect(mPart->data,
+                                                     mPart->offset,
+                                                     mPart->length));
+  }
+
+private:
+  RadosOssFileReader *mReader;
+  RadosOssFileReader::Part *mPart;
+};
+
+RadosOssFileVersion::RadosOssFileVersion()
+  : ino(0),
+    size(0)
+{
+  mtime.tv_sec = ctime.tv_sec = 0;
+  mtime.tv_nsec = ctime.tv_nsec = 0;
+}
+
+RadosOssFileVersion::RadosOssFileVersion(const struct stat &statBuff)
+  : ino(statBuff.st_ino),
+    size(statBuff.st_size),
+    mtime(statBuff.st_mtim),
+    ctime(statBuff.st_ctim)
+{
+}
+
+bool
+RadosOssFileVersion::operator==(const RadosOssFileVersion &other) const
+{
+  return ino == other.ino && size == other.size &&
+         mtime.tv_sec == other.mtime.tv_sec &&
+         mtime.tv_nsec == other.mtime.tv_nsec &&
+         ctime.tv_sec == other.ctime.tv_sec &&
+         ctime.tv_nsec == other.ctime.tv_nsec;
+}
+
+RadosOssFileReader::RadosOssFileReader(radosfs::File *file, size_t stripeSize,
+                                       RadosOssThreadPool *pool,
+                                       size_t maxInFlight)
+  : mFile(file),
+    mStripeSize(stripeSize),
+    mPool(pool),
+    mMaxInFlight(maxInFlight),
+    mCond(0),
+    mInFlight(0),
+    mCache(0),
+    mVersion()
+{}
+
+void
+RadosOssFileReader::useCache(RadosOssBlockCache *cache,
+                             const std::string &path,
+                             const struct stat &statBuff)
+{
+  mCache = cache->enabled() ? cache : 0;
+  mPath = path;
+  mVersion = RadosOssFileVersion(statBuff);
+}
+
+ssize_t
+RadosOssFileReader::read(char *buff, off_t offset, size_t blen)
+{
+  off_t stripeEnd = offset - offset % mStripeSize + mStripeSize;
+
+  if (mPool && mMaxInFlight > 1 && offset + (off_t) blen > stripeEnd)
+    return readParts(buff, offset, blen);
+
+  return readDirect(buff, offset, blen);
+}
+
+ssize_t
+RadosOssFileReader::readDirect(char *buff, off_t offset, size_t blen)
+{
+  if (mCache)
+    return mCache->read(*this, buff, offset, blen);
+
+  return readFromRados(buff, offset, blen);
+}
+
+// Reads each stripe object covered by the range in parallel, straight into
+// its slice of the buffer. Jobs in the pool never get here (they use
+// readDirect), so waiting for a free slot cannot deadlock.
+ssize_t
+RadosOssFileReader::readParts(char *buff, off_t offset, size_t blen)
+{
+  std::vector<Part> parts;
+  off_t end = offset + blen;
+  ssize_t ret = 0;
+  bool done = false;
+
+  for (off_t pos = offset; pos < end; pos += parts.back().length)
+  {
+    off_t stripeEnd = pos - pos % mStripeSize + mStripeSize;
+    Part part;
+
+    part.data = buff + (pos - offset);
+    part.offset = pos;
+    part.length = std::min(end, stripeEnd) - pos;
+    part.result = 0;
+    part.ready = false;
+    parts.push_back(part);
+  }
+
+  mCond.Lock();
+
+  for (size_t i = 0; i < parts.size(); i++)
+  {
+    while (mInFlight >= mMaxInFlight)
+      mCond.Wait();
+
+    mInFlight++;
+    mPool->enqueue(new RadosOssReadPartJob(this, &parts[i]));
+  }
+
+  // The parts after a short one or an error are not used but still need to
+  // finish before returning
+  for (size_t i = 0; i < parts.size(); i++)
+  {
+    while (!parts[i].ready)
+      mCond.Wait();
+
+    if (done)
+      continue;
+
+    if (parts[i].result < 0)
+    {
+      ret = parts[i].result;
+      done = true;
+      continue;
+    }
+
+    ret += parts[i].result;
+    done = parts[i].result < (ssize_t) parts[i].length;
+  }
+
+  mCond.UnLock();
+
+  return ret;
+}
+
+void
+RadosOssFileReader::partFinished(Part *part, ssize_t result)
+{
+  mCond.Lock();
+  part->result = result;
+  part->ready = true;
+  mInFlight--;
+  mCond.Broadcast();
+  mCond.UnLock();
+}
+
+ssize_t
+RadosOssFileReader::readFromRados(char *buff, off_t offset, size_t blen)
+{
+  RadosOssOpTimer timer(RADOS_OSS_OP_RADOS_READ, true);
+
+  return timer.done(mFile->read(buff, offset, blen));
+}
+
+RadosOssBlockCache::RadosOssBlockCache()
+  : mCond(0),
+    mMaxSize(0),
+    mBlockSize(0),
+    mUsed(0),
+    mHits(0),
+    mMisses(0)
+{}
+
+RadosOssBlockCache::~RadosOssBlockCache()
+{
+  while (!mFiles.empty())
+  {
+    File *file = (*mFiles.begin()).second;
+    file->writers = 0;
+    dropFile(mFiles.begin());
+  }
+}
+
+ssize_t
+RadosOssBlockCache::read(RadosOssFileReader &reader, char *buff, off_t offset,
+                         size_t blen)
+{
+  size_t stripeSize = reader.stripeSize();
+  size_t blockSize = std::min(mBlockSize, stripeSize);
+  off_t pos = offset;
+  off_t end = offset + blen;
+
+  while (pos < end)
+  {
+    off_t stripeStart = pos - pos % stripeSize;
+    off_t blockOffset = pos - (pos - stripeStart) % blockSize;
+    size_t length = std::min((off_t) blockSize,
+                             stripeStart + (off_t) stripeSize - blockOffset);
+    Block *block = acquireBlock(reader, blockOffset, length);
+
+    // Not cacheable now (the file is being written or the cache is full of
+    // blocks in use) so the rest is read directly
+    if (!block)
+    {
+      ssize_t ret = reader.readFromRados(buff + (pos - offset), pos, end - pos);
+
+      if (ret < 0)
+        return pos > offset ? pos - offset : ret;
+
+      return pos - offset + ret;
+    }
+
+    if (block->result < 0)
+    {
+      ssize_t ret = block->result;
+      releaseBlock(block);
+
+      return pos > offset ? pos - offset : ret;
+    }
+
+    off_t dataEnd = block->offset + block->result;
+    bool eof = block->result < (ssize_t) block->length;
+
+    if (pos < dataEnd)
+    {
+      size_t copyLength = std::min(dataEnd, end) - pos;
+      memcpy(buff + (pos - offset), block->data + (pos - block->offset),
+             copyLength);
+      pos += copyLength;
+    }
+
+    releaseBlock(block);
+
+    if (eof && pos >= dataEnd)
+      break;
+  }
+
+  return pos - offset;
+}
+
+// Must be called with the lock held
+RadosOssBlockCache::File *
+RadosOssBlockCache::findFile(const RadosOssFileReader &reader, bool create)
+{
+  std::map<std::string, File *>::iterator it = mFiles.find(reader.path());
+
+  if (it != mFiles.end())
+  {
+    File *file = (*it).second;
+
+    // The file changed since its blocks were cached
+    if (file->writers == 0 && file->version != reader.version())
+    {
+      while (!file->blocks.empty())
+        detachBlock((*file->blocks.begin()).second);
+
+      file->version = reader.version();
+    }
+
+    return file;
+  }
+
+  if (!create)
+    return 0;
+
+  File *file = new File;
+  file->path = reader.path();
+  file->version = reader.version();
+  file->writers = 0;
+  mFiles[file->path] = file;
+
+  return file;
+}
+
+// Returns the block once it is ready (with a reference which needs to be
+// released) or 0 if it cannot be cached
+RadosOssBlockCache::Block *
+RadosOssBlockCache::acquireBlock(RadosOssFileReader &reader, off_t blockOffset,
+                                 size_t length)
+{
+  mCond.Lock();
+
+  File *file = findFile(reader, true);
+
+  if (file->writers > 0)
+  {
+    mCond.UnLock();
+    return 0;
+  }
+
+  std::map<off_t, Block *>::iterator it = file->blocks.find(blockOffset);
+
+  if (it != file->blocks.end())
+  {
+    Block *block = (*it).second;
+
+    block->refs++;
+    mHits++;
+
+    while (!block->ready)
+      mCond.Wait();
+
+    if (block->file)
+      mLru.splice(mLru.end(), mLru, block->lru);
+
+    mCond.UnLock();
+
+    return block;
+  }
+
+  if (!reserve(length))
+  {
+    mCond.UnLock();
+    return 0;
+  }
+
+  // Eviction may have dropped the file's entry
+  file = findFile(reader, true);
+
+  Block *block = new Block;
+  block->file = file;
+  block->offset = blockOffset;
+  block->length = length;
+  block->data = (char *) malloc(length);
+  block->result = 0;
+  block->ready = false;
+  block->refs = 1;
+  file->blocks[blockOffset] = block;
+  mMisses++;
+
+  mCond.UnLock();
+
+  ssize_t ret = reader.readFromRados(block->data, blockOffset, length);
+
+  mCond.Lock();
+
+  block->result = ret;
+  block->ready = true;
+
+  // Errors are not kept, the next reader tries again
+  if (ret < 0 && block->file)
+    detachBlock(block);
+  else if (block->file)
+    block->lru = mLru.insert(mLru.end(), block);
+
+  mCond.Broadcast();
+  mCond.UnLock();
+
+  return block;
+}
+
+void
+RadosOssBlockCache::releaseBlock(Block *block)
+{
+  mCond.Lock();
+
+  block->refs--;
+
+  // Detached blocks are freed by their last user
+  if (!block->file && block->refs == 0)
+    freeBlock(block);
+
+  mCond.UnLock();
+}
+
+// Must be called with the lock held
+bool
+RadosOssBlockCache::reserve(size_t size)
+{
+  std::list<Block *>::iterator it = mLru.begin();
+
+  if (size > mMaxSize)
+    return false;
+
+  while (mUsed + size > mMaxSize && it != mLru.end())
+  {
+    Block *block = *it;
+    it++;
+
+    if (block->refs > 0)
+      continue;
+
+    File *file = block->file;
+    detachBlock(block);
+
+    if (file->blocks.empty() && file->writers == 0)
+      dropFile(mFiles.find(file->path));
+  }
+
+  if (mUsed + size > mMaxSize)
+    return false;
+
+  mUsed += size;
+
+  return true;
+}
+
+// Must be called with the lock held
+void
+RadosOssBlockCache::detachBlock(Block *block)
+{
+  block->file->blocks.erase(block->offset);
+
+  if (block->ready && block->result >= 0)
+    mLru.erase(block->lru);
+
+  block->file = 0;
+
+  if (block->refs == 0)
+    freeBlock(block);
+}
+
+// Must be called with the lock held
+void
+RadosOssBlockCache::dropFile(std::map<std::string, File *>::iterator it)
+{
+  File *file = (*it).second;
+
+  while (!file->blocks.empty())
+    detachBlock((*file->blocks.begin()).second);
+
+  // Files being written keep their entry so readers keep bypassing the cache
+  if (file->writers == 0)
+  {
+    mFiles.erase(it);
+    delete file;
+  }
+}
+
+// Must be called with the lock held
+void
+RadosOssBlockCache::freeBlock(Block *block)
+{
+  mUsed -= block->length;
+  free(block->data);
+  delete block;
+}
+
+void
+RadosOssBlockCache::addWriter(const std::string &path)
+{
+  std::map<std::string, File *>::iterator it;
+  File *file;
+
+  mCond.Lock();
+  it = mFiles.find(path);
+
+  if (it == mFiles.end())
+  {
+    file = new File;
+    file->path = path;
+    file->version.size = -1;
+    file->writers = 0;
+    mFiles[path] = file;
+  }
+  else
+  {
+    file = (*it).second;
+
+    while (!file->blocks.empty())
+      detachBlock((*file->blocks.begin()).second);
+  }
+
+  file->writers++;
+
+  mCond.UnLock();
+}
+
+void
+RadosOssBlockCache::removeWriter(const std::string &path)
+{
+  std::map<std::string, File *>::iterator it;
+
+  mCond.Lock();
+  it = mFiles.find(path);
+
+  if (it != mFiles.end())
+  {
+    File *file = (*it).second;
+
+    if (file->writers > 0)
+      file->writers--;
+
+    dropFile(it);
+  }
+
+  mCond.UnLock();
+}
+
+void
+RadosOssBlockCache::invalidate(const std::string &path, bool isPrefix)
+{
+  std::map<std::string, File *>::iterator it;
+
+  mCond.Lock();
+  it = mFiles.lower_bound(path);
+
+  while (it != mFiles.end())
+  {
+    const std::string &filePath = (*it).first;
+
+    if (filePath.compare(0, path.length(), path) != 0)
+      break;
+
+    bool matches = filePath.length() == path.length() ||
+                   (isPrefix && (path[path.length() - 1] == '/' ||
+                                 filePath[path.length()] == '/'));
+
+    if (!isPrefix && !matches)
+      break;
+
+    if (matches)
+      dropFile(it++);
+    else
+      it++;
+  }
+
+  mCond.UnLock();
+}
+
+size_t
+RadosOssBlockCache::usedSize()
+{
+  size_t used;
+
+  mCond.Lock();
+  used = mUsed;
+  mCond.UnLock();
+
+  return used;
+}
@@ -0,0 +1,172 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_BLOCK_CACHE_HH__
+#define __RADOS_OSS_BLOCK_CACHE_HH__
+
+#include <XrdSys/XrdSysPthread.hh>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <list>
+#include <map>
+#include <string>
+#include <radosfs/File.hh>
+
+#include "RadosOssThreadPool.hh"
+
+class RadosOssBlockCache;
+
+// Which contents of a file are cached: its inode (kept across renames, so a
+// file renamed over another is told apart) and its size and modification
+// and change times, to nanoseconds
+struct RadosOssFileVersion
+{
+  RadosOssFileVersion();
+  RadosOssFileVersion(const struct stat &statBuff);
+
+  bool operator==(const RadosOssFileVersion &other) const;
+  bool operator!=(const RadosOssFileVersion &other) const
+  { return !(*this == other); }
+
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+  struct timespec ctime;
+};
+
+// Reads the data of an open file, from RADOS or, for files opened for reading
+// only, through the block cache shared by all the handles. Reads spanning
+// several stripe objects are split at their boundaries and the parts are read
+// in parallel (at most maxInFlight of them per handle) into the caller's
+// buffer.
+class RadosOssFileReader
+{
+public:
+  RadosOssFileReader(radosfs::File *file, size_t stripeSize,
+                     RadosOssThreadPool *pool=0, size_t maxInFlight=0);
+
+  void useCache(RadosOssBlockCache *cache, const std::string &path,
+                const struct stat &statBuff);
+  ssize_t read(char *buff, off_t offset, size_t blen);
+  // Reads the range at once, for the jobs already running in the pool
+  ssize_t readDirect(char *buff, off_t offset, size_t blen);
+  ssize_t readFromRados(char *buff, off_t offset, size_t blen);
+
+  const std::string & path(void) const { return mPath; }
+  size_t stripeSize(void) const { return mStripeSize; }
+  const RadosOssFileVersion & version(void) const { return mVersion; }
+
+private:
+  struct Part
+  {
+    char *data;
+    off_t offset;
+    size_t length;
+    ssize_t result;
+    bool ready;
+  };
+
+  friend class RadosOssReadPartJob;
+
+  ssize_t readParts(char *buff, off_t offset, size_t blen);
+  void partFinished(Part *part, ssize_t result);
+
+  radosfs::File *mFile;
+  size_t mStripeSize;
+  RadosOssThreadPool *mPool;
+  size_t mMaxInFlight;
+  XrdSysCondVar mCond;
+  size_t mInFlight;
+  RadosOssBlockCache *mCache;
+  std::string mPath;
+  RadosOssFileVersion mVersion;
+};
+
+// Process-wide cache of file blocks (aligned to the stripe objects) with a
+// global memory limit and LRU eviction. Concurrent misses on the same block
+// wait for a single read. Files are identified by path together with the
+// version they had when opened, so changes made elsewhere are noticed on the
+// next open; files open for writing in this server are not cached.
+class RadosOssBlockCache
+{
+public:
+  RadosOssBlockCache();
+  ~RadosOssBlockCache();
+
+  void setMaxSize(size_t maxSize) { mMaxSize = maxSize; }
+  void setBlockSize(size_t blockSize) { mBlockSize = blockSize; }
+  bool enabled(void) const { return mMaxSize > 0 && mBlockSize > 0; }
+
+  ssize_t read(RadosOssFileReader &reader, char *buff, off_t offset,
+               size_t blen);
+  void addWriter(const std::string &path);
+  void removeWriter(const std::string &path);
+  // A prefix invalidates every path under it too, e.g. a renamed directory
+  void invalidate(const std::string &path, bool isPrefix=false);
+
+  unsigned long long hits(void) const { return mHits; }
+  unsigned long long misses(void) const { return mMisses; }
+  size_t usedSize(void);
+
+private:
+  struct File;
+
+  struct Block
+  {
+    File *file;
+    off_t offset;
+    size_t length;
+    char *data;
+    ssize_t result;
+    bool ready;
+    size_t refs;
+    std::list<Block *>::iterator lru;
+  };
+
+  struct File
+  {
+    std::string path;
+    RadosOssFileVersion version;
+    size_t writers;
+    std::map<off_t, Block *> blocks;
+  };
+
+  File * findFile(const RadosOssFileReader &reader, bool create);
+  Block * acquireBlock(RadosOssFileReader &reader, off_t blockOffset,
+                       size_t length);
+  void releaseBlock(Block *block);
+  bool reserve(size_t size);
+  void detachBlock(Block *block);
+  void dropFile(std::map<std::string, File *>::iterator it);
+  void freeBlock(Block *block);
+
+  XrdSysCondVar mCond;
+  std::map<std::string, File *> mFiles;
+  // Least recently used first; only blocks which are ready are in it
+  std::list<Block *> mLru;
+  size_t mMaxSize;
+  size_t mBlockSize;
+  size_t mUsed;
+  unsigned long long mHits;
+  unsigned long long mMisses;
+};
+
+#endif /* __RADOS_OSS_BLOCK_CACHE_HH__ */
@@ -0,0 +1,387 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#ifdef RADOS_OSS_X86_SIMD
+#include <cpuid.h>
+#endif
+
+#include "RadosOssChecksum.hh"
+#include "RadosOssDefines.hh"
+
+#ifdef RADOS_OSS_X86_SIMD
+// From RadosOssChecksumSimd.cc, which is built for SSE4.2 and SSSE3 so they
+// may only be called if the CPU has them
+uint32_t radosOssCrc32cSse42(uint32_t crc, const char *data, size_t length);
+uint32_t radosOssAdler32Ssse3(uint32_t adler, const char *data,
+                              size_t length);
+
+static bool
+cpuHasSimdChecksums(void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return false;
+
+  return (ecx & bit_SSE4_2) && (ecx & bit_SSSE3);
+}
+
+static const bool useSimd = cpuHasSimdChecksums();
+#endif
+
+#define ADLER32_BASE 65521
+// Largest number of bytes before s2 may overflow 32 bits
+#define ADLER32_NMAX 5552
+
+static const char *checksumNames[RADOS_OSS_NUM_CKS] = {
+  "adler32",
+  "crc32c"
+};
+
+// Slicing-by-8 tables of the (reflected) Castagnoli polynomial
+class Crc32cTables
+{
+public:
+  Crc32cTables()
+  {
+    for (int i = 0; i < 256; i++)
+    {
+      uint32_t crc = i;
+
+      for (int j = 0; j < 8; j++)
+        crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+
+      table[0][i] = crc;
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+      for (int j = 1; j < 8; j++)
+        table[j][i] = (table[j - 1][i] >> 8) ^ table[0][table[j - 1][i] & 0xff];
+    }
+  }
+
+  uint32_t table[8][256];
+};
+
+static const Crc32cTables crc32cTables;
+
+const char *
+RadosOssChecksum::name(RadosOssChecksumType type)
+{
+  return checksumNames[type];
+}
+
+bool
+RadosOssChecksum::fromName(const char *name, RadosOssChecksumType &type)
+{
+  for (int i = 0; i < RADOS_OSS_NUM_CKS; i++)
+  {
+    if (strcasecmp(name, checksumNames[i]) == 0)
+    {
+      type = (RadosOssChecksumType) i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+uint32_t
+RadosOssChecksum::initialValue(RadosOssChecksumType type)
+{
+  return type == RADOS_OSS_CKS_ADLER32 ? 1 : 0;
+}
+
+uint32_t
+RadosOssChecksum::update(RadosOssChecksumType type, uint32_t value,
+                         const char *data, size_t length)
+{
+  if (type == RADOS_OSS_CKS_ADLER32)
+    return adler32(value, data, length);
+
+  return crc32c(value, data, length);
+}
+
+uint32_t
+RadosOssChecksum::adler32(uint32_t adler, const char *data, size_t length)
+{
+  const unsigned char *buff = (const unsigned char *) data;
+  uint32_t s1 = adler & 0xffff;
+  uint32_t s2 = adler >> 16;
+
+#ifdef RADOS_OSS_X86_SIMD
+  if (useSimd)
+    return radosOssAdler32Ssse3(adler, data, length);
+#endif
+
+  while (length > 0)
+  {
+    size_t blockLength = length < ADLER32_NMAX ? length : ADLER32_NMAX;
+    length -= blockLength;
+
+    while (blockLength >= 8)
+    {
+      s1 += buff[0]; s2 += s1;
+      s1 += buff[1]; s2 += s1;
+      s1 += buff[2]; s2 += s1;
+      s1 += buff[3]; s2 += s1;
+      s1 += buff[4]; s2 += s1;
+      s1 += buff[5]; s2 += s1;
+      s1 += buff[6]; s2 += s1;
+      s1 += buff[7]; s2 += s1;
+      buff += 8;
+      blockLength -= 8;
+    }
+
+    while (blockLength-- > 0)
+    {
+      s1 += *buff++;
+      s2 += s1;
+    }
+
+    s1 %= ADLER32_BASE;
+    s2 %= ADLER32_BASE;
+  }
+
+  return (s2 << 16) | s1;
+}
+
+uint32_t
+RadosOssChecksum::crc32c(uint32_t crc, const char *data, size_t length)
+{
+  const unsigned char *buff = (const unsigned char *) data;
+  const uint32_t (*table)[256] = crc32cTables.table;
+
+#ifdef RADOS_OSS_X86_SIMD
+  if (useSimd)
+    return radosOssCrc32cSse42(crc, data, length);
+#endif
+
+  crc = ~crc;
+
+  while (length > 0 && ((uintptr_t) buff & 7) != 0)
+  {
+    crc = (crc >> 8) ^ table[0][(crc ^ *buff++) & 0xff];
+    length--;
+  }
+
+  while (length >= 8)
+  {
+    uint32_t low, high;
+
+    memcpy(&low, buff, 4);
+    memcpy(&high, buff + 4, 4);
+    low ^= crc;
+
+    crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^
+          table[5][(low >> 16) & 0xff] ^ table[4][low >> 24] ^
+          table[3][high & 0xff] ^ table[2][(high >> 8) & 0xff] ^
+          table[1][(high >> 16) & 0xff] ^ table[0][high >> 24];
+
+    buff += 8;
+    length -= 8;
+  }
+
+  while (length-- > 0)
+    crc = (crc >> 8) ^ table[0][(crc ^ *buff++) & 0xff];
+
+  return ~crc;
+}
+
+void
+RadosOssChecksum::pageChecksums(const char *data, off_t offset, size_t length,
+                                uint32_t *csvec)
+{
+  size_t pos = 0;
+
+  while (pos < length)
+  {
+    size_t pageLength = std::min(length - pos, (size_t) (PGIO_PAGE_SIZE -
+                                 (offset + pos) % PGIO_PAGE_SIZE));
+
+    *csvec++ = crc32c(0, data + pos, pageLength);
+    pos += pageLength;
+  }
+}
+
+bool
+RadosOssChecksum::verifyPageChecksums(const char *data, off_t offset,
+                                      size_t length, const uint32_t *csvec)
+{
+  size_t pos = 0;
+
+  while (pos < length)
+  {
+    size_t pageLength = std::min(length - pos, (size_t) (PGIO_PAGE_SIZE -
+                                 (offset + pos) % PGIO_PAGE_SIZE));
+
+    if (*csvec++ != crc32c(0, data + pos, pageLength))
+      return false;
+
+    pos += pageLength;
+  }
+
+  return true;
+}
+
+static std::string
+xattrName(RadosOssChecksumType type)
+{
+  return std::string(CHECKSUM_XATTR_PREFIX) + checksumNames[type];
+}
+
+int
+RadosOssChecksum::store(radosfs::FsObj &obj, RadosOssChecksumType type,
+                        uint32_t value, const struct stat &statBuff)
+{
+  char xattr[64];
+
+  snprintf(xattr, sizeof(xattr), "%08x %llu %llu", value,
+           (unsigned long long) statBuff.st_size,
+           (unsigned long long) statBuff.st_mtime);
+
+  return obj.setXAttr(xattrName(type), xattr);
+}
+
+// Returns -ESRCH if there is no checksum for the file and -ESTALE if the
+// file changed since it was stored
+int
+RadosOssChecksum::load(radosfs::FsObj &obj, RadosOssChecksumType type,
+                       uint32_t &value, const struct stat &statBuff)
+{
+  std::string xattr;
+  unsigned long long size, mtime;
+  int ret = obj.getXAttr(xattrName(type), xattr);
+
+  if (ret == -ENODATA || ret == -ENOENT)
+    return -ESRCH;
+
+  if (ret < 0)
+    return ret;
+
+  if (sscanf(xattr.c_str(), "%x %llu %llu", &value, &size, &mtime) != 3)
+    return -ESRCH;
+
+  if (size != (unsigned long long) statBuff.st_size ||
+      mtime != (unsigned long long) statBuff.st_mtime)
+    return -ESTALE;
+
+  return 0;
+}
+
+int
+RadosOssChecksum::remove(radosfs::FsObj &obj, RadosOssChecksumType type)
+{
+  int ret = obj.removeXAttr(xattrName(type));
+
+  if (ret == -ENODATA || ret == -ENOENT)
+    return 0;
+
+  return ret;
+}
+
+RadosOssWriteChecksums::RadosOssWriteChecksums(
+    const std::vector<RadosOssChecksumType> &types, bool fromStart)
+  : mTypes(types),
+    mNextOffset(0),
+    mValid(fromStart),
+    mWritten(false)
+{
+  for (size_t i = 0; i < mTypes.size(); i++)
+    mValues.push_back(RadosOssChecksum::initialValue(mTypes[i]));
+}
+
+// Must be called with the lock held
+bool
+RadosOssWriteChecksums::setInvalid()
+{
+  // Nothing was removed yet if the checksums were valid until now or if
+  // this is the first write of a handle which could not compute them
+  bool needsRemoval = mValid || !mWritten;
+
+  mValid = false;
+  mWritten = true;
+
+  return needsRemoval;
+}
+
+bool
+RadosOssWriteChecksums::update(const char *data, off_t offset, size_t length)
+{
+  XrdSysMutexHelper lock(mMutex);
+
+  if (!mValid || offset != mNextOffset)
+    return setInvalid();
+
+  for (size_t i = 0; i < mTypes.size(); i++)
+    mValues[i] = RadosOssChecksum::update(mTypes[i], mValues[i], data, length);
+
+  mNextOffset += length;
+  mWritten = true;
+
+  return false;
+}
+
+bool
+RadosOssWriteChecksums::invalidate()
+{
+  XrdSysMutexHelper lock(mMutex);
+
+  return setInvalid();
+}
+
+bool
+RadosOssWriteChecksums::valid()
+{
+  XrdSysMutexHelper lock(mMutex);
+
+  return mValid;
+}
+
+bool
+RadosOssWriteChecksums::written()
+{
+  XrdSysMutexHelper lock(mMutex);
+
+  return mWritten;
+}
+
+// Number of bytes, from the start of the file, covered by the checksums
+off_t
+RadosOssWriteChecksums::length()
+{
+  XrdSysMutexHelper lock(mMutex);
+
+  return mNextOffset;
+}
+
+uint32_t
+RadosOssWriteChecksums::value(size_t index)
+{
+  XrdSysMutexHelper lock(mMutex);
+
+  return mValues[index];
+}
@@ -0,0 +1,98 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_CHECKSUM_HH__
+#define __RADOS_OSS_CHECKSUM_HH__
+
+#include <XrdSys/XrdSysPthread.hh>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include <radosfs/FsObj.hh>
+
+typedef enum {
+  RADOS_OSS_CKS_ADLER32 = 0,
+  RADOS_OSS_CKS_CRC32C,
+  RADOS_OSS_NUM_CKS
+} RadosOssChecksumType;
+
+// The supported checksums and how they are stored: as an xattr of the file
+// holding the value together with the size and mtime the file had, so a
+// checksum is ignored once the file changes.
+class RadosOssChecksum
+{
+public:
+  static const char * name(RadosOssChecksumType type);
+  static bool fromName(const char *name, RadosOssChecksumType &type);
+
+  static uint32_t initialValue(RadosOssChecksumType type);
+  static uint32_t update(RadosOssChecksumType type, uint32_t value,
+                         const char *data, size_t length);
+  static uint32_t adler32(uint32_t adler, const char *data, size_t length);
+  static uint32_t crc32c(uint32_t crc, const char *data, size_t length);
+
+  // The crc32c of every page (aligned to the file offsets) of some data;
+  // the first and last pages may be partial
+  static void pageChecksums(const char *data, off_t offset, size_t length,
+                            uint32_t *csvec);
+  static bool verifyPageChecksums(const char *data, off_t offset,
+                                  size_t length, const uint32_t *csvec);
+
+  static int store(radosfs::FsObj &obj, RadosOssChecksumType type,
+                   uint32_t value, const struct stat &statBuff);
+  static int load(radosfs::FsObj &obj, RadosOssChecksumType type,
+                  uint32_t &value, const struct stat &statBuff);
+  static int remove(radosfs::FsObj &obj, RadosOssChecksumType type);
+};
+
+// Computes the checksums of the data written through a handle, as long as it
+// is written sequentially from the beginning of an empty file.
+class RadosOssWriteChecksums
+{
+public:
+  RadosOssWriteChecksums(const std::vector<RadosOssChecksumType> &types,
+                         bool fromStart);
+
+  // These return true the first time the checksums become invalid, i.e.
+  // when the ones stored for the file need to be removed
+  bool update(const char *data, off_t offset, size_t length);
+  bool invalidate(void);
+
+  bool valid(void);
+  bool written(void);
+  off_t length(void);
+  const std::vector<RadosOssChecksumType> & types(void) const
+  { return mTypes; }
+  uint32_t value(size_t index);
+
+private:
+  bool setInvalid(void);
+
+  XrdSysMutex mMutex;
+  std::vector<RadosOssChecksumType> mTypes;
+  std::vector<uint32_t> mValues;
+  off_t mNextOffset;
+  bool mValid;
+  bool mWritten;
+};
+
+#endif /* __RADOS_OSS_CHECKSUM_HH__ */
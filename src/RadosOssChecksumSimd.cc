@@ -0,0 +1,147 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+// Checksum kernels for x86-64 CPUs with SSE4.2 and SSSE3. This file is built
+// with those instruction sets enabled, so its functions must only be called
+// after checking the CPU has them (see RadosOssChecksum.cc).
+
+#ifdef RADOS_OSS_X86_SIMD
+
+#include <nmmintrin.h>
+#include <tmmintrin.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define ADLER32_BASE 65521
+#define ADLER32_NMAX 5552
+#define ADLER32_SIMD_BLOCK 32
+
+uint32_t
+radosOssCrc32cSse42(uint32_t crc, const char *data, size_t length)
+{
+  const unsigned char *buff = (const unsigned char *) data;
+  uint64_t crc64;
+
+  crc = ~crc;
+
+  while (length > 0 && ((uintptr_t) buff & 7) != 0)
+  {
+    crc = _mm_crc32_u8(crc, *buff++);
+    length--;
+  }
+
+  crc64 = crc;
+
+  while (length >= 8)
+  {
+    uint64_t word;
+
+    memcpy(&word, buff, 8);
+    crc64 = _mm_crc32_u64(crc64, word);
+    buff += 8;
+    length -= 8;
+  }
+
+  crc = (uint32_t) crc64;
+
+  while (length-- > 0)
+    crc = _mm_crc32_u8(crc, *buff++);
+
+  return ~crc;
+}
+
+// Blocks of 32 bytes are summed with SAD (for s1) and multiply-adds by the
+// weights 32..1 (for s2); s1 is added to s2 32 times per block, which is
+// accounted for at the end of each run of blocks.
+uint32_t
+radosOssAdler32Ssse3(uint32_t adler, const char *data, size_t length)
+{
+  const unsigned char *buff = (const unsigned char *) data;
+  uint32_t s1 = adler & 0xffff;
+  uint32_t s2 = adler >> 16;
+  size_t blocks = length / ADLER32_SIMD_BLOCK;
+
+  length -= blocks * ADLER32_SIMD_BLOCK;
+
+  const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25,
+                                     24, 23, 22, 21, 20, 19, 18, 17);
+  const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9,
+                                     8, 7, 6, 5, 4, 3, 2, 1);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(1);
+
+  while (blocks > 0)
+  {
+    size_t n = ADLER32_NMAX / ADLER32_SIMD_BLOCK;
+
+    if (n > blocks)
+      n = blocks;
+
+    blocks -= n;
+
+    __m128i vPrefix = _mm_set_epi32(0, 0, 0, s1 * n);
+    __m128i vS2 = _mm_set_epi32(0, 0, 0, s2);
+    __m128i vS1 = _mm_setzero_si128();
+
+    do
+    {
+      const __m128i bytes1 = _mm_loadu_si128((const __m128i *) buff);
+      const __m128i bytes2 = _mm_loadu_si128((const __m128i *) (buff + 16));
+
+      vPrefix = _mm_add_epi32(vPrefix, vS1);
+
+      vS1 = _mm_add_epi32(vS1, _mm_sad_epu8(bytes1, zero));
+      vS2 = _mm_add_epi32(vS2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1),
+                                              ones));
+      vS1 = _mm_add_epi32(vS1, _mm_sad_epu8(bytes2, zero));
+      vS2 = _mm_add_epi32(vS2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2),
+                                              ones));
+      buff += ADLER32_SIMD_BLOCK;
+    } while (--n);
+
+    vS2 = _mm_add_epi32(vS2, _mm_slli_epi32(vPrefix, 5));
+
+    // Horizontal sums of the four lanes
+    vS1 = _mm_add_epi32(vS1, _mm_shuffle_epi32(vS1, _MM_SHUFFLE(2, 3, 0, 1)));
+    vS1 = _mm_add_epi32(vS1, _mm_shuffle_epi32(vS1, _MM_SHUFFLE(1, 0, 3, 2)));
+    s1 += _mm_cvtsi128_si32(vS1);
+
+    vS2 = _mm_add_epi32(vS2, _mm_shuffle_epi32(vS2, _MM_SHUFFLE(2, 3, 0, 1)));
+    vS2 = _mm_add_epi32(vS2, _mm_shuffle_epi32(vS2, _MM_SHUFFLE(1, 0, 3, 2)));
+    s2 = _mm_cvtsi128_si32(vS2);
+
+    s1 %= ADLER32_BASE;
+    s2 %= ADLER32_BASE;
+  }
+
+  while (length-- > 0)
+  {
+    s1 += *buff++;
+    s2 += s1;
+  }
+
+  s1 %= ADLER32_BASE;
+  s2 %= ADLER32_BASE;
+
+  return (s2 << 16) | s1;
+}
+
+#endif /* RADOS_OSS_X86_SIMD */
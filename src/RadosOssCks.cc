@@ -0,0 +1,349 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include <XrdVersion.hh>
+#include <algorithm>
+#include <string>
+
+#include "RadosOssCks.hh"
+#include "RadosOss.hh"
+#include "RadosOssDefines.hh"
+
+extern "C"
+{
+  XrdCks*
+  XrdCksInit(XrdSysError *eDest, const char *config_fn, const char *parms)
+  {
+    return new RadosOssCks(eDest);
+  }
+}
+
+RadosOssCks::RadosOssCks(XrdSysError *eroute)
+  : XrdCks(eroute)
+{}
+
+radosfs::File::OpenMode
+RadosOssCks::openMode(bool modifies)
+{
+  if (modifies)
+    return (radosfs::File::OpenMode)
+        (radosfs::File::MODE_WRITE | radosfs::File::MODE_READ);
+
+  return radosfs::File::MODE_READ;
+}
+
+void
+RadosOssCks::setValue(XrdCksData &cks, uint32_t value,
+                      const struct stat &statBuff)
+{
+  unsigned char bytes[4];
+
+  bytes[0] = value >> 24;
+  bytes[1] = value >> 16;
+  bytes[2] = value >> 8;
+  bytes[3] = value;
+
+  cks.Set(bytes, sizeof(bytes));
+  cks.fmTime = statBuff.st_mtime;
+  cks.csTime = 0;
+}
+
+int
+RadosOssCks::computeChecksums(radosfs::File &file,
+                              const std::vector<RadosOssChecksumType> &types,
+                              std::vector<uint32_t> &values,
+                              struct stat &statBuff)
+{
+  std::vector<char> buff(CHECKSUM_READ_BLOCK_SIZE);
+  struct stat statAfter;
+  off_t offset = 0;
+  int ret;
+
+  ret = file.stat(&statBuff);
+
+  if (ret != 0)
+    return ret;
+
+  values.clear();
+  for (size_t i = 0; i < types.size(); i++)
+    values.push_back(RadosOssChecksum::initialValue(types[i]));
+
+  while (offset < statBuff.st_size)
+  {
+    ssize_t length = file.read(&buff[0], offset, buff.size());
+
+    if (length < 0)
+      return length;
+
+    if (length == 0)
+      break;
+
+    for (size_t i = 0; i < types.size(); i++)
+      values[i] = RadosOssChecksum::update(types[i], values[i], &buff[0],
+                                           length);
+
+    offset += length;
+  }
+
+  ret = file.stat(&statAfter);
+
+  if (ret != 0)
+    return ret;
+
+  // The file was modified while it was being read
+  if (offset != statBuff.st_size || statAfter.st_size != statBuff.st_size ||
+      statAfter.st_mtime != statBuff.st_mtime)
+    return -EAGAIN;
+
+  return 0;
+}
+
+// As the OSS does before accessing a path, files closed without syncing
+// are synced first, which also reports the error if that failed
+static int
+flushPath(const char *pfn)
+{
+  return OssInstance->flusher()->flushPath(pfn);
+}
+
+int
+RadosOssCks::Calc(const char *pfn, XrdCksData &cks, int doSet)
+{
+  RadosOssChecksumType type;
+
+  if (!RadosOssChecksum::fromName(cks.Name, type))
+    return -ENOTSUP;
+
+  if (!OssInstance)
+    return -ENODEV;
+
+  int ret = flushPath(pfn);
+
+  if (ret != 0)
+    return ret;
+
+  radosfs::File file(OssInstance->radosFs(pfn), pfn, openMode(doSet));
+
+  // All the configured checksums are computed with the same read of the file
+  std::vector<RadosOssChecksumType> types = OssInstance->checksums();
+  std::vector<RadosOssChecksumType>::iterator it =
+      std::find(types.begin(), types.end(), type);
+
+  if (it == types.end())
+  {
+    types.insert(types.begin(), type);
+    it = types.begin();
+  }
+
+  std::vector<uint32_t> values;
+  struct stat statBuff;
+  ret = computeChecksums(file, types, values, statBuff);
+
+  if (ret != 0)
+    return ret;
+
+  setValue(cks, values[it - types.begin()], statBuff);
+
+  if (doSet)
+  {
+    for (size_t i = 0; i < types.size(); i++)
+      RadosOssChecksum::store(file, types[i], values[i], statBuff);
+  }
+
+  return 0;
+}
+
+int
+RadosOssCks::Del(const char *pfn, XrdCksData &cks)
+{
+  RadosOssChecksumType type;
+
+  if (!RadosOssChecksum::fromName(cks.Name, type))
+    return -ENOTSUP;
+
+  if (!OssInstance)
+    return -ENODEV;
+
+  radosfs::File file(OssInstance->radosFs(pfn), pfn, openMode(true));
+
+  return RadosOssChecksum::remove(file, type);
+}
+
+int
+RadosOssCks::Get(const char *pfn, XrdCksData &cks)
+{
+  RadosOssChecksumType type;
+  struct stat statBuff;
+  uint32_t value;
+  int ret;
+
+  if (!RadosOssChecksum::fromName(cks.Name, type))
+    return -ENOTSUP;
+
+  if (!OssInstance)
+    return -ENODEV;
+
+  ret = flushPath(pfn);
+
+  if (ret != 0)
+    return ret;
+
+  radosfs::File file(OssInstance->radosFs(pfn), pfn, radosfs::File::MODE_READ);
+
+  ret = file.stat(&statBuff);
+
+  if (ret != 0)
+    return ret;
+
+  // -ESRCH if there is no checksum, -ESTALE if it is out of date
+  ret = RadosOssChecksum::load(file, type, value, statBuff);
+
+  if (ret != 0)
+    return ret;
+
+  setValue(cks, value, statBuff);
+
+  return cks.Length;
+}
+
+int
+RadosOssCks::Config(const char *token, char *line)
+{
+  return 1;
+}
+
+int
+RadosOssCks::Init(const char *configFn, const char *defaultCalc)
+{
+  return 1;
+}
+
+char *
+RadosOssCks::List(const char *pfn, char *buff, int blen, char sep)
+{
+  struct stat statBuff;
+  int used = 0;
+
+  if (!OssInstance || blen <= 0 || flushPath(pfn) != 0)
+    return 0;
+
+  radosfs::File file(OssInstance->radosFs(pfn), pfn, radosfs::File::MODE_READ);
+
+  if (file.stat(&statBuff) != 0)
+    return 0;
+
+  buff[0] = '\0';
+
+  for (int i = 0; i < RADOS_OSS_NUM_CKS; i++)
+  {
+    RadosOssChecksumType type = (RadosOssChecksumType) i;
+    const char *name = RadosOssChecksum::name(type);
+    int length = strlen(name) + (used > 0 ? 1 : 0);
+    uint32_t value;
+
+    if (RadosOssChecksum::load(file, type, value, statBuff) != 0)
+      continue;
+
+    if (used + length >= blen)
+      break;
+
+    if (used > 0)
+      buff[used++] = sep;
+
+    strcpy(buff + used, name);
+    used += strlen(name);
+  }
+
+  return used > 0 ? buff : 0;
+}
+
+const char *
+RadosOssCks::Name(int seqNum)
+{
+  if (seqNum < 0 || seqNum >= RADOS_OSS_NUM_CKS)
+    return 0;
+
+  return RadosOssChecksum::name((RadosOssChecksumType) seqNum);
+}
+
+int
+RadosOssCks::Size(const char *name)
+{
+  RadosOssChecksumType type;
+
+  if (name && !RadosOssChecksum::fromName(name, type))
+    return 0;
+
+  // Both adler32 and crc32c are 32 bit values
+  return 4;
+}
+
+int
+RadosOssCks::Set(const char *pfn, XrdCksData &cks, int myTime)
+{
+  RadosOssChecksumType type;
+  struct stat statBuff;
+  int ret;
+
+  if (!RadosOssChecksum::fromName(cks.Name, type))
+    return -ENOTSUP;
+
+  if (cks.Length != 4)
+    return -EINVAL;
+
+  if (!OssInstance)
+    return -ENODEV;
+
+  radosfs::File file(OssInstance->radosFs(pfn), pfn, openMode(true));
+
+  ret = file.stat(&statBuff);
+
+  if (ret != 0)
+    return ret;
+
+  const unsigned char *bytes = (const unsigned char *) cks.Value;
+  uint32_t value = ((uint32_t) bytes[0] << 24) | ((uint32_t) bytes[1] << 16) |
+                   ((uint32_t) bytes[2] << 8) | bytes[3];
+
+  return RadosOssChecksum::store(file, type, value, statBuff);
+}
+
+int
+RadosOssCks::Ver(const char *pfn, XrdCksData &cks)
+{
+  XrdCksData current;
+  int ret;
+
+  current.Set(cks.Name);
+  ret = Get(pfn, current);
+
+  if (ret == -ESRCH || ret == -ESTALE)
+    ret = Calc(pfn, current, 1);
+
+  if (ret < 0)
+    return ret;
+
+  return current.Length == cks.Length &&
+         memcmp(current.Value, cks.Value, cks.Length) == 0;
+}
+
+XrdVERSIONINFO(XrdCksInit, RadosOssCks);
@@ -0,0 +1,63 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_CKS_HH__
+#define __RADOS_OSS_CKS_HH__
+
+#include <XrdCks/XrdCks.hh>
+#include <XrdCks/XrdCksData.hh>
+#include <XrdSys/XrdSysError.hh>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <vector>
+#include <radosfs/File.hh>
+
+#include "RadosOssChecksum.hh"
+
+// Checksum plugin (ofs.ckslib) serving the checksums stored by the OSS plugin
+// when the files are written; they are only computed by reading the file if
+// they are missing or out of date.
+class RadosOssCks : public XrdCks
+{
+public:
+  RadosOssCks(XrdSysError *eroute);
+  virtual ~RadosOssCks() {}
+
+  virtual int Calc(const char *pfn, XrdCksData &cks, int doSet=1);
+  virtual int Del(const char *pfn, XrdCksData &cks);
+  virtual int Get(const char *pfn, XrdCksData &cks);
+  virtual int Config(const char *token, char *line);
+  virtual int Init(const char *configFn, const char *defaultCalc=0);
+  virtual char *List(const char *pfn, char *buff, int blen, char sep=' ');
+  virtual const char *Name(int seqNum=0);
+  virtual int Size(const char *name=0);
+  virtual int Set(const char *pfn, XrdCksData &cks, int myTime=0);
+  virtual int Ver(const char *pfn, XrdCksData &cks);
+
+private:
+  int computeChecksums(radosfs::File &file,
+                       const std::vector<RadosOssChecksumType> &types,
+                       std::vector<uint32_t> &values, struct stat &statBuff);
+  static radosfs::File::OpenMode openMode(bool modifies);
+  static void setValue(XrdCksData &cks, uint32_t value,
+                       const struct stat &statBuff);
+};
+
+#endif /* __RADOS_OSS_CKS_HH__ */
@@ -0,0 +1,76 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <XrdOuc/XrdOucEnv.hh>
+
+#include "RadosOssCred.hh"
+#include "RadosOssDefines.hh"
+
+uid_t RadosOssCred::sAnonymousUid = DEFAULT_ANONYMOUS_UID;
+gid_t RadosOssCred::sAnonymousGid = DEFAULT_ANONYMOUS_GID;
+
+RadosOssCred::RadosOssCred()
+  : uid(sAnonymousUid),
+    gid(sAnonymousGid)
+{
+}
+
+RadosOssCred::RadosOssCred(XrdOucEnv *env)
+  : uid(sAnonymousUid),
+    gid(sAnonymousGid)
+{
+  if (env && env->Get("uid") && env->Get("gid"))
+  {
+    uid = env->GetInt("uid");
+    gid = env->GetInt("gid");
+  }
+}
+
+void
+RadosOssCred::setAnonymous(uid_t uid, gid_t gid)
+{
+  sAnonymousUid = uid;
+  sAnonymousGid = gid;
+}
+
+bool
+RadosOssCred::isRoot() const
+{
+  return uid == ROOT_UID;
+}
+
+// mode is a combination of R_OK, W_OK and X_OK
+bool
+RadosOssCred::canAccess(const struct stat &statBuff, int mode) const
+{
+  mode_t perms;
+
+  if (isRoot())
+    return true;
+
+  if (statBuff.st_uid == uid)
+    perms = statBuff.st_mode >> 6;
+  else if (statBuff.st_gid == gid)
+    perms = statBuff.st_mode >> 3;
+  else
+    perms = statBuff.st_mode;
+
+  return (perms & mode & 07) == (mode_t) mode;
+}
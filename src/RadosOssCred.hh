@@ -0,0 +1,52 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_CRED_HH__
+#define __RADOS_OSS_CRED_HH__
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+class XrdOucEnv;
+
+// Identity of the client behind a request. The radosfs::Filesystem is shared
+// by all threads and always runs as root, so permissions are checked against
+// this instead of the filesystem's ids.
+class RadosOssCred
+{
+public:
+  RadosOssCred();
+  RadosOssCred(XrdOucEnv *env);
+
+  bool isRoot(void) const;
+  bool canAccess(const struct stat &statBuff, int mode) const;
+
+  // The identity of the requests which do not say who the client is
+  static void setAnonymous(uid_t uid, gid_t gid);
+
+  uid_t uid;
+  gid_t gid;
+
+private:
+  static uid_t sAnonymousUid;
+  static gid_t sAnonymousGid;
+};
+
+#endif /* __RADOS_OSS_CRED_HH__ */
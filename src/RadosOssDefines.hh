@@ -23,12 +23,94 @@
 
 #define RADOS_CONFIG (RADOS_OSS_CONFIG_PREFIX ".config")
 #define RADOS_CONFIG_USER (RADOS_OSS_CONFIG_PREFIX ".user")
+#define RADOS_CONFIG_ANONYMOUS_UID (RADOS_OSS_CONFIG_PREFIX ".anonymous.uid")
+#define RADOS_CONFIG_ANONYMOUS_GID (RADOS_OSS_CONFIG_PREFIX ".anonymous.gid")
 #define RADOS_CONFIG_DEFAULT_STRIPESIZE (RADOS_OSS_CONFIG_PREFIX ".stripe")
 #define RADOS_CONFIG_DATA_POOLS (RADOS_OSS_CONFIG_PREFIX ".datapools")
 #define RADOS_CONFIG_MTD_POOLS (RADOS_OSS_CONFIG_PREFIX ".metadatapools")
+#define RADOS_CONFIG_POOLS_RELOAD (RADOS_OSS_CONFIG_PREFIX ".pools.reload")
+#define RADOS_CONFIG_METRICS_FILE (RADOS_OSS_CONFIG_PREFIX ".metrics.file")
+#define RADOS_CONFIG_METRICS_INTERVAL (RADOS_OSS_CONFIG_PREFIX ".metrics.interval")
+#define RADOS_CONFIG_TRACE_FILE (RADOS_OSS_CONFIG_PREFIX ".trace.file")
+#define RADOS_CONFIG_CHECKSUMS (RADOS_OSS_CONFIG_PREFIX ".checksums")
+#define RADOS_CONFIG_CLIENTS (RADOS_OSS_CONFIG_PREFIX ".clients")
+#define RADOS_CONFIG_CLIENTS_POLICY (RADOS_OSS_CONFIG_PREFIX ".clients.policy")
+#define RADOS_CONFIG_AIO_THREADS (RADOS_OSS_CONFIG_PREFIX ".aiothreads")
+#define RADOS_CONFIG_OP_THREADS (RADOS_OSS_CONFIG_PREFIX ".opthreads")
+#define RADOS_CONFIG_UNLINK_REAPERS (RADOS_OSS_CONFIG_PREFIX ".unlink.reapers")
+#define RADOS_CONFIG_DURABILITY_INTERVAL (RADOS_OSS_CONFIG_PREFIX ".durability.interval")
+#define RADOS_CONFIG_STATFS_INTERVAL (RADOS_OSS_CONFIG_PREFIX ".statfs.interval")
+#define RADOS_CONFIG_SCHED_MAX_IN_FLIGHT (RADOS_OSS_CONFIG_PREFIX ".sched.maxinflight")
+#define RADOS_CONFIG_SCHED_USERS (RADOS_OSS_CONFIG_PREFIX ".sched.users")
+#define RADOS_CONFIG_SCHED_POOLS (RADOS_OSS_CONFIG_PREFIX ".sched.pools")
+#define RADOS_CONFIG_READ_MAX_IN_FLIGHT (RADOS_OSS_CONFIG_PREFIX ".read.maxinflight")
+#define RADOS_CONFIG_READV_MAX_GAP (RADOS_OSS_CONFIG_PREFIX ".readv.maxgap")
+#define RADOS_CONFIG_READDIR_PAGE_SIZE (RADOS_OSS_CONFIG_PREFIX ".readdir.pagesize")
+#define RADOS_CONFIG_DIR_CACHE_SIZE (RADOS_OSS_CONFIG_PREFIX ".dircache.size")
+#define RADOS_CONFIG_DIR_CACHE_MEMORY (RADOS_OSS_CONFIG_PREFIX ".dircache.memory")
+#define RADOS_CONFIG_KNOWN_DIRS_SIZE (RADOS_OSS_CONFIG_PREFIX ".knowndirs.size")
+#define RADOS_CONFIG_STAT_CACHE_SIZE (RADOS_OSS_CONFIG_PREFIX ".statcache.size")
+#define RADOS_CONFIG_STAT_CACHE_TTL (RADOS_OSS_CONFIG_PREFIX ".statcache.ttl")
+#define RADOS_CONFIG_NEG_STAT_CACHE_SIZE (RADOS_OSS_CONFIG_PREFIX ".negstatcache.size")
+#define RADOS_CONFIG_NEG_STAT_CACHE_TTL (RADOS_OSS_CONFIG_PREFIX ".negstatcache.ttl")
+#define RADOS_CONFIG_READAHEAD_DEPTH (RADOS_OSS_CONFIG_PREFIX ".readahead.depth")
+#define RADOS_CONFIG_READAHEAD_BLOCK_SIZE (RADOS_OSS_CONFIG_PREFIX ".readahead.blocksize")
+#define RADOS_CONFIG_READAHEAD_HANDLE_MEM (RADOS_OSS_CONFIG_PREFIX ".readahead.handlemem")
+#define RADOS_CONFIG_READAHEAD_GLOBAL_MEM (RADOS_OSS_CONFIG_PREFIX ".readahead.globalmem")
+#define RADOS_CONFIG_WRITE_BEHIND (RADOS_OSS_CONFIG_PREFIX ".writebehind")
+#define RADOS_CONFIG_BLOCK_CACHE_SIZE (RADOS_OSS_CONFIG_PREFIX ".blockcache.size")
+#define RADOS_CONFIG_BLOCK_CACHE_BLOCK_SIZE (RADOS_OSS_CONFIG_PREFIX ".blockcache.blocksize")
+#define RADOS_CONFIG_WRITE_BEHIND_BUFFER_SIZE (RADOS_OSS_CONFIG_PREFIX ".writebehind.buffersize")
+#define RADOS_CONFIG_WRITE_BEHIND_MAX_IN_FLIGHT (RADOS_OSS_CONFIG_PREFIX ".writebehind.maxinflight")
 #define RADOS_OSS_CONFIG_PREFIX "radososs"
 #define DEFAULT_POOL_PREFIX "/"
 #define DEFAULT_POOL_FILE_SIZE 1000 // 1 GB
+#define DEFAULT_POOLS_RELOAD_INTERVAL 0 // s
+#define DEFAULT_METRICS_INTERVAL 60 // s
+#define DEFAULT_DURABILITY_INTERVAL 5 // s
+#define DEFAULT_UNLINK_REAPERS 4
+#define TRASH_DIR_NAME ".radososs-trash"
+#define TRASH_DIR_MODE 0700
+#define TRASH_RENAME_ATTEMPTS 8
+#define TRUNCATE_SWAP_MAX_COPY 4194304 // 4 MB
+// The stripe sizes accepted
+#define MIN_STRIPE_SIZE 4096
+#define MAX_STRIPE_SIZE 1073741824 // 1 GB
+#define DEFAULT_STATFS_INTERVAL 10 // s
 #define ROOT_UID 0
+#define DEFAULT_ANONYMOUS_UID ROOT_UID
+#define DEFAULT_ANONYMOUS_GID 0
+#define INDEX_NAME_KEY "name="
+#define DEFAULT_CLIENTS 1
+#define DEFAULT_AIO_THREADS 128
+#define DEFAULT_OP_THREADS 64
+#define DEFAULT_READ_MAX_IN_FLIGHT 8
+#define DEFAULT_READV_MAX_GAP 65536 // 64 KB
+#define DEFAULT_READDIR_PAGE_SIZE 1024
+#define DEFAULT_DIR_CACHE_SIZE 1024
+#define DEFAULT_DIR_CACHE_MEMORY 268435456 // 256 MB
+#define DEFAULT_KNOWN_DIRS_SIZE 100000
+#define DEFAULT_STAT_CACHE_SIZE 100000
+#define DEFAULT_STAT_CACHE_TTL 1000 // ms
+#define DEFAULT_NEG_STAT_CACHE_SIZE 100000
+#define DEFAULT_NEG_STAT_CACHE_TTL 500 // ms
+#define DEFAULT_READAHEAD_DEPTH 4
+#define DEFAULT_READAHEAD_BLOCK_SIZE 4194304 // 4 MB
+#define DEFAULT_READAHEAD_HANDLE_MEM 67108864 // 64 MB
+#define DEFAULT_READAHEAD_GLOBAL_MEM 1073741824 // 1 GB
+#define READAHEAD_MIN_SEQUENTIAL_READS 2
+#define DEFAULT_BLOCK_CACHE_SIZE 0
+#define DEFAULT_BLOCK_CACHE_BLOCK_SIZE 1048576 // 1 MB
+#define DEFAULT_WRITE_BEHIND_BUFFER_SIZE 16777216 // 16 MB
+#define DEFAULT_WRITE_BEHIND_MAX_IN_FLIGHT 4
+#define DIR_LOG_READ_CHUNK 4194304 // 4 MB
+#define DIR_LOG_TAIL_CHECK 64
+#define TRACE_BUFFER_RECORDS 1024 // 64 KB, per thread
+#define TRACE_MAX_PENDING_BUFFERS 1024
+#define CHECKSUM_XATTR_PREFIX "sys.radososs.checksum."
+#define CHECKSUM_READ_BLOCK_SIZE 4194304 // 4 MB
+#define PGIO_PAGE_SIZE 4096
+#define PGIO_BLOCK_SIZE 1048576 // 1 MB
+#define PGIO_READ_DEPTH 4
 
 #endif // __RADOS_OSS_DEFINES_HH__
@@ -21,108 +21,191 @@
 #include <cstdio>
 #include <assert.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <set>
 #include <XrdSys/XrdSysPlatform.hh>
 #include <XrdOuc/XrdOucEnv.hh>
 
 #include "RadosOssDir.hh"
 #include "RadosOssDefines.hh"
+#include "RadosOssHash.hh"
+#include "RadosOssMetrics.hh"
+#include "RadosOssReaper.hh"
 
-RadosOssDir::RadosOssDir(radosfs::Filesystem *radosFs,
-                         const XrdSysError &eroute)
-  : mRadosFs(radosFs),
+class RadosOssDirPageJob : public RadosOssJob
+{
+public:
+  RadosOssDirPageJob(RadosOssDir *dir, int firstIndex)
+    : mDir(dir),
+      mFirstIndex(firstIndex)
+  {}
+
+  virtual void run(void)
+  {
+    mDir->loadPage(mDir->mNextPage, mFirstIndex);
+    mDir->pageLoaded();
+  }
+
+private:
+  RadosOssDir *mDir;
+  int mFirstIndex;
+};
+
+RadosOssDir::RadosOssDir(RadosOss *oss, const XrdSysError &eroute)
+  : mRadosFs(0),
+    mOss(oss),
     mDir(0),
-    mStatRet(0)
+    mListing(0),
+    mStatRet(0),
+    mCond(0),
+    mPagePos(0),
+    mNextIndex(0),
+    mPrefetching(false),
+    mStarted(false),
+    mPathHash(0),
+    mTraceHandle(0)
 {
+  mPage.error = 0;
+  mPage.last = false;
 }
 
 RadosOssDir::~RadosOssDir()
 {
+  waitForPrefetch();
+
+  if (mListing)
+    mListing->unref();
+
   delete mDir;
 }
 
 int
 RadosOssDir::Opendir(const char *path, XrdOucEnv &env)
 {
-  uid_t uid = env.GetInt("uid");
-  gid_t gid = env.GetInt("gid");
+  RadosOssOpTimer timer(RADOS_OSS_OP_OPENDIR);
+  RadosOssCred cred(&env);
 
-  mRadosFs->setIds(uid, gid);
+  if (OssTrace.enabled())
+  {
+    mPathHash = radosOssPathHash(path);
+    mTraceHandle = OssTrace.newHandle();
+    timer.traceHandle(mPathHash, mTraceHandle);
+  }
 
+  mRadosFs = mOss->handleRadosFs(path);
   mDir = new radosfs::Dir(mRadosFs, path);
 
   if (!mDir->exists())
-    return -ENOENT;
+    return timer.done(-ENOENT);
 
   if (mDir->isFile())
-    return -ENOTDIR;
+    return timer.done(-ENOTDIR);
 
-  if (!mDir->isReadable())
-    return -EACCES;
+  if (mOss->checkAccess(cred, mDir->path(), R_OK) != 0)
+    return timer.done(-EACCES);
+
+  if (mOss->dirCache()->enabled())
+  {
+    rados_ioctx_t ioctx = mOss->metadataIoctx(mDir->path());
+    int ret;
 
-  mDir->refresh();
+    if (ioctx)
+      mListing = mOss->dirCache()->getListing(mDir->path(), ioctx, &ret);
+  }
+
+  // Without the directory cache, the names are taken once into a listing of
+  // this handle's own (radosfs can only look them up by index, walking its
+  // set of entries each time)
+  if (!mListing)
+  {
+    std::set<std::string> entries;
+    int ret;
 
-  return XrdOssOK;
+    mDir->refresh();
+    ret = mDir->entryList(entries);
+
+    if (ret != 0)
+      return timer.done(ret);
+
+    mListing = new RadosOssDirListing(0);
+    mListing->entries.assign(entries.begin(), entries.end());
+  }
+
+  return timer.done(XrdOssOK);
 }
 
 int
 RadosOssDir::Close(long long *retsz)
 {
-  return XrdOssOK;
+  RadosOssOpTimer timer(RADOS_OSS_OP_CLOSEDIR);
+  timer.traceHandle(mPathHash, mTraceHandle);
+  waitForPrefetch();
+
+  return timer.done(XrdOssOK);
 }
 
 int
 RadosOssDir::Readdir(char *buff, int blen)
 {
-  int ret;
-  std::string entry;
-
-  if (mEntryList.empty())
+  RadosOssOpTimer timer(RADOS_OSS_OP_READDIR);
+  timer.traceHandle(mPathHash, mTraceHandle);
+  // The first page is only requested here because StatRet is called after
+  // Opendir and decides whether the entries need to be stat'ed
+  if (!mStarted)
   {
-    ret = mDir->entryList(mEntryList);
-    mEntryListIt = mEntryList.begin();
+    mStarted = true;
+    prefetchNextPage();
   }
 
-  if (ret == 0 && mEntryListIt != mEntryList.end())
+  // A page may have no entries to list, if they were all hidden
+  while (mPagePos >= mPage.names.size())
   {
-    entry = *mEntryListIt;
-    ++mEntryListIt;
+    if (mPage.last)
+    {
+      buff[0] = '\0';
+      return timer.done(XrdOssOK);
+    }
+
+    waitForPrefetch();
+
+    mPage.names.swap(mNextPage.names);
+    mPage.stats.swap(mNextPage.stats);
+    mPage.error = mNextPage.error;
+    mPage.last = mNextPage.last;
+    mPagePos = 0;
+
+    if (mPage.error != 0)
+    {
+      mPage.last = true;
+      return timer.done(mPage.error);
+    }
+
+    if (!mPage.last)
+      prefetchNextPage();
   }
 
-  if (shouldStat())
-  {
-    if (mEntriesStatInfo.empty())
-      ret = statAllEntries();
-
-    if (ret != 0)
-      return ret;
+  const std::string &entry = mPage.names[mPagePos];
 
+  if (blen <= (int) entry.length())
+    return timer.done(-ENAMETOOLONG);
 
-    std::map<std::string, std::pair<int, struct stat> >::const_iterator it;
-    if ((it = mEntriesStatInfo.find(entry)) == mEntriesStatInfo.end())
-      return -ENOENT;
-
-    std::pair<int, struct stat> entryStat = (*it).second;
+  if (shouldStat())
+  {
+    const std::pair<int, struct stat> &entryStat = mPage.stats[mPagePos];
 
     if (entryStat.first != 0)
-      return entryStat.first;
+    {
+      mPagePos++;
+      return timer.done(entryStat.first);
+    }
 
     *mStatRet = entryStat.second;
-
-    ret = 0;
   }
 
-  if (ret != 0)
-    return ret;
-
-  if (blen <= entry.length())
-    return -ENAMETOOLONG;
-
-  if (entry != "")
-    ret = strlcpy(buff, entry.c_str(), entry.length() + 1);
-
-  buff[ret] = '\0';
+  strlcpy(buff, entry.c_str(), entry.length() + 1);
+  mPagePos++;
 
-  return XrdOssOK;
+  return timer.done(XrdOssOK);
 }
 
 int
@@ -132,33 +215,94 @@ RadosOssDir::StatRet(struct stat *buff)
   return 0;
 }
 
-int
-RadosOssDir::statAllEntries()
+void
+RadosOssDir::loadPage(DirPage &page, int firstIndex)
 {
-  int ret = 0;
+  size_t pageSize = mOss->readdirPageSize();
+
+  page.names.clear();
+  page.stats.clear();
+  page.error = 0;
+  page.last = false;
+
+  size_t i;
+
+  for (i = 0; i < pageSize; i++)
+  {
+    if (firstIndex + i >= mListing->entries.size())
+      break;
+
+    const std::string &name = mListing->entries[firstIndex + i];
+
+    if (!RadosOssReaper::isTrash(name))
+      page.names.push_back(name);
+  }
+
+  page.last = i < pageSize;
+
+  if (!shouldStat() || page.names.empty())
+    return;
 
-  if (mEntryList.empty())
-    ret = mDir->entryList(mEntryList);
+  std::vector<std::string> paths;
+  paths.reserve(page.names.size());
 
-  if (ret != 0)
-    return ret;
+  std::vector<std::string>::const_iterator it;
+  for (it = page.names.begin(); it != page.names.end(); ++it)
+    paths.push_back(mDir->path() + *it);
 
-  std::vector<std::string> entries;
-  entries.reserve(mEntryList.size());
+  std::vector<uint64_t> generations;
+  generations.reserve(paths.size());
 
-  std::set<std::string>::const_iterator it;
-  for (it = mEntryList.begin(); it != mEntryList.end(); ++it)
-    entries.push_back(mDir->path() + *it);
+  for (size_t i = 0; i < paths.size(); i++)
+    generations.push_back(mOss->statCache()->generation(paths[i]));
 
-  std::vector<std::pair<int, struct stat> > statInfo;
-  statInfo = mRadosFs->stat(entries);
+  std::vector<std::pair<int, struct stat> > stats = mRadosFs->stat(paths);
+  std::vector<std::string> names;
 
-  size_t i = 0;
-  std::set<std::string>::const_iterator sit;
-  for (sit = mEntryList.begin(); sit != mEntryList.end(); ++sit, ++i)
+  names.swap(page.names);
+
+  for (size_t i = 0; i < paths.size(); i++)
   {
-    mEntriesStatInfo[*sit] = statInfo[i];
+    // Removed since it was listed
+    if (stats[i].first == -ENOENT)
+      continue;
+
+    if (stats[i].first == 0)
+      mOss->statCache()->put(paths[i], stats[i].second, generations[i]);
+
+    page.names.push_back(names[i]);
+    page.stats.push_back(stats[i]);
   }
+}
+
+void
+RadosOssDir::prefetchNextPage()
+{
+  int firstIndex = mNextIndex;
+
+  mNextIndex += mOss->readdirPageSize();
 
-  return ret;
+  mCond.Lock();
+  mPrefetching = true;
+  mCond.UnLock();
+
+  mOss->opPool()->enqueue(new RadosOssDirPageJob(this, firstIndex));
+}
+
+void
+RadosOssDir::pageLoaded()
+{
+  mCond.Lock();
+  mPrefetching = false;
+  mCond.Broadcast();
+  mCond.UnLock();
+}
+
+void
+RadosOssDir::waitForPrefetch()
+{
+  mCond.Lock();
+  while (mPrefetching)
+    mCond.Wait();
+  mCond.UnLock();
 }
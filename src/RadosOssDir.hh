@@ -25,11 +25,24 @@
 #include <xrootd/XrdSys/XrdSysError.hh>
 #include <radosfs/Filesystem.hh>
 #include <radosfs/Dir.hh>
+#include <string>
+#include <vector>
 
+#include "RadosOss.hh"
+
+// Entries are listed in pages of a fixed number of names. While a page is
+// being returned, the following one (names and, if requested, their stat
+// info) is fetched in the background. The names of the whole directory are
+// still held in memory, in a listing of the handle's own or, when the
+// directory cache is enabled, in the one it shares among all the handles of
+// the same directory: the directory's log has to be read to its end to know
+// which entries remain.
+// What the pages bound is the stat info and the copies of the names kept by
+// each handle.
 class RadosOssDir : public XrdOssDF
 {
 public:
-  RadosOssDir(radosfs::Filesystem *radosFs, const XrdSysError &eroute);
+  RadosOssDir(RadosOss *oss, const XrdSysError &eroute);
   virtual ~RadosOssDir();
   virtual int Opendir(const char *, XrdOucEnv &);
   virtual int Readdir(char *buff, int blen);
@@ -37,15 +50,37 @@ public:
   virtual int StatRet(struct stat *buff);
 
 private:
+  struct DirPage
+  {
+    std::vector<std::string> names;
+    std::vector<std::pair<int, struct stat> > stats;
+    int error;
+    bool last;
+  };
+
+  friend class RadosOssDirPageJob;
+
   inline bool shouldStat() const { return mStatRet != 0; }
-  int statAllEntries();
+  void loadPage(DirPage &page, int firstIndex);
+  void prefetchNextPage(void);
+  void pageLoaded(void);
+  void waitForPrefetch(void);
 
   radosfs::Filesystem *mRadosFs;
+  RadosOss *mOss;
   radosfs::Dir *mDir;
+  RadosOssDirListing *mListing;
   struct stat *mStatRet;
-  std::set<std::string> mEntryList;
-  std::set<std::string>::const_iterator mEntryListIt;
-  std::map<std::string, std::pair<int, struct stat> > mEntriesStatInfo;
+  XrdSysCondVar mCond;
+  DirPage mPage;
+  DirPage mNextPage;
+  size_t mPagePos;
+  int mNextIndex;
+  bool mPrefetching;
+  bool mStarted;
+  // Identify the directory in the trace, if one is being written
+  uint64_t mPathHash;
+  uint64_t mTraceHandle;
 };
 
 #endif /* __RADOS_OSS_DIR_HH__ */
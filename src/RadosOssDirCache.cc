@@ -0,0 +1,199 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "RadosOssDirCache.hh"
+
+static std::string
+dirKey(const std::string &path)
+{
+  if (path.empty() || path[path.length() - 1] == '/')
+    return path;
+
+  return path + "/";
+}
+
+void
+RadosOssDirListing::ref()
+{
+  __sync_add_and_fetch(&mRefs, 1);
+}
+
+void
+RadosOssDirListing::unref()
+{
+  if (__sync_sub_and_fetch(&mRefs, 1) == 0)
+    delete this;
+}
+
+RadosOssDirCache::RadosOssDirCache()
+  : mMaxDirs(0),
+    mMaxMemory(0),
+    mMemory(0)
+{
+}
+
+RadosOssDirCache::~RadosOssDirCache()
+{
+  std::map<std::string, CachedDir *>::iterator it;
+  for (it = mDirs.begin(); it != mDirs.end(); it++)
+    deleteDir((*it).second);
+}
+
+RadosOssDirListing *
+RadosOssDirCache::getListing(const std::string &path, rados_ioctx_t ioctx,
+                             int *ret)
+{
+  RadosOssDirListing *listing = 0;
+  CachedDir *dir = acquire(dirKey(path), ioctx);
+
+  dir->mutex.Lock();
+
+  *ret = dir->info.update();
+
+  if (*ret == 0)
+  {
+    if (!dir->listing || dir->listing->version != dir->info.version())
+    {
+      RadosOssDirListing *newListing =
+          new RadosOssDirListing(dir->info.version());
+      newListing->entries = dir->info.entries();
+
+      if (dir->listing)
+        dir->listing->unref();
+
+      dir->listing = newListing;
+
+      // The listing is a copy of the entries
+      XrdSysMutexHelper lock(mMutex);
+
+      if (!dir->evicted)
+      {
+        mMemory -= dir->memory;
+        dir->memory = 2 * dir->info.memory();
+        mMemory += dir->memory;
+      }
+    }
+
+    listing = dir->listing;
+    listing->ref();
+  }
+
+  dir->mutex.UnLock();
+
+  release(dir);
+
+  return listing;
+}
+
+void
+RadosOssDirCache::invalidate(const std::string &path)
+{
+  if (!enabled())
+    return;
+
+  XrdSysMutexHelper lock(mMutex);
+
+  std::map<std::string, CachedDir *>::iterator it = mDirs.find(dirKey(path));
+
+  if (it != mDirs.end())
+    evict(it);
+}
+
+RadosOssDirCache::CachedDir *
+RadosOssDirCache::acquire(const std::string &path, rados_ioctx_t ioctx)
+{
+  CachedDir *dir;
+  XrdSysMutexHelper lock(mMutex);
+
+  std::map<std::string, CachedDir *>::iterator it = mDirs.find(path);
+
+  if (it != mDirs.end())
+  {
+    dir = (*it).second;
+    mOrder.erase(dir->order);
+  }
+  else
+  {
+    makeRoom(mMaxDirs - 1);
+
+    dir = new CachedDir(path, ioctx);
+    mDirs[path] = dir;
+  }
+
+  dir->order = mOrder.insert(mOrder.end(), path);
+  dir->users++;
+
+  return dir;
+}
+
+void
+RadosOssDirCache::release(CachedDir *dir)
+{
+  XrdSysMutexHelper lock(mMutex);
+
+  if (--dir->users == 0 && dir->evicted)
+    deleteDir(dir);
+  else
+    makeRoom(mMaxDirs);
+}
+
+// Drops the least recently listed directories not in use until there are
+// at most maxDirs and they fit in the maximum memory. Must be called with
+// the lock held.
+void
+RadosOssDirCache::makeRoom(size_t maxDirs)
+{
+  std::list<std::string>::iterator orderIt = mOrder.begin();
+
+  while ((mDirs.size() > maxDirs || mMemory > mMaxMemory) &&
+         orderIt != mOrder.end())
+  {
+    std::map<std::string, CachedDir *>::iterator oldest;
+    oldest = mDirs.find(*orderIt++);
+
+    if ((*oldest).second->users == 0)
+      evict(oldest);
+  }
+}
+
+void
+RadosOssDirCache::evict(std::map<std::string, CachedDir *>::iterator it)
+{
+  CachedDir *dir = (*it).second;
+
+  mOrder.erase(dir->order);
+  mDirs.erase(it);
+  mMemory -= dir->memory;
+
+  // Directories being updated are deleted by their last user
+  if (dir->users == 0)
+    deleteDir(dir);
+  else
+    dir->evicted = true;
+}
+
+void
+RadosOssDirCache::deleteDir(CachedDir *dir)
+{
+  if (dir->listing)
+    dir->listing->unref();
+
+  delete dir;
+}
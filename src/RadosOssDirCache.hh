@@ -0,0 +1,109 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_DIR_CACHE_HH__
+#define __RADOS_OSS_DIR_CACHE_HH__
+
+#include <XrdSys/XrdSysPthread.hh>
+#include <rados/librados.h>
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "DirInfo.hh"
+
+// Immutable snapshot of a directory's entries, shared by all the handles
+// listing that version of the directory.
+class RadosOssDirListing
+{
+public:
+  RadosOssDirListing(uint64_t listingVersion)
+    : version(listingVersion),
+      mRefs(1)
+  {}
+
+  void ref(void);
+  void unref(void);
+
+  std::vector<std::string> entries;
+  const uint64_t version;
+
+private:
+  int mRefs;
+};
+
+// Process-wide cache of directory contents. Each directory's DirInfo is
+// refreshed by reading only the tail of its log, so getting the listing of
+// a directory which did not change costs a single stat of its object. The
+// least recently listed directories are dropped when there are more than
+// the maximum number of them or when their entries take more than the
+// maximum memory.
+class RadosOssDirCache
+{
+public:
+  RadosOssDirCache();
+  ~RadosOssDirCache();
+
+  void setMaxDirs(size_t maxDirs) { mMaxDirs = maxDirs; }
+  void setMaxMemory(size_t maxMemory) { mMaxMemory = maxMemory; }
+  bool enabled(void) const { return mMaxDirs > 0; }
+
+  RadosOssDirListing * getListing(const std::string &path,
+                                  rados_ioctx_t ioctx, int *ret);
+  void invalidate(const std::string &path);
+
+private:
+  struct CachedDir
+  {
+    CachedDir(const std::string &path, rados_ioctx_t ioctx)
+      : info(path, ioctx),
+        listing(0),
+        users(0),
+        memory(0),
+        evicted(false)
+    {}
+
+    XrdSysMutex mutex;
+    DirInfo info;
+    RadosOssDirListing *listing;
+    std::list<std::string>::iterator order;
+    size_t users;
+    // The entries of the DirInfo and of the current listing
+    size_t memory;
+    bool evicted;
+  };
+
+  CachedDir * acquire(const std::string &path, rados_ioctx_t ioctx);
+  void release(CachedDir *dir);
+  void makeRoom(size_t maxDirs);
+  void evict(std::map<std::string, CachedDir *>::iterator it);
+  void deleteDir(CachedDir *dir);
+
+  XrdSysMutex mMutex;
+  std::map<std::string, CachedDir *> mDirs;
+  std::list<std::string> mOrder;
+  size_t mMaxDirs;
+  size_t mMaxMemory;
+  size_t mMemory;
+};
+
+#endif /* __RADOS_OSS_DIR_CACHE_HH__ */
@@ -21,27 +21,285 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <private/XrdOss/XrdOssError.hh>
 #include <XrdOuc/XrdOucEnv.hh>
 #include <stdio.h>
 #include <string>
+#include <algorithm>
 #include <radosfs/File.hh>
 
 #include "RadosOssFile.hh"
 #include "RadosOssDefines.hh"
+#include "RadosOssHash.hh"
+#include "RadosOssMetrics.hh"
 
-RadosOssFile::RadosOssFile(radosfs::Filesystem *radosFs,
-                           const XrdSysError &eroute)
-  : mRadosFs(radosFs),
+class RadosOssAioJob : public RadosOssJob
+{
+public:
+  RadosOssAioJob(RadosOssFile *file, XrdSfsAio *aiop, bool isWrite,
+                 bool pageChecksums=false, uint64_t opts=0)
+    : mFile(file),
+      mAiop(aiop),
+      mIsWrite(isWrite),
+      mPageChecksums(pageChecksums),
+      mOpts(opts),
+      mTimer(isWrite ? RADOS_OSS_OP_AIO_WRITE : RADOS_OSS_OP_AIO_READ, true)
+  {
+    mTimer.traceHandle(file->mPathHash, file->mTraceHandle,
+                       aiop->sfsAio.aio_offset, aiop->sfsAio.aio_nbytes);
+  }
+
+  virtual void run(void)
+  {
+    char *buff = (char *) mAiop->sfsAio.aio_buf;
+    off_t offset = mAiop->sfsAio.aio_offset;
+    size_t blen = mAiop->sfsAio.aio_nbytes;
+
+    // The scheduler, if any, already admitted the job, which is only timed
+    // as an aio operation
+    if (mIsWrite)
+    {
+      mAiop->Result = mTimer.done(mPageChecksums ?
+                                  mFile->pgWriteData(buff, offset, blen,
+                                                     csvec(), mOpts) :
+                                  mFile->writeData(buff, offset, blen));
+    }
+    else
+    {
+      mAiop->Result = mTimer.done(mPageChecksums ?
+                                  mFile->pgReadData(buff, offset, blen,
+                                                    csvec()) :
+                                  mFile->readData(buff, offset, blen));
+    }
+
+    if (mFile->mSchedUser)
+      mFile->mOss->scheduler()->release();
+
+    if (mIsWrite)
+      mAiop->doneWrite();
+    else
+      mAiop->doneRead();
+
+    mFile->mAioOps.done();
+  }
+
+private:
+  uint32_t * csvec(void)
+  {
+#ifdef RADOS_OSS_HAVE_PGIO
+    return mAiop->cksVec;
+#else
+    return 0;
+#endif
+  }
+
+  RadosOssFile *mFile;
+  XrdSfsAio *mAiop;
+  bool mIsWrite;
+  bool mPageChecksums;
+  uint64_t mOpts;
+  // The job lives from the request until its completion, queueing included
+  RadosOssOpTimer mTimer;
+};
+
+struct PgReadBlock
+{
+  char *data;
+  off_t offset;
+  size_t length;
+  ssize_t result;
+  bool ready;
+};
+
+// Reads one block of a pgRead straight into the caller's buffer.
+class RadosOssPgReadJob : public RadosOssJob
+{
+public:
+  RadosOssPgReadJob(RadosOssFileReader *reader, PgReadBlock *block,
+                    XrdSysCondVar *cond)
+    : mReader(reader),
+      mBlock(block),
+      mCond(cond)
+  {}
+
+  virtual void run(void)
+  {
+    ssize_t ret = mReader->readDirect(mBlock->data, mBlock->offset,
+                                      mBlock->length);
+
+    mCond->Lock();
+    mBlock->result = ret;
+    mBlock->ready = true;
+    mCond->Broadcast();
+    mCond->UnLock();
+  }
+
+private:
+  RadosOssFileReader *mReader;
+  PgReadBlock *mBlock;
+  XrdSysCondVar *mCond;
+};
+
+// The part of a segment which lies in one stripe object
+struct ReadVPiece
+{
+  int segment;
+  off_t offset;
+  size_t length;
+};
+
+struct ReadVExtent
+{
+  off_t offset;
+  size_t length;
+  std::vector<ReadVPiece> pieces;
+};
+
+// Reads all the merged extents that fall into the same stripe object and
+// scatters them into the segments' buffers.
+class RadosOssReadVJob : public RadosOssJob
+{
+public:
+  RadosOssReadVJob(RadosOssFileReader *reader, XrdOucIOVec *readV,
+                   std::vector<ReadVExtent> *extents, ssize_t *result,
+                   RadosOssOpCounter *counter)
+    : mReader(reader),
+      mReadV(readV),
+      mExtents(extents),
+      mResult(result),
+      mCounter(counter)
+  {}
+
+  virtual void run(void)
+  {
+    *mResult = 0;
+
+    std::vector<ReadVExtent>::const_iterator it;
+    for (it = mExtents->begin(); it != mExtents->end() && *mResult == 0; it++)
+      *mResult = readExtent(*it);
+
+    mCounter->done();
+  }
+
+private:
+  ssize_t readExtent(const ReadVExtent &extent)
+  {
+    ssize_t ret;
+
+    // A lone piece is read straight into the client's buffer
+    if (extent.pieces.size() == 1)
+    {
+      const ReadVPiece &piece = extent.pieces[0];
+
+      ret = mReader->readDirect(pieceData(piece), piece.offset, piece.length);
+
+      if (ret < 0)
+        return ret;
+
+      return ret == (ssize_t) piece.length ? 0 : -ESPIPE;
+    }
+
+    std::vector<char> buff(extent.length);
+    ret = mReader->readDirect(&buff[0], extent.offset, extent.length);
+
+    if (ret < 0)
+      return ret;
+
+    std::vector<ReadVPiece>::const_iterator it;
+    for (it = extent.pieces.begin(); it != extent.pieces.end(); it++)
+    {
+      off_t pieceStart = (*it).offset - extent.offset;
+
+      if (pieceStart + (off_t) (*it).length > ret)
+        return -ESPIPE;
+
+      memcpy(pieceData(*it), &buff[pieceStart], (*it).length);
+    }
+
+    return 0;
+  }
+
+  char * pieceData(const ReadVPiece &piece) const
+  {
+    const XrdOucIOVec &segment = mReadV[piece.segment];
+
+    return segment.data + (piece.offset - segment.offset);
+  }
+
+  RadosOssFileReader *mReader;
+  XrdOucIOVec *mReadV;
+  std::vector<ReadVExtent> *mExtents;
+  ssize_t *mResult;
+  RadosOssOpCounter *mCounter;
+};
+
+class ReadVOffsetCompare
+{
+public:
+  ReadVOffsetCompare(const XrdOucIOVec *readV) : mReadV(readV) {}
+
+  bool operator()(int index1, int index2) const
+  {
+    return mReadV[index1].offset < mReadV[index2].offset;
+  }
+
+private:
+  const XrdOucIOVec *mReadV;
+};
+
+// The I/O is shared among the users named in the tidents (user.pid:fd@host)
+static std::string
+tidentUser(const char *tident)
+{
+  std::string user(tident ? tident : "");
+
+  return user.substr(0, user.find('.'));
+}
+
+RadosOssFile::RadosOssFile(RadosOss *oss, const XrdSysError &eroute,
+                           const char *tident)
+  : mRadosFs(0),
+    mOss(oss),
     mFile(0),
+    mReader(0),
+    mReadahead(0),
+    mWriteBehind(0),
+    mChecksums(0),
+    mWritable(false),
+    mDirty(false),
+    mCacheWriter(false),
+    mOpenRegistered(false),
+    mDurability(RADOS_OSS_DURABILITY_CLOSE),
     mObjectName(0),
-    mEroute(eroute)
+    mEroute(eroute),
+    mStripeSize(0),
+    mSchedUser(0),
+    mSchedPool(0),
+    mPathHash(0),
+    mTraceHandle(0)
 {
   fd = -1;
+
+  if (mOss->scheduler()->enabled())
+    mSchedUser = mOss->scheduler()->user(tidentUser(tident));
 }
 
 RadosOssFile::~RadosOssFile()
 {
+  mAioOps.waitForAll();
+  delete mReadahead;
+  delete mWriteBehind;
+  delete mChecksums;
+
+  // Once the data has landed, the file can be cached again
+  if (mCacheWriter)
+    mOss->blockCache()->removeWriter(mObjectName);
+
+  if (mOpenRegistered)
+    mOss->removeOpenFile(mObjectName);
+
+  delete mReader;
   delete mFile;
   free(mObjectName);
   mObjectName = 0;
@@ -50,65 +308,786 @@ RadosOssFile::~RadosOssFile()
 int
 RadosOssFile::Close(long long *retsz)
 {
-  Fsync();
+  RadosOssOpTimer timer(RADOS_OSS_OP_CLOSE);
+  timer.traceHandle(mPathHash, mTraceHandle);
+  mAioOps.waitForAll();
 
-  return XrdOssOK;
+  int ret = 0;
+
+  // The checksums are stored with the size of the file once synced, so a
+  // handle computing them cannot leave the sync to the flusher
+  if (mDirty && mDurability != RADOS_OSS_DURABILITY_CLOSE &&
+      !(mChecksums && mChecksums->valid()))
+  {
+    // The prefetched blocks use the file which is handed over
+    if (mReadahead)
+      mReadahead->invalidate();
+
+    mOss->flusher()->add(mObjectName, mFile, mWriteBehind, mCacheWriter,
+                         mDurability == RADOS_OSS_DURABILITY_ASYNC);
+    mFile = 0;
+    mWriteBehind = 0;
+    mDirty = false;
+    mCacheWriter = false;
+  }
+  else
+  {
+    ret = sync();
+  }
+
+  if (mChecksums && mFile)
+    storeChecksums(ret == 0);
+
+  if (mWritable)
+    mOss->statCache()->invalidate(mObjectName);
+
+  return timer.done(ret);
 }
 
 int
 RadosOssFile::Open(const char *path, int flags, mode_t mode, XrdOucEnv &env)
 {
+  RadosOssOpTimer timer(RADOS_OSS_OP_OPEN);
   int ret = 0;
+  int accessMode = R_OK;
+  RadosOssCred cred(&env);
   mObjectName = strdup(path);
+
+  if (OssTrace.enabled())
+  {
+    mPathHash = radosOssPathHash(path);
+    mTraceHandle = OssTrace.newHandle();
+    timer.traceHandle(mPathHash, mTraceHandle, 0, mode, flags);
+  }
+
+  mUid = cred.uid;
+  mGid = cred.gid;
+
+  // Reports the failure to sync the file after a previous handle closed it
+  ret = mOss->flusher()->flushPath(path);
+
+  if (ret != 0)
+    return timer.done(ret);
+
   radosfs::File::OpenMode openMode = radosfs::File::MODE_READ;
 
   if (flags & O_RDWR)
+  {
     openMode = (radosfs::File::OpenMode)
         (radosfs::File::MODE_WRITE | radosfs::File::MODE_READ);
+    accessMode = R_OK | W_OK;
+  }
   else if (flags & O_WRONLY)
+  {
     openMode = (radosfs::File::OpenMode) radosfs::File::MODE_WRITE;
+    accessMode = W_OK;
+  }
 
+  if (flags & O_TRUNC)
+    accessMode |= W_OK;
+
+  mRadosFs = mOss->handleRadosFs(path);
   mFile = new radosfs::File(mRadosFs, path, openMode);
 
+  bool created = false;
+  size_t stripeSize = 0;
+
   if (flags & O_CREAT)
-    ret = mFile->create(-1, std::string(""), env.Get("rfs.stripe") ? atoi(env.Get("rfs.stripe")) : 0 );
+  {
+    ret = RadosOss::requestedStripeSize(env, stripeSize);
 
-  if (flags & O_TRUNC)
-    ret = mFile->truncate(0);
+    if (ret == 0)
+      ret = mOss->checkParentAccess(cred, path, false);
 
-  return ret;
+    if (ret != 0)
+      return timer.done(ret);
+
+    ret = mFile->create(-1, std::string(""), stripeSize);
+    created = ret == 0;
+
+    // RadosFS creates files owned by root, so one which cannot be given to
+    // the user is removed rather than left behind
+    if (ret == 0 && !cred.isRoot())
+    {
+      ret = mFile->chown(mUid, mGid);
+
+      if (ret != 0)
+        mFile->remove();
+    }
+    // Without O_EXCL an existing file is opened (and truncated) as if
+    // O_CREAT was not given, so the user needs the rights to do that
+    else if (ret == -EEXIST && !(flags & O_EXCL))
+      ret = mOss->checkAccess(cred, path, accessMode);
+  }
+  else
+  {
+    ret = mOss->checkAccess(cred, path, accessMode);
+  }
+
+  // The truncation may replace the file by a new one, so the handle is
+  // instanced again (a file just created is empty already)
+  if (ret == 0 && (flags & O_TRUNC) && !created)
+  {
+    ret = mOss->truncatePath(path, 0);
+    delete mFile;
+    mFile = new radosfs::File(mRadosFs, path, openMode);
+  }
+
+  if (flags & (O_CREAT | O_TRUNC))
+    mOss->invalidateStat(path);
+
+  if (ret != 0)
+    return timer.done(ret);
+
+  // The reads and writes are split and aligned to the stripe objects.
+  // RadosFS does not tell the stripe size of an existing file (its block
+  // size is a fixed value), so those use the filesystem's one.
+  if (!created)
+    stripeSize = 0;
+
+  mStripeSize = stripeSize > 0 ? stripeSize : mRadosFs->fileChunkSize();
+  mWritable = (openMode & radosfs::File::MODE_WRITE) != 0;
+
+  if (mWritable || mSchedUser)
+  {
+    RadosOssPool pool;
+
+    if (mOss->getPoolFromPath(path, pool))
+    {
+      if (mWritable)
+        mDurability = pool.durability;
+
+      if (mSchedUser)
+        mSchedPool = mOss->scheduler()->pool(pool.name);
+    }
+  }
+  mReader = new RadosOssFileReader(mFile, mStripeSize, mOss->opPool(),
+                                   mOss->readMaxInFlight());
+
+  // Blocks are only shared by handles which read the file; any write to it
+  // in this server stops the caching until all its writers close
+  if (mOss->blockCache()->enabled())
+  {
+    struct stat statBuff;
+
+    if (mWritable)
+    {
+      mOss->blockCache()->addWriter(path);
+      mCacheWriter = true;
+    }
+    else if (mOss->statPath(path, &statBuff) == 0)
+    {
+      mReader->useCache(mOss->blockCache(), path, statBuff);
+    }
+  }
+
+  // Even without read-ahead (depth 0) the blocks serve the preread hints
+  if (openMode & radosfs::File::MODE_READ)
+    mReadahead = new RadosOssReadahead(mReader, mStripeSize,
+                                       mOss->readaheadConf(), mOss->opPool(),
+                                       mOss->readaheadBudget());
+
+  if (mWritable && mOss->writeBehindConf().enabled)
+    mWriteBehind = new RadosOssWriteBehind(mFile, mStripeSize,
+                                           mOss->writeBehindConf(),
+                                           mOss->opPool());
+
+  if (ret == 0 && mWritable && !mOss->checksums().empty())
+  {
+    // The checksums can only be computed while writing if the file starts
+    // empty, otherwise they are computed when queried
+    bool fromStart = (flags & (O_CREAT | O_TRUNC)) != 0;
+
+    if (!fromStart)
+    {
+      struct stat statBuff;
+      fromStart = mOss->statPath(path, &statBuff) == 0 &&
+                  statBuff.st_size == 0;
+    }
+
+    mChecksums = new RadosOssWriteChecksums(mOss->checksums(), fromStart);
+  }
+
+  if (ret == 0)
+  {
+    mOss->addOpenFile(path);
+    mOpenRegistered = true;
+  }
+
+  return timer.done(ret);
 }
 
 ssize_t
 RadosOssFile::Read(off_t offset, size_t blen)
 {
-  if (fd < 0)
-    return (ssize_t)-XRDOSS_E8004;
+  RadosOssOpTimer timer(RADOS_OSS_OP_PREREAD);
+  timer.traceHandle(mPathHash, mTraceHandle, offset, blen);
 
-  return 0;
+  if (!mFile)
+    return timer.done(-XRDOSS_E8004);
+
+  // This is only a hint: the range is fetched in the background so the reads
+  // which follow are served from memory. Buffered writes have not landed yet
+  // so the hint is ignored rather than fetching stale data.
+  if (mReadahead && !(mWriteBehind && mWriteBehind->hasPendingData()))
+    mReadahead->prefetch(offset, blen);
+
+  return timer.done(0);
 }
 
 ssize_t
 RadosOssFile::Read(void *buff, off_t offset, size_t blen)
 {
-  return mFile->read((char *) buff, offset, blen);
+  RadosOssSchedSlot slot(mOss->scheduler(), mSchedUser, mSchedPool, blen);
+
+  return doRead(buff, offset, blen);
+}
+
+ssize_t
+RadosOssFile::doRead(void *buff, off_t offset, size_t blen)
+{
+  RadosOssOpTimer timer(RADOS_OSS_OP_READ, true);
+  timer.traceHandle(mPathHash, mTraceHandle, offset, blen);
+
+  return timer.done(readData((char *) buff, offset, blen));
+}
+
+ssize_t
+RadosOssFile::readData(char *buff, off_t offset, size_t blen)
+{
+  int ret = flushWriteBehind();
+
+  if (ret != 0)
+    return ret;
+
+  if (mReadahead)
+    return mReadahead->read(buff, offset, blen);
+
+  return mReader->read(buff, offset, blen);
+}
+
+int
+RadosOssFile::Read(XrdSfsAio *aiop)
+{
+  mAioOps.add();
+  enqueueAio(new RadosOssAioJob(this, aiop, false), aiop->sfsAio.aio_nbytes);
+
+  return XrdOssOK;
+}
+
+// Jobs wait for their turn before taking one of the I/O threads, otherwise
+// the requests of a single user could fill them all
+void
+RadosOssFile::enqueueAio(RadosOssJob *job, size_t bytes)
+{
+  if (mSchedUser)
+    mOss->scheduler()->submit(mSchedUser, mSchedPool, bytes, job,
+                              mOss->ioPool());
+  else
+    mOss->ioPool()->enqueue(job);
+}
+
+ssize_t
+RadosOssFile::ReadV(XrdOucIOVec *readV, int n)
+{
+  RadosOssOpTimer timer(RADOS_OSS_OP_READV, true);
+  ssize_t totalBytes = 0;
+  std::vector<int> order(n);
+
+  for (int i = 0; i < n; i++)
+  {
+    order[i] = i;
+    totalBytes += readV[i].size;
+  }
+
+  timer.traceHandle(mPathHash, mTraceHandle, 0, totalBytes, n);
+  timer.traceSegments(readV, n);
+
+  RadosOssSchedSlot slot(mOss->scheduler(), mSchedUser, mSchedPool,
+                         totalBytes);
+
+  int ret = flushWriteBehind();
+
+  if (ret != 0)
+    return timer.done(ret);
+
+  std::sort(order.begin(), order.end(), ReadVOffsetCompare(readV));
+
+  // Split the segments at the stripe objects' boundaries, merge the pieces
+  // that are close to each other into extents and group the extents per
+  // stripe object, so each object gets its own job
+  std::vector<std::vector<ReadVExtent> > objectExtents;
+  off_t currentStripe = -1;
+  size_t maxGap = mOss->readVMaxGap();
+
+  for (int i = 0; i < n; i++)
+  {
+    const XrdOucIOVec &segment = readV[order[i]];
+    off_t segmentEnd = segment.offset + segment.size;
+    ReadVPiece piece;
+
+    piece.segment = order[i];
+
+    for (piece.offset = segment.offset; piece.offset < segmentEnd;
+         piece.offset += piece.length)
+    {
+      off_t stripe = piece.offset / mStripeSize;
+      off_t pieceEnd = std::min(segmentEnd, (stripe + 1) * (off_t) mStripeSize);
+
+      piece.length = pieceEnd - piece.offset;
+
+      if (stripe != currentStripe)
+      {
+        objectExtents.push_back(std::vector<ReadVExtent>());
+        currentStripe = stripe;
+      }
+
+      std::vector<ReadVExtent> &extents = objectExtents.back();
+
+      if (!extents.empty())
+      {
+        ReadVExtent &extent = extents.back();
+        off_t extentEnd = extent.offset + extent.length;
+
+        if (piece.offset <= extentEnd + (off_t) maxGap)
+        {
+          if (pieceEnd > extentEnd)
+            extent.length = pieceEnd - extent.offset;
+
+          extent.pieces.push_back(piece);
+          continue;
+        }
+      }
+
+      ReadVExtent extent;
+      extent.offset = piece.offset;
+      extent.length = piece.length;
+      extent.pieces.push_back(piece);
+      extents.push_back(extent);
+    }
+  }
+
+  std::vector<ssize_t> results(objectExtents.size(), 0);
+  RadosOssOpCounter counter;
+
+  for (size_t i = 0; i < objectExtents.size(); i++)
+  {
+    counter.add();
+    mOss->opPool()->enqueue(new RadosOssReadVJob(mReader, readV,
+                                                 &objectExtents[i],
+                                                 &results[i], &counter));
+  }
+
+  counter.waitForAll();
+
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    if (results[i] != 0)
+      return timer.done(results[i]);
+  }
+
+  return timer.done(totalBytes);
+}
+
+int
+RadosOssFile::flushWriteBehind()
+{
+  // Buffered writes need to land before they can be read back
+  if (mWriteBehind && mWriteBehind->hasPendingData())
+    return mWriteBehind->sync();
+
+  return 0;
+}
+
+int
+RadosOssFile::sync()
+{
+  int ret = 0;
+
+  // Nothing to sync if the handle did not write since the last time
+  if (!mWritable || !__sync_bool_compare_and_swap(&mDirty, true, false))
+    return XrdOssOK;
+
+  RadosOssOpTimer timer(RADOS_OSS_OP_RADOS_SYNC);
+
+  if (mWriteBehind)
+    ret = mWriteBehind->sync();
+
+  if (ret == 0)
+    ret = mFile->sync();
+
+  // To be retried by the next sync
+  if (ret != 0)
+    mDirty = true;
+
+  return timer.done(ret);
+}
+
+int
+RadosOssFile::Fsync()
+{
+  RadosOssOpTimer timer(RADOS_OSS_OP_FSYNC);
+  timer.traceHandle(mPathHash, mTraceHandle);
+
+  return timer.done(sync());
+}
+
+void
+RadosOssFile::storeChecksums(bool dataSynced)
+{
+  if (!dataSynced)
+  {
+    if (mChecksums->invalidate())
+      removeChecksums();
+
+    return;
+  }
+
+  if (!mChecksums->valid())
+    return;
+
+  // Stored with the size and mtime the file has now, so they are discarded
+  // if the file is modified afterwards
+  struct stat statBuff;
+  if (mFile->stat(&statBuff) != 0)
+    return;
+
+  // Data written past what this handle wrote (e.g. by another handle, or
+  // if the file was not really empty when opened) is not in the checksums
+  if (statBuff.st_size != mChecksums->length())
+  {
+    if (mChecksums->invalidate())
+      removeChecksums();
+
+    return;
+  }
+
+  const std::vector<RadosOssChecksumType> &types = mChecksums->types();
+  for (size_t i = 0; i < types.size(); i++)
+  {
+    int ret = RadosOssChecksum::store(*mFile, types[i], mChecksums->value(i),
+                                      statBuff);
+
+    if (ret != 0)
+      mEroute.Emsg("storeChecksums", -ret, "store checksum of", mObjectName);
+  }
+}
+
+void
+RadosOssFile::removeChecksums()
+{
+  const std::vector<RadosOssChecksumType> &types = mChecksums->types();
+
+  for (size_t i = 0; i < types.size(); i++)
+    RadosOssChecksum::remove(*mFile, types[i]);
 }
 
 int
 RadosOssFile::Fstat(struct stat *buff)
 {
-  return mRadosFs->stat(mObjectName, buff);
+  RadosOssOpTimer timer(RADOS_OSS_OP_FSTAT);
+  timer.traceHandle(mPathHash, mTraceHandle);
+  int ret = mOss->flusher()->flushPath(mObjectName);
+
+  if (ret != 0)
+    return timer.done(ret);
+
+  return timer.done(mOss->statPath(mObjectName, buff));
 }
 
 ssize_t
 RadosOssFile::Write(const void *buff, off_t offset, size_t blen)
 {
-  int ret = mFile->write((char *) buff, offset, blen);
+  RadosOssSchedSlot slot(mOss->scheduler(), mSchedUser, mSchedPool, blen);
+
+  return doWrite(buff, offset, blen);
+}
+
+ssize_t
+RadosOssFile::doWrite(const void *buff, off_t offset, size_t blen)
+{
+  RadosOssOpTimer timer(RADOS_OSS_OP_WRITE, true);
+  timer.traceHandle(mPathHash, mTraceHandle, offset, blen);
+
+  return timer.done(writeData((const char *) buff, offset, blen));
+}
+
+ssize_t
+RadosOssFile::writeData(const char *buff, off_t offset, size_t blen)
+{
+  if (mReadahead)
+    mReadahead->invalidate();
+
+  mDirty = true;
+  mOss->statCache()->invalidate(mObjectName);
+
+  // Any checksum stored for the file is removed as soon as it gets a write
+  // that cannot be added to the ones being computed
+  if (mChecksums && mChecksums->update(buff, offset, blen))
+    removeChecksums();
+
+  ssize_t ret;
+
+  if (mWriteBehind)
+  {
+    ret = mWriteBehind->write(buff, offset, blen);
+  }
+  else
+  {
+    RadosOssOpTimer radosTimer(RADOS_OSS_OP_RADOS_WRITE, true);
+    ret = radosTimer.done(mFile->write((char *) buff, offset, blen));
+
+    // The libradosfs file write returns 0 if it succeeds but the XRootD OSS
+    // Write needs to return the number of bytes instead
+    if (ret == 0)
+      ret = blen;
+  }
+
+  if (ret < 0 && mChecksums && mChecksums->invalidate())
+    removeChecksums();
+
+  return ret;
+}
+
+int
+RadosOssFile::Write(XrdSfsAio *aiop)
+{
+  mAioOps.add();
+  enqueueAio(new RadosOssAioJob(this, aiop, true), aiop->sfsAio.aio_nbytes);
+
+  return XrdOssOK;
+}
+
+// Index in the checksums' vector of the page holding pos, for an operation
+// starting at start
+static size_t
+pageIndex(off_t start, off_t pos)
+{
+  return pos / PGIO_PAGE_SIZE - start / PGIO_PAGE_SIZE;
+}
+
+ssize_t
+RadosOssFile::pgRead(void *buffer, off_t offset, size_t rdlen,
+                     uint32_t *csvec, uint64_t opts)
+{
+  RadosOssSchedSlot slot(mOss->scheduler(), mSchedUser, mSchedPool, rdlen);
+
+  return doPgRead(buffer, offset, rdlen, csvec, opts);
+}
+
+ssize_t
+RadosOssFile::doPgRead(void *buffer, off_t offset, size_t rdlen,
+                       uint32_t *csvec, uint64_t opts)
+{
+  RadosOssOpTimer timer(RADOS_OSS_OP_PGREAD, true);
+  timer.traceHandle(mPathHash, mTraceHandle, offset, rdlen);
+
+  // There are no stored page checksums to verify the data against, so the
+  // options make no difference
+  return timer.done(pgReadData((char *) buffer, offset, rdlen, csvec));
+}
+
+ssize_t
+RadosOssFile::pgReadData(char *buff, off_t offset, size_t rdlen,
+                         uint32_t *csvec)
+{
+  ssize_t ret;
+
+  if (rdlen <= PGIO_BLOCK_SIZE)
+  {
+    ret = readData(buff, offset, rdlen);
+
+    if (ret > 0 && csvec)
+      RadosOssChecksum::pageChecksums(buff, offset, ret, csvec);
+
+    return ret;
+  }
+
+  ret = flushWriteBehind();
 
-  // The libradosfs file write returns 0 if it succeeds but the XRootD OSS Write
-  // needs to return the number of bytes instead
   if (ret == 0)
-    ret = blen;
+    ret = readPipelined(buff, offset, rdlen, csvec);
+
+  return ret;
+}
+
+// Reads the data in blocks (never spanning two stripe objects), a few of them
+// at a time, and checksums the pages of each block while the following ones
+// are being read.
+ssize_t
+RadosOssFile::readPipelined(char *buff, off_t offset, size_t blen,
+                            uint32_t *csvec)
+{
+  std::vector<PgReadBlock> blocks;
+  XrdSysCondVar cond(0);
+  off_t end = offset + blen;
+  size_t next = 0;
+  size_t checked = 0;
+  ssize_t ret = 0;
+  bool done = false;
+
+  for (off_t pos = offset; pos < end; pos += blocks.back().length)
+  {
+    off_t stripeEnd = pos - pos % mStripeSize + mStripeSize;
+    off_t blockEnd = std::min(std::min(end, stripeEnd),
+                              pos + (off_t) PGIO_BLOCK_SIZE);
+    PgReadBlock block;
+
+    block.data = buff + (pos - offset);
+    block.offset = pos;
+    block.length = blockEnd - pos;
+    block.result = 0;
+    block.ready = false;
+    blocks.push_back(block);
+  }
+
+  for (; next < blocks.size() && next < PGIO_READ_DEPTH; next++)
+    mOss->opPool()->enqueue(new RadosOssPgReadJob(mReader, &blocks[next],
+                                                  &cond));
+
+  cond.Lock();
+
+  // Once done (error or end of file) this only waits for the blocks in flight
+  for (size_t i = 0; i < next; i++)
+  {
+    PgReadBlock &block = blocks[i];
+
+    while (!block.ready)
+      cond.Wait();
+
+    if (done)
+      continue;
+
+    if (block.result < 0)
+    {
+      ret = block.result;
+      done = true;
+      continue;
+    }
+
+    ret += block.result;
+    done = block.result < (ssize_t) block.length || i == blocks.size() - 1;
+
+    cond.UnLock();
+
+    if (!done && next < blocks.size())
+    {
+      mOss->opPool()->enqueue(new RadosOssPgReadJob(mReader, &blocks[next],
+                                                    &cond));
+      next++;
+    }
+
+    if (csvec)
+    {
+      // A page that continues in the next block waits for it
+      size_t checkedEnd = ret;
+
+      if (!done)
+        checkedEnd -= (offset + ret) % PGIO_PAGE_SIZE;
+
+      if (checkedEnd > checked)
+      {
+        RadosOssChecksum::pageChecksums(buff + checked, offset + checked,
+                                        checkedEnd - checked,
+                                        csvec + pageIndex(offset,
+                                                          offset + checked));
+        checked = checkedEnd;
+      }
+    }
+
+    cond.Lock();
+  }
+
+  cond.UnLock();
 
   return ret;
 }
+
+ssize_t
+RadosOssFile::pgWrite(void *buffer, off_t offset, size_t wrlen,
+                      uint32_t *csvec, uint64_t opts)
+{
+  RadosOssSchedSlot slot(mOss->scheduler(), mSchedUser, mSchedPool, wrlen);
+
+  return doPgWrite(buffer, offset, wrlen, csvec, opts);
+}
+
+ssize_t
+RadosOssFile::doPgWrite(void *buffer, off_t offset, size_t wrlen,
+                        uint32_t *csvec, uint64_t opts)
+{
+  RadosOssOpTimer timer(RADOS_OSS_OP_PGWRITE, true);
+  timer.traceHandle(mPathHash, mTraceHandle, offset, wrlen);
+
+  return timer.done(pgWriteData((const char *) buffer, offset, wrlen, csvec,
+                                opts));
+}
+
+ssize_t
+RadosOssFile::pgWriteData(const char *buff, off_t offset, size_t wrlen,
+                          uint32_t *csvec, uint64_t opts)
+{
+  size_t written = 0;
+
+  // With write-behind the data is handed over in blocks, so the pages of a
+  // block are checked while the previous ones are written in the background
+  size_t blockSize = mWriteBehind ? PGIO_BLOCK_SIZE : wrlen;
+
+  while (written < wrlen)
+  {
+    off_t pos = offset + written;
+    size_t length = std::min(wrlen - written, blockSize);
+
+    // Blocks end at a page boundary so no page is split between two of them
+    if (written + length < wrlen)
+      length -= (pos + length) % PGIO_PAGE_SIZE;
+
+    if (csvec)
+    {
+      uint32_t *pageCsvec = csvec + pageIndex(offset, pos);
+
+      if (opts & Verify)
+      {
+        if (!RadosOssChecksum::verifyPageChecksums(buff + written, pos, length,
+                                                   pageCsvec))
+          return -EDOM;
+      }
+      else if (opts & doCalc)
+      {
+        RadosOssChecksum::pageChecksums(buff + written, pos, length,
+                                        pageCsvec);
+      }
+    }
+
+    ssize_t ret = writeData(buff + written, pos, length);
+
+    if (ret < 0)
+      return ret;
+
+    written += length;
+  }
+
+  return written;
+}
+
+#ifdef RADOS_OSS_HAVE_PGIO
+int
+RadosOssFile::pgRead(XrdSfsAio *aiop, uint64_t opts)
+{
+  mAioOps.add();
+  enqueueAio(new RadosOssAioJob(this, aiop, false, true, opts),
+             aiop->sfsAio.aio_nbytes);
+
+  return XrdOssOK;
+}
+
+int
+RadosOssFile::pgWrite(XrdSfsAio *aiop, uint64_t opts)
+{
+  mAioOps.add();
+  enqueueAio(new RadosOssAioJob(this, aiop, true, true, opts),
+             aiop->sfsAio.aio_nbytes);
+
+  return XrdOssOK;
+}
+#endif
@@ -22,6 +22,8 @@
 #define __RADOS_OSS_FILE_HH__
 
 #include <xrootd/XrdOss/XrdOss.hh>
+#include <xrootd/XrdSfs/XrdSfsAio.hh>
+#include <stdint.h>
 #include <vector>
 #include <radosfs/Filesystem.hh>
 #include <radosfs/File.hh>
@@ -31,24 +33,88 @@
 class RadosOssFile : public XrdOssDF
 {
 public:
-  RadosOssFile(radosfs::Filesystem *radosFs, const XrdSysError &eroute);
+  RadosOssFile(RadosOss *oss, const XrdSysError &eroute, const char *tident);
   virtual ~RadosOssFile();
   virtual int Open(const char *path, int flags, mode_t mode, XrdOucEnv &env);
   virtual int Close(long long *retsz=0);
   virtual ssize_t Read(off_t offset, size_t blen);
   virtual ssize_t Read(void *buff, off_t offset, size_t blen);
+  virtual int Read(XrdSfsAio *aiop);
+  virtual ssize_t ReadV(XrdOucIOVec *readV, int n);
   virtual int Fstat(struct stat *buff);
+  virtual int Fsync(void);
   virtual ssize_t Write(const void *buff, off_t offset, size_t blen);
+  virtual int Write(XrdSfsAio *aiop);
   virtual int getFD() { return fd; }
 
+  // Reads and writes with the crc32c of every 4 KB page of the data; they
+  // override XrdOssDF's if XRootD has them (RADOS_OSS_HAVE_PGIO) and are
+  // plain methods otherwise
+  virtual ssize_t pgRead(void *buffer, off_t offset, size_t rdlen,
+                         uint32_t *csvec, uint64_t opts);
+  virtual ssize_t pgWrite(void *buffer, off_t offset, size_t wrlen,
+                          uint32_t *csvec, uint64_t opts);
+#ifdef RADOS_OSS_HAVE_PGIO
+  virtual int pgRead(XrdSfsAio *aiop, uint64_t opts);
+  virtual int pgWrite(XrdSfsAio *aiop, uint64_t opts);
+#else
+  // The same values as XrdOssDF's options
+  static const uint64_t Verify = 0x8000000000000000ULL;
+  static const uint64_t doCalc = 0x4000000000000000ULL;
+#endif
+
 private:
+  friend class RadosOssAioJob;
+
+  // The reads and writes once the scheduler admitted them; the *Data ones
+  // are not timed, for the aio jobs which time themselves
+  ssize_t doRead(void *buff, off_t offset, size_t blen);
+  ssize_t doWrite(const void *buff, off_t offset, size_t blen);
+  ssize_t doPgRead(void *buffer, off_t offset, size_t rdlen, uint32_t *csvec,
+                   uint64_t opts);
+  ssize_t doPgWrite(void *buffer, off_t offset, size_t wrlen, uint32_t *csvec,
+                    uint64_t opts);
+  void enqueueAio(RadosOssJob *job, size_t bytes);
+  ssize_t readData(char *buff, off_t offset, size_t blen);
+  ssize_t pgReadData(char *buff, off_t offset, size_t rdlen, uint32_t *csvec);
+  ssize_t pgWriteData(const char *buff, off_t offset, size_t wrlen,
+                      uint32_t *csvec, uint64_t opts);
+  ssize_t readPipelined(char *buff, off_t offset, size_t blen,
+                        uint32_t *csvec);
+  ssize_t writeData(const char *buff, off_t offset, size_t blen);
+  int flushWriteBehind(void);
+  int sync(void);
+  void storeChecksums(bool dataSynced);
+  void removeChecksums(void);
+
   radosfs::Filesystem *mRadosFs;
+  RadosOss *mOss;
   radosfs::File *mFile;
+  RadosOssFileReader *mReader;
+  RadosOssReadahead *mReadahead;
+  RadosOssWriteBehind *mWriteBehind;
+  RadosOssWriteChecksums *mChecksums;
+  bool mWritable;
+  // Written since the last sync
+  bool mDirty;
+  bool mCacheWriter;
+  // Registered in the server's open files, which are never truncated by
+  // replacing them
+  bool mOpenRegistered;
+  RadosOssDurability mDurability;
   char* mObjectName;
   XrdSysMutex mMutex;
   XrdSysError mEroute;
   uid_t mUid;
   gid_t mGid;
+  size_t mStripeSize;
+  RadosOssOpCounter mAioOps;
+  // Where the handle's I/O is accounted in the scheduler, if enabled
+  RadosOssScheduler::User *mSchedUser;
+  RadosOssScheduler::Pool *mSchedPool;
+  // Identify the file in the trace, if one is being written
+  uint64_t mPathHash;
+  uint64_t mTraceHandle;
 };
 
 #endif /* __RADOS_OSS_FILE_HH__ */
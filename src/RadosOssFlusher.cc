@@ -0,0 +1,303 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <string.h>
+#include <time.h>
+
+#include "RadosOss.hh"
+#include "RadosOssFlusher.hh"
+#include "RadosOssMetrics.hh"
+
+extern XrdSysError OssEroute;
+
+RadosOssFlusher::RadosOssFlusher()
+  : mOss(0),
+    mInterval(0),
+    mCond(0),
+    mAsyncPending(0),
+    mRunning(false),
+    mStopping(false)
+{}
+
+RadosOssFlusher::~RadosOssFlusher()
+{
+  stop();
+}
+
+int
+RadosOssFlusher::start(RadosOss *oss, int interval)
+{
+  mOss = oss;
+  mInterval = interval > 0 ? interval : 1;
+
+  int ret = XrdSysThread::Run(&mThread, RadosOssFlusher::flusherThread,
+                              (void *) this, XRDSYSTHREAD_HOLD,
+                              "RadosOss flusher");
+
+  if (ret != 0)
+    return -ret;
+
+  mRunning = true;
+
+  return 0;
+}
+
+// Syncs everything still pending
+void
+RadosOssFlusher::stop()
+{
+  if (!mRunning)
+    return;
+
+  mCond.Lock();
+  mStopping = true;
+  mCond.Broadcast();
+  mCond.UnLock();
+
+  XrdSysThread::Join(mThread, 0);
+  mRunning = false;
+}
+
+void
+RadosOssFlusher::add(const std::string &path, radosfs::File *file,
+                     RadosOssWriteBehind *writeBehind, bool cacheWriter,
+                     bool async)
+{
+  Entry *entry = new Entry;
+  entry->path = path;
+  entry->file = file;
+  entry->writeBehind = writeBehind;
+  entry->cacheWriter = cacheWriter;
+  entry->async = async;
+  entry->flushing = false;
+
+  mCond.Lock();
+
+  mEntries.insert(std::make_pair(path, entry));
+
+  if (async)
+  {
+    mAsyncPending++;
+    mCond.Broadcast();
+  }
+
+  mCond.UnLock();
+}
+
+// Syncs the pending files of the path, waiting for the ones the flusher is
+// already syncing, and returns (and forgets) the last error of the path
+int
+RadosOssFlusher::flushPath(const std::string &path)
+{
+  int ret = 0;
+
+  mCond.Lock();
+
+  if (mEntries.empty() && mErrors.empty())
+  {
+    mCond.UnLock();
+    return 0;
+  }
+
+  while (true)
+  {
+    std::pair<EntryMap::iterator, EntryMap::iterator> range;
+    EntryMap::iterator it;
+    Entry *entry = 0;
+
+    range = mEntries.equal_range(path);
+
+    if (range.first == range.second)
+      break;
+
+    for (it = range.first; it != range.second && !entry; it++)
+    {
+      if (!(*it).second->flushing)
+        entry = (*it).second;
+    }
+
+    if (!entry)
+    {
+      mCond.Wait();
+      continue;
+    }
+
+    entry->flushing = true;
+
+    if (entry->async)
+      mAsyncPending--;
+
+    mCond.UnLock();
+    int flushRet = flush(entry);
+    mCond.Lock();
+
+    finish(entry, flushRet);
+  }
+
+  std::map<std::string, int>::iterator errorIt = mErrors.find(path);
+
+  if (errorIt != mErrors.end())
+  {
+    ret = (*errorIt).second;
+    mErrors.erase(errorIt);
+  }
+
+  mCond.UnLock();
+
+  return ret;
+}
+
+size_t
+RadosOssFlusher::pending()
+{
+  size_t pending;
+
+  mCond.Lock();
+  pending = mEntries.size();
+  mCond.UnLock();
+
+  return pending;
+}
+
+void *
+RadosOssFlusher::flusherThread(void *flusher)
+{
+  ((RadosOssFlusher *) flusher)->flushPeriodically();
+  return 0;
+}
+
+void
+RadosOssFlusher::flushPeriodically()
+{
+  time_t nextTick = time(0) + mInterval;
+
+  mCond.Lock();
+
+  while (!mStopping)
+  {
+    time_t now = time(0);
+    bool tick = now >= nextTick;
+
+    if (!tick && mAsyncPending == 0)
+    {
+      mCond.Wait(nextTick - now);
+      continue;
+    }
+
+    if (tick)
+      nextTick = now + mInterval;
+
+    flushEntries(tick);
+  }
+
+  flushEntries(true);
+
+  mCond.UnLock();
+}
+
+// Must be called with the lock held, which is released while syncing
+void
+RadosOssFlusher::flushEntries(bool all)
+{
+  std::vector<Entry *> entries;
+  EntryMap::iterator it;
+
+  for (it = mEntries.begin(); it != mEntries.end(); it++)
+  {
+    Entry *entry = (*it).second;
+
+    if (entry->flushing || !(all || entry->async))
+      continue;
+
+    entry->flushing = true;
+
+    if (entry->async)
+      mAsyncPending--;
+
+    entries.push_back(entry);
+  }
+
+  if (entries.empty())
+    return;
+
+  mCond.UnLock();
+
+  std::vector<int> results(entries.size());
+
+  for (size_t i = 0; i < entries.size(); i++)
+    results[i] = flush(entries[i]);
+
+  mCond.Lock();
+
+  for (size_t i = 0; i < entries.size(); i++)
+    finish(entries[i], results[i]);
+}
+
+int
+RadosOssFlusher::flush(Entry *entry)
+{
+  RadosOssOpTimer timer(RADOS_OSS_OP_RADOS_SYNC);
+  int ret = 0;
+
+  if (entry->writeBehind)
+    ret = entry->writeBehind->sync();
+
+  if (ret == 0)
+    ret = entry->file->sync();
+
+  delete entry->writeBehind;
+  delete entry->file;
+
+  // Once the data has landed, the file can be cached again
+  if (entry->cacheWriter)
+    mOss->blockCache()->removeWriter(entry->path);
+
+  mOss->statCache()->invalidate(entry->path);
+
+  if (ret != 0)
+    OssEroute.Emsg("Flusher", -ret, "sync", entry->path.c_str());
+
+  return timer.done(ret);
+}
+
+// Must be called with the lock held
+void
+RadosOssFlusher::finish(Entry *entry, int ret)
+{
+  std::pair<EntryMap::iterator, EntryMap::iterator> range;
+  EntryMap::iterator it;
+
+  range = mEntries.equal_range(entry->path);
+
+  for (it = range.first; it != range.second; it++)
+  {
+    if ((*it).second == entry)
+    {
+      mEntries.erase(it);
+      break;
+    }
+  }
+
+  if (ret != 0)
+    mErrors[entry->path] = ret;
+
+  delete entry;
+  mCond.Broadcast();
+}
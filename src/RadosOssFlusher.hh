@@ -0,0 +1,85 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_FLUSHER_HH__
+#define __RADOS_OSS_FLUSHER_HH__
+
+#include <XrdSys/XrdSysPthread.hh>
+#include <pthread.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <radosfs/File.hh>
+
+#include "RadosOssWriteBehind.hh"
+
+class RadosOss;
+
+// Syncs the files closed without syncing them, for pools whose durability
+// mode is "interval" (synced every interval seconds) or "async" (synced
+// right away, in the background). The closed handle's file and write-behind
+// are handed over and deleted once synced. A path with pending syncs is
+// synced first when it is accessed again and the error, if any, is reported
+// then, once.
+class RadosOssFlusher
+{
+public:
+  RadosOssFlusher();
+  ~RadosOssFlusher();
+
+  int start(RadosOss *oss, int interval);
+  void stop(void);
+
+  void add(const std::string &path, radosfs::File *file,
+           RadosOssWriteBehind *writeBehind, bool cacheWriter, bool async);
+  int flushPath(const std::string &path);
+  size_t pending(void);
+
+private:
+  struct Entry
+  {
+    std::string path;
+    radosfs::File *file;
+    RadosOssWriteBehind *writeBehind;
+    bool cacheWriter;
+    bool async;
+    bool flushing;
+  };
+
+  typedef std::multimap<std::string, Entry *> EntryMap;
+
+  static void * flusherThread(void *flusher);
+  void flushPeriodically(void);
+  void flushEntries(bool all);
+  int flush(Entry *entry);
+  void finish(Entry *entry, int ret);
+
+  RadosOss *mOss;
+  int mInterval;
+  XrdSysCondVar mCond;
+  EntryMap mEntries;
+  std::map<std::string, int> mErrors;
+  size_t mAsyncPending;
+  pthread_t mThread;
+  bool mRunning;
+  bool mStopping;
+};
+
+#endif /* __RADOS_OSS_FLUSHER_HH__ */
@@ -0,0 +1,50 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_HASH_HH__
+#define __RADOS_OSS_HASH_HH__
+
+#include <stdint.h>
+#include <string>
+
+// FNV-1a hash of a path. It picks the shards of the caches and the RADOS
+// client of a path, and identifies the paths in the traces, so replaying a
+// trace relies on it never changing.
+inline uint64_t
+radosOssPathHash(const char *path)
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (const char *c = path; *c != '\0'; c++)
+  {
+    hash ^= (unsigned char) *c;
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+inline uint64_t
+radosOssPathHash(const std::string &path)
+{
+  return radosOssPathHash(path.c_str());
+}
+
+#endif /* __RADOS_OSS_HASH_HH__ */
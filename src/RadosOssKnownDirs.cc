@@ -0,0 +1,100 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "RadosOssKnownDirs.hh"
+
+RadosOssKnownDirs::RadosOssKnownDirs()
+  : mMaxDirs(0),
+    mHits(0),
+    mMisses(0)
+{}
+
+std::string
+RadosOssKnownDirs::dirKey(const std::string &path)
+{
+  if (path.empty() || path[path.length() - 1] != '/')
+    return path + "/";
+
+  return path;
+}
+
+bool
+RadosOssKnownDirs::contains(const std::string &path)
+{
+  if (!enabled())
+    return false;
+
+  XrdSysMutexHelper lock(mMutex);
+  DirMap::iterator it = mDirs.find(dirKey(path));
+
+  if (it == mDirs.end())
+  {
+    mMisses++;
+    return false;
+  }
+
+  mLru.splice(mLru.begin(), mLru, (*it).second);
+  mHits++;
+
+  return true;
+}
+
+void
+RadosOssKnownDirs::add(const std::string &path)
+{
+  if (!enabled())
+    return;
+
+  std::string key = dirKey(path);
+  XrdSysMutexHelper lock(mMutex);
+  DirMap::iterator it = mDirs.find(key);
+
+  if (it != mDirs.end())
+  {
+    mLru.splice(mLru.begin(), mLru, (*it).second);
+    return;
+  }
+
+  mLru.push_front(key);
+  mDirs[key] = mLru.begin();
+
+  if (mDirs.size() > mMaxDirs)
+  {
+    mDirs.erase(mLru.back());
+    mLru.pop_back();
+  }
+}
+
+void
+RadosOssKnownDirs::invalidate(const std::string &path)
+{
+  if (!enabled())
+    return;
+
+  std::string key = dirKey(path);
+  XrdSysMutexHelper lock(mMutex);
+  DirMap::iterator it = mDirs.lower_bound(key);
+
+  while (it != mDirs.end() && (*it).first.compare(0, key.length(), key) == 0)
+  {
+    mLru.erase((*it).second);
+    mDirs.erase(it++);
+  }
+}
@@ -0,0 +1,65 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_KNOWN_DIRS_HH__
+#define __RADOS_OSS_KNOWN_DIRS_HH__
+
+#include <XrdSys/XrdSysPthread.hh>
+#include <list>
+#include <map>
+#include <string>
+
+// Bounded set of directories known to exist (with their ancestors), so that
+// creating files with mkpath does not need to check the whole path in RADOS
+// each time. The least recently used directories are evicted first. A
+// directory removed elsewhere stays known until its entry is evicted, so
+// callers fall back to creating the path if it turns out to be missing.
+class RadosOssKnownDirs
+{
+public:
+  RadosOssKnownDirs();
+
+  void setMaxDirs(size_t maxDirs) { mMaxDirs = maxDirs; }
+  bool enabled(void) const { return mMaxDirs > 0; }
+
+  bool contains(const std::string &path);
+  void add(const std::string &path);
+  // Forgets the directory and everything under it
+  void invalidate(const std::string &path);
+
+  unsigned long long hits(void) const { return mHits; }
+  unsigned long long misses(void) const { return mMisses; }
+
+private:
+  typedef std::map<std::string, std::list<std::string>::iterator> DirMap;
+
+  static std::string dirKey(const std::string &path);
+
+  XrdSysMutex mMutex;
+  // Sorted, so the directories under a path are the ones following it
+  DirMap mDirs;
+  // Most recently used first
+  std::list<std::string> mLru;
+  size_t mMaxDirs;
+  unsigned long long mHits;
+  unsigned long long mMisses;
+};
+
+#endif /* __RADOS_OSS_KNOWN_DIRS_HH__ */
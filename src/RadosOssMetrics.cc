@@ -0,0 +1,347 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <XrdSys/XrdSysError.hh>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "RadosOssMetrics.hh"
+
+extern XrdSysError OssEroute;
+
+RadosOssMetrics OssMetrics;
+
+static const char *opNames[RADOS_OSS_NUM_OPS] = {
+  "stat",
+  "statfs",
+  "create",
+  "mkdir",
+  "remdir",
+  "unlink",
+  "truncate",
+  "chmod",
+  "rename",
+  "open",
+  "close",
+  "read",
+  "readv",
+  "aioread",
+  "write",
+  "aiowrite",
+  "fsync",
+  "fstat",
+  "opendir",
+  "readdir",
+  "closedir",
+  "pgread",
+  "pgwrite",
+  "preread",
+  "radosstat",
+  "radosread",
+  "radoswrite",
+  "radossync",
+  "radosremove",
+  "schedwait"
+};
+
+static const char *gaugeNames[RADOS_OSS_NUM_GAUGES] = {
+  "reaperpending"
+};
+
+RadosOssMetrics::RadosOssMetrics()
+  : mExportInterval(0),
+    mExporterCond(0),
+    mExporterRunning(false),
+    mStopping(false)
+{
+  pthread_key_create(&mSlotKey, RadosOssMetrics::releaseSlot);
+
+  for (int i = 0; i < RADOS_OSS_NUM_GAUGES; i++)
+    mGauges[i] = 0;
+}
+
+RadosOssMetrics::~RadosOssMetrics()
+{
+  stopExporter();
+}
+
+const char *
+RadosOssMetrics::opName(RadosOssOp op)
+{
+  return opNames[op];
+}
+
+const char *
+RadosOssMetrics::gaugeName(RadosOssGauge gauge)
+{
+  return gaugeNames[gauge];
+}
+
+// Monotonic, so durations and rate limits are not skewed when the system
+// clock is set
+uint64_t
+RadosOssMetrics::nowUs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+RadosOssMetrics::ThreadSlot *
+RadosOssMetrics::threadSlot()
+{
+  ThreadSlot *slot = (ThreadSlot *) pthread_getspecific(mSlotKey);
+
+  if (slot)
+    return slot;
+
+  mSlotsMutex.Lock();
+
+  // Slots of threads which exited are reused (their counts are kept)
+  if (!mFreeSlots.empty())
+  {
+    slot = mFreeSlots.back();
+    mFreeSlots.pop_back();
+  }
+  else
+  {
+    slot = new ThreadSlot;
+    memset(&slot->stats, 0, sizeof(slot->stats));
+    slot->metrics = this;
+    mSlots.push_back(slot);
+  }
+
+  mSlotsMutex.UnLock();
+
+  pthread_setspecific(mSlotKey, slot);
+
+  return slot;
+}
+
+void
+RadosOssMetrics::releaseSlot(void *threadSlot)
+{
+  ThreadSlot *slot = (ThreadSlot *) threadSlot;
+  RadosOssMetrics *metrics = slot->metrics;
+
+  metrics->mSlotsMutex.Lock();
+  metrics->mFreeSlots.push_back(slot);
+  metrics->mSlotsMutex.UnLock();
+}
+
+void
+RadosOssMetrics::record(RadosOssOp op, uint64_t elapsedUs, ssize_t result,
+                        bool countBytes)
+{
+  RadosOssOpStats &stats = threadSlot()->stats;
+  int bucket = 0;
+
+  if (elapsedUs > 1)
+    bucket = 63 - __builtin_clzll(elapsedUs);
+
+  if (bucket >= RADOS_OSS_METRICS_NUM_BUCKETS)
+    bucket = RADOS_OSS_METRICS_NUM_BUCKETS - 1;
+
+  // Only this thread writes to its slot; readers may see slightly old values
+  stats.count[op]++;
+  stats.totalUs[op] += elapsedUs;
+  stats.histogram[op][bucket]++;
+
+  if (result < 0)
+    stats.errors[op]++;
+  else if (countBytes)
+    stats.bytes[op] += result;
+}
+
+void
+RadosOssMetrics::snapshot(RadosOssOpStats &stats)
+{
+  memset(&stats, 0, sizeof(stats));
+
+  XrdSysMutexHelper lock(mSlotsMutex);
+
+  std::vector<ThreadSlot *>::const_iterator it;
+  for (it = mSlots.begin(); it != mSlots.end(); it++)
+  {
+    const RadosOssOpStats &slotStats = (*it)->stats;
+
+    for (int op = 0; op < RADOS_OSS_NUM_OPS; op++)
+    {
+      stats.count[op] += slotStats.count[op];
+      stats.errors[op] += slotStats.errors[op];
+      stats.bytes[op] += slotStats.bytes[op];
+      stats.totalUs[op] += slotStats.totalUs[op];
+
+      for (int i = 0; i < RADOS_OSS_METRICS_NUM_BUCKETS; i++)
+        stats.histogram[op][i] += slotStats.histogram[op][i];
+    }
+  }
+}
+
+// Returns the upper bound (in microseconds) of the bucket holding the given
+// fraction of the operations
+uint64_t
+RadosOssMetrics::percentile(const RadosOssOpStats &stats, RadosOssOp op,
+                            double fraction)
+{
+  uint64_t target = (uint64_t) (stats.count[op] * fraction);
+  uint64_t seen = 0;
+
+  if (stats.count[op] == 0)
+    return 0;
+
+  for (int i = 0; i < RADOS_OSS_METRICS_NUM_BUCKETS; i++)
+  {
+    seen += stats.histogram[op][i];
+
+    if (seen > target)
+      return 2ULL << i;
+  }
+
+  return 2ULL << (RADOS_OSS_METRICS_NUM_BUCKETS - 1);
+}
+
+int
+RadosOssMetrics::startExporter(const std::string &path, size_t interval)
+{
+  mExportPath = path;
+  mExportInterval = interval;
+
+  int ret = XrdSysThread::Run(&mExporterThread,
+                              RadosOssMetrics::exporterThread, (void *) this,
+                              XRDSYSTHREAD_HOLD, "RadosOss metrics exporter");
+
+  if (ret != 0)
+    return -ret;
+
+  mExporterRunning = true;
+
+  return 0;
+}
+
+void
+RadosOssMetrics::stopExporter()
+{
+  if (!mExporterRunning)
+    return;
+
+  mExporterCond.Lock();
+  mStopping = true;
+  mExporterCond.Broadcast();
+  mExporterCond.UnLock();
+
+  XrdSysThread::Join(mExporterThread, 0);
+  mExporterRunning = false;
+}
+
+void *
+RadosOssMetrics::exporterThread(void *metrics)
+{
+  ((RadosOssMetrics *) metrics)->exportPeriodically();
+  return 0;
+}
+
+void
+RadosOssMetrics::exportPeriodically()
+{
+  mExporterCond.Lock();
+
+  while (!mStopping)
+  {
+    mExporterCond.Wait(mExportInterval);
+
+    if (mStopping)
+      break;
+
+    mExporterCond.UnLock();
+
+    int ret = exportToFile();
+
+    if (ret != 0)
+      OssEroute.Emsg("Failed to export the metrics to", mExportPath.c_str(),
+                     ":", strerror(-ret));
+
+    mExporterCond.Lock();
+  }
+
+  mExporterCond.UnLock();
+}
+
+// Writes a JSON snapshot to a temporary file which then replaces the export
+// file, so readers never see a partial snapshot
+int
+RadosOssMetrics::exportToFile()
+{
+  RadosOssOpStats stats;
+  std::string tmpPath = mExportPath + ".tmp";
+  FILE *file = fopen(tmpPath.c_str(), "w");
+
+  if (!file)
+    return -errno;
+
+  snapshot(stats);
+
+  fprintf(file, "{\"time\": %lu, \"ops\": {", (unsigned long) time(0));
+
+  for (int op = 0; op < RADOS_OSS_NUM_OPS; op++)
+  {
+    RadosOssOp radosOssOp = (RadosOssOp) op;
+    int lastBucket = RADOS_OSS_METRICS_NUM_BUCKETS - 1;
+
+    while (lastBucket > 0 && stats.histogram[op][lastBucket] == 0)
+      lastBucket--;
+
+    fprintf(file, "%s\n  \"%s\": {\"count\": %llu, \"errors\": %llu, "
+            "\"bytes\": %llu, \"total_us\": %llu, \"p50_us\": %llu, "
+            "\"p99_us\": %llu, \"histogram\": [",
+            (op == 0 ? "" : ","), opName(radosOssOp),
+            (unsigned long long) stats.count[op],
+            (unsigned long long) stats.errors[op],
+            (unsigned long long) stats.bytes[op],
+            (unsigned long long) stats.totalUs[op],
+            (unsigned long long) percentile(stats, radosOssOp, 0.5),
+            (unsigned long long) percentile(stats, radosOssOp, 0.99));
+
+    for (int i = 0; i <= lastBucket; i++)
+      fprintf(file, "%s%llu", (i == 0 ? "" : ", "),
+              (unsigned long long) stats.histogram[op][i]);
+
+    fprintf(file, "]}");
+  }
+
+  fprintf(file, "\n}, \"gauges\": {");
+
+  for (int i = 0; i < RADOS_OSS_NUM_GAUGES; i++)
+    fprintf(file, "%s\"%s\": %llu", (i == 0 ? "" : ", "),
+            gaugeName((RadosOssGauge) i), (unsigned long long) mGauges[i]);
+
+  fprintf(file, "}}\n");
+
+  if (fclose(file) != 0)
+    return -errno;
+
+  if (rename(tmpPath.c_str(), mExportPath.c_str()) != 0)
+    return -errno;
+
+  return 0;
+}
@@ -0,0 +1,221 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_METRICS_HH__
+#define __RADOS_OSS_METRICS_HH__
+
+#include <XrdSys/XrdSysPthread.hh>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+#include "RadosOssHash.hh"
+#include "RadosOssTrace.hh"
+
+typedef enum {
+  RADOS_OSS_OP_STAT = 0,
+  RADOS_OSS_OP_STATFS,
+  RADOS_OSS_OP_CREATE,
+  RADOS_OSS_OP_MKDIR,
+  RADOS_OSS_OP_REMDIR,
+  RADOS_OSS_OP_UNLINK,
+  RADOS_OSS_OP_TRUNCATE,
+  RADOS_OSS_OP_CHMOD,
+  RADOS_OSS_OP_RENAME,
+  RADOS_OSS_OP_OPEN,
+  RADOS_OSS_OP_CLOSE,
+  RADOS_OSS_OP_READ,
+  RADOS_OSS_OP_READV,
+  RADOS_OSS_OP_AIO_READ,
+  RADOS_OSS_OP_WRITE,
+  RADOS_OSS_OP_AIO_WRITE,
+  RADOS_OSS_OP_FSYNC,
+  RADOS_OSS_OP_FSTAT,
+  RADOS_OSS_OP_OPENDIR,
+  RADOS_OSS_OP_READDIR,
+  RADOS_OSS_OP_CLOSEDIR,
+  RADOS_OSS_OP_PGREAD,
+  RADOS_OSS_OP_PGWRITE,
+  RADOS_OSS_OP_PREREAD,
+  // Operations on RADOS done underneath the ones above
+  RADOS_OSS_OP_RADOS_STAT,
+  RADOS_OSS_OP_RADOS_READ,
+  RADOS_OSS_OP_RADOS_WRITE,
+  RADOS_OSS_OP_RADOS_SYNC,
+  RADOS_OSS_OP_RADOS_REMOVE,
+  // Time the reads and writes waited for their turn in the I/O scheduler
+  RADOS_OSS_OP_SCHED_WAIT,
+  RADOS_OSS_NUM_OPS
+} RadosOssOp;
+
+// Current values (rather than counts) exported with the operations
+typedef enum {
+  // Removed files whose objects the reaper has not deleted yet
+  RADOS_OSS_GAUGE_REAPER_PENDING = 0,
+  RADOS_OSS_NUM_GAUGES
+} RadosOssGauge;
+
+#define RADOS_OSS_METRICS_NUM_BUCKETS 32
+
+// Counters of one or more threads. Bucket i of the histograms counts the
+// operations which took [2^i, 2^(i+1)) microseconds (bucket 0 includes 0).
+struct RadosOssOpStats
+{
+  uint64_t count[RADOS_OSS_NUM_OPS];
+  uint64_t errors[RADOS_OSS_NUM_OPS];
+  uint64_t bytes[RADOS_OSS_NUM_OPS];
+  uint64_t totalUs[RADOS_OSS_NUM_OPS];
+  uint64_t histogram[RADOS_OSS_NUM_OPS][RADOS_OSS_METRICS_NUM_BUCKETS];
+};
+
+// Always-on latency and throughput metrics. Every thread records into its
+// own counters so recording never takes a lock nor shares cache lines with
+// other threads; a snapshot adds up the counters of all threads.
+class RadosOssMetrics
+{
+public:
+  RadosOssMetrics();
+  ~RadosOssMetrics();
+
+  void record(RadosOssOp op, uint64_t elapsedUs, ssize_t result,
+              bool countBytes);
+  void snapshot(RadosOssOpStats &stats);
+  void setGauge(RadosOssGauge gauge, uint64_t value) { mGauges[gauge] = value; }
+  uint64_t gauge(RadosOssGauge gauge) const { return mGauges[gauge]; }
+
+  int startExporter(const std::string &path, size_t interval);
+  void stopExporter(void);
+
+  static const char * opName(RadosOssOp op);
+  static const char * gaugeName(RadosOssGauge gauge);
+  static uint64_t percentile(const RadosOssOpStats &stats, RadosOssOp op,
+                             double fraction);
+  static uint64_t nowUs(void);
+
+private:
+  struct ThreadSlot
+  {
+    RadosOssMetrics *metrics;
+    RadosOssOpStats stats;
+  };
+
+  ThreadSlot * threadSlot(void);
+  static void releaseSlot(void *slot);
+  static void * exporterThread(void *metrics);
+  void exportPeriodically(void);
+  int exportToFile(void);
+
+  pthread_key_t mSlotKey;
+  // Only protects the lists of slots, which change when threads come or go
+  XrdSysMutex mSlotsMutex;
+  std::vector<ThreadSlot *> mSlots;
+  std::vector<ThreadSlot *> mFreeSlots;
+  volatile uint64_t mGauges[RADOS_OSS_NUM_GAUGES];
+
+  std::string mExportPath;
+  size_t mExportInterval;
+  XrdSysCondVar mExporterCond;
+  pthread_t mExporterThread;
+  bool mExporterRunning;
+  bool mStopping;
+};
+
+extern RadosOssMetrics OssMetrics;
+
+// Times an operation from its construction to its destruction. The result of
+// the operation (an error or the number of bytes) is given with done().
+// Operations of the XrdOss interface also describe themselves with
+// tracePath() or traceHandle() so they are added to the trace, if one is
+// being written.
+class RadosOssOpTimer
+{
+public:
+  RadosOssOpTimer(RadosOssOp op, bool countBytes=false)
+    : mOp(op),
+      mCountBytes(countBytes),
+      mTraced(false),
+      mResult(0),
+      mStart(RadosOssMetrics::nowUs()),
+      mSegments(0),
+      mNumSegments(0)
+  {}
+
+  ~RadosOssOpTimer()
+  {
+    uint64_t elapsedUs = RadosOssMetrics::nowUs() - mStart;
+
+    OssMetrics.record(mOp, elapsedUs, mResult, mCountBytes);
+
+    if (mTraced)
+    {
+      mTrace.start = mStart;
+      mTrace.duration = elapsedUs;
+      mTrace.result = mResult;
+      mTrace.op = mOp;
+      OssTrace.record(mTrace, mSegments, mNumSegments);
+    }
+  }
+
+  template <typename T>
+  T done(T result) { mResult = result; return result; }
+
+  void tracePath(const char *path, int64_t offset=0, uint64_t length=0,
+                 uint32_t flags=0)
+  {
+    if (OssTrace.enabled())
+      traceHandle(radosOssPathHash(path), 0, offset, length, flags);
+  }
+
+  void traceHandle(uint64_t pathHash, uint64_t handle, int64_t offset=0,
+                   uint64_t length=0, uint32_t flags=0)
+  {
+    if (!OssTrace.enabled())
+      return;
+
+    memset(&mTrace, 0, sizeof(mTrace));
+    mTrace.pathHash = pathHash;
+    mTrace.handle = handle;
+    mTrace.offset = offset;
+    mTrace.length = length;
+    mTrace.flags = flags;
+    mTraced = true;
+  }
+
+  void traceSegments(const XrdOucIOVec *segments, int numSegments)
+  {
+    mSegments = segments;
+    mNumSegments = numSegments;
+  }
+
+private:
+  RadosOssOp mOp;
+  bool mCountBytes;
+  bool mTraced;
+  ssize_t mResult;
+  uint64_t mStart;
+  RadosOssTraceRecord mTrace;
+  const XrdOucIOVec *mSegments;
+  int mNumSegments;
+};
+
+#endif /* __RADOS_OSS_METRICS_HH__ */
@@ -0,0 +1,176 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "RadosOssPoolTable.hh"
+
+bool
+operator==(const RadosOssPool &pool, const RadosOssPool &other)
+{
+  return pool.name == other.name && pool.prefix == other.prefix &&
+         pool.size == other.size && pool.isMtdPool == other.isMtdPool &&
+         pool.durability == other.durability;
+}
+
+RadosOssPoolTable::RadosOssPoolTable(const std::vector<RadosOssPool> &pools)
+  : mPools(pools),
+    mRoot(new Node("")),
+    mRefs(1)
+{
+  for (size_t i = 0; i < mPools.size(); i++)
+    insert(i);
+}
+
+RadosOssPoolTable::~RadosOssPoolTable()
+{
+  deleteNode(mRoot);
+}
+
+void
+RadosOssPoolTable::ref()
+{
+  __sync_add_and_fetch(&mRefs, 1);
+}
+
+void
+RadosOssPoolTable::unref()
+{
+  if (__sync_sub_and_fetch(&mRefs, 1) == 0)
+    delete this;
+}
+
+void
+RadosOssPoolTable::deleteNode(Node *node)
+{
+  for (size_t i = 0; i < node->children.size(); i++)
+    deleteNode(node->children[i]);
+
+  delete node;
+}
+
+// Returns the child whose label starts with c or, if there is none, sets
+// index to where such a child should be inserted
+RadosOssPoolTable::Node *
+RadosOssPoolTable::findChild(const Node *node, char c, size_t *index)
+{
+  size_t low = 0, high = node->children.size();
+
+  while (low < high)
+  {
+    size_t middle = (low + high) / 2;
+    char first = node->children[middle]->label[0];
+
+    if (first == c)
+    {
+      *index = middle;
+      return node->children[middle];
+    }
+
+    if (first < c)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  *index = low;
+
+  return 0;
+}
+
+void
+RadosOssPoolTable::insert(int poolIndex)
+{
+  const RadosOssPool &pool = mPools[poolIndex];
+  const std::string &prefix = pool.prefix;
+  Node *node = mRoot;
+  size_t pos = 0;
+
+  while (pos < prefix.length())
+  {
+    size_t index;
+    Node *child = findChild(node, prefix[pos], &index);
+
+    if (!child)
+    {
+      child = new Node(prefix.substr(pos));
+      node->children.insert(node->children.begin() + index, child);
+      node = child;
+      break;
+    }
+
+    size_t common = 1;
+    while (common < child->label.length() &&
+           pos + common < prefix.length() &&
+           child->label[common] == prefix[pos + common])
+      common++;
+
+    // the prefix ends or diverges in the middle of the label so the child
+    // is split in two
+    if (common < child->label.length())
+    {
+      Node *parent = new Node(child->label.substr(0, common));
+      child->label.erase(0, common);
+      parent->children.push_back(child);
+      node->children[index] = parent;
+      child = parent;
+    }
+
+    node = child;
+    pos += common;
+  }
+
+  // As with a linear walk, the first pool configured for a prefix wins
+  int &nodePool = pool.isMtdPool ? node->mtdPool : node->dataPool;
+
+  if (nodePool == -1)
+    nodePool = poolIndex;
+}
+
+const RadosOssPool *
+RadosOssPoolTable::find(const std::string &path, bool isMtdPool) const
+{
+  const Node *node = mRoot;
+  size_t pos = 0;
+  int match = -1;
+
+  while (true)
+  {
+    int nodePool = isMtdPool ? node->mtdPool : node->dataPool;
+
+    if (nodePool != -1)
+      match = nodePool;
+
+    if (pos == path.length())
+      break;
+
+    size_t index;
+    const Node *child = findChild(node, path[pos], &index);
+
+    if (!child || path.compare(pos, child->label.length(), child->label) != 0)
+      break;
+
+    node = child;
+    pos += child->label.length();
+  }
+
+  if (match == -1)
+    return 0;
+
+  return &mPools[match];
+}
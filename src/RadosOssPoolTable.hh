@@ -0,0 +1,86 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_POOL_TABLE_HH__
+#define __RADOS_OSS_POOL_TABLE_HH__
+
+#include <string>
+#include <vector>
+
+// When the data written to a file is synced if the handle does not do it
+typedef enum {
+  RADOS_OSS_DURABILITY_CLOSE = 0, // before Close returns
+  RADOS_OSS_DURABILITY_INTERVAL, // periodically, by the flusher
+  RADOS_OSS_DURABILITY_ASYNC // right after Close, by the flusher
+} RadosOssDurability;
+
+typedef struct {
+  std::string name;
+  std::string prefix;
+  int size;
+  bool isMtdPool;
+  RadosOssDurability durability;
+} RadosOssPool;
+
+// Immutable routing table from path prefixes to pools. The prefixes are
+// compiled into a radix tree so finding the longest matching prefix only
+// depends on the length of the path, not on the number of pools.
+// Tables are reference counted so a new one can replace the current one
+// while requests are still using it.
+class RadosOssPoolTable
+{
+public:
+  RadosOssPoolTable(const std::vector<RadosOssPool> &pools);
+  ~RadosOssPoolTable();
+
+  void ref(void);
+  void unref(void);
+
+  const RadosOssPool * find(const std::string &path, bool isMtdPool) const;
+  const std::vector<RadosOssPool> & pools(void) const { return mPools; }
+
+private:
+  struct Node
+  {
+    Node(const std::string &nodeLabel)
+      : label(nodeLabel),
+        dataPool(-1),
+        mtdPool(-1)
+    {}
+
+    std::string label;
+    int dataPool;
+    int mtdPool;
+    // sorted by the first char of their labels
+    std::vector<Node *> children;
+  };
+
+  static Node * findChild(const Node *node, char c, size_t *index);
+  static void deleteNode(Node *node);
+  void insert(int poolIndex);
+
+  std::vector<RadosOssPool> mPools;
+  Node *mRoot;
+  int mRefs;
+};
+
+bool operator==(const RadosOssPool &pool, const RadosOssPool &other);
+
+#endif /* __RADOS_OSS_POOL_TABLE_HH__ */
@@ -0,0 +1,341 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "RadosOssReadahead.hh"
+#include "RadosOssDefines.hh"
+
+bool
+RadosOssMemoryBudget::reserve(size_t size)
+{
+  XrdSysMutexHelper lock(mMutex);
+
+  if (mUsed + size > mLimit)
+    return false;
+
+  mUsed += size;
+
+  return true;
+}
+
+void
+RadosOssMemoryBudget::release(size_t size)
+{
+  XrdSysMutexHelper lock(mMutex);
+
+  mUsed -= size;
+}
+
+class RadosOssReadaheadJob : public RadosOssJob
+{
+public:
+  RadosOssReadaheadJob(RadosOssReadahead *readahead,
+                       RadosOssReadahead::Block *block)
+    : mReadahead(readahead),
+      mBlock(block)
+  {}
+
+  virtual void run(void)
+  {
+    mBlock->result = mReadahead->mReader->readDirect(mBlock->data,
+                                                     mBlock->offset,
+                                                     mBlock->length);
+    mReadahead->blockFinished(mBlock);
+  }
+
+private:
+  RadosOssReadahead *mReadahead;
+  RadosOssReadahead::Block *mBlock;
+};
+
+RadosOssReadahead::RadosOssReadahead(RadosOssFileReader *reader,
+                                     size_t stripeSize,
+                                     const RadosOssReadaheadConf &conf,
+                                     RadosOssThreadPool *pool,
+                                     RadosOssMemoryBudget *budget)
+  : mReader(reader),
+    mStripeSize(stripeSize),
+    mConf(conf),
+    mPool(pool),
+    mBudget(budget),
+    mCond(0),
+    mUsedMemory(0),
+    mInFlight(0),
+    mNextOffset(0),
+    mSequentialReads(0),
+    mEof(false)
+{
+  if (mConf.blockSize == 0 || mConf.blockSize > mStripeSize)
+    mConf.blockSize = mStripeSize;
+}
+
+RadosOssReadahead::~RadosOssReadahead()
+{
+  invalidate();
+}
+
+off_t
+RadosOssReadahead::blockStart(off_t offset) const
+{
+  off_t stripeStart = offset - offset % mStripeSize;
+  off_t offsetInStripe = offset - stripeStart;
+
+  return stripeStart + offsetInStripe - offsetInStripe % mConf.blockSize;
+}
+
+size_t
+RadosOssReadahead::blockLength(off_t blockOffset) const
+{
+  off_t stripeEnd = blockOffset - blockOffset % mStripeSize + mStripeSize;
+
+  if (blockOffset + (off_t) mConf.blockSize > stripeEnd)
+    return stripeEnd - blockOffset;
+
+  return mConf.blockSize;
+}
+
+ssize_t
+RadosOssReadahead::read(char *buff, off_t offset, size_t blen)
+{
+  bool eof = false;
+  size_t served;
+  ssize_t ret;
+
+  mCond.Lock();
+
+  if (offset == mNextOffset)
+  {
+    mSequentialReads++;
+  }
+  else if (mBlocks.count(blockStart(offset)) == 0)
+  {
+    mSequentialReads = 0;
+    mEof = false;
+    dropBlocks(0, true);
+  }
+
+  if (mSequentialReads >= READAHEAD_MIN_SEQUENTIAL_READS)
+    scheduleBlocks(offset);
+
+  served = serveFromBlocks(buff, offset, blen, &eof);
+
+  mCond.UnLock();
+
+  ret = served;
+
+  if (served < blen && !eof)
+  {
+    ssize_t directRet = mReader->read(buff + served, offset + served,
+                                      blen - served);
+    if (directRet >= 0)
+      ret += directRet;
+    else if (served == 0)
+      return directRet;
+  }
+
+  mCond.Lock();
+
+  mNextOffset = offset + ret;
+  dropBlocks(mNextOffset, false);
+
+  if (mSequentialReads >= READAHEAD_MIN_SEQUENTIAL_READS)
+    scheduleBlocks(mNextOffset);
+
+  mCond.UnLock();
+
+  return ret;
+}
+
+size_t
+RadosOssReadahead::serveFromBlocks(char *buff, off_t offset, size_t blen,
+                                   bool *eof)
+{
+  off_t pos = offset;
+  off_t end = offset + blen;
+
+  while (pos < end)
+  {
+    std::map<off_t, Block *>::iterator it = mBlocks.find(blockStart(pos));
+
+    if (it == mBlocks.end())
+      break;
+
+    Block *block = (*it).second;
+
+    // The block may be dropped by another reader while we wait so we look
+    // it up again once woken up
+    if (!block->ready)
+    {
+      mCond.Wait();
+      continue;
+    }
+
+    if (block->result < 0)
+      break;
+
+    off_t blockDataEnd = block->offset + block->result;
+
+    if (pos >= blockDataEnd)
+    {
+      *eof = block->result < (ssize_t) block->length;
+      break;
+    }
+
+    size_t length = std::min(blockDataEnd, end) - pos;
+    memcpy(buff + (pos - offset), block->data + (pos - block->offset), length);
+    pos += length;
+
+    if (pos == blockDataEnd && block->result < (ssize_t) block->length)
+    {
+      *eof = true;
+      break;
+    }
+  }
+
+  return pos - offset;
+}
+
+void
+RadosOssReadahead::scheduleBlocks(off_t offset)
+{
+  off_t blockOffset = blockStart(offset);
+
+  for (size_t i = 0; i < mConf.depth && !mEof; i++)
+  {
+    size_t length = blockLength(blockOffset);
+
+    if (mBlocks.count(blockOffset) == 0)
+    {
+      if (!scheduleBlock(blockOffset, length))
+        break;
+    }
+    else if (mBlocks[blockOffset]->ready &&
+             mBlocks[blockOffset]->result < (ssize_t) length)
+    {
+      // Nothing else to prefetch after the end of the file
+      mEof = true;
+    }
+
+    blockOffset += length;
+  }
+}
+
+// Must be called with the lock held
+bool
+RadosOssReadahead::scheduleBlock(off_t blockOffset, size_t length)
+{
+  if (mUsedMemory + length > mConf.handleMemory || !mBudget->reserve(length))
+    return false;
+
+  Block *block = new Block;
+  block->offset = blockOffset;
+  block->length = length;
+  block->data = (char *) malloc(length);
+  block->result = 0;
+  block->ready = false;
+
+  mUsedMemory += length;
+  mInFlight++;
+  mBlocks[blockOffset] = block;
+
+  mPool->enqueue(new RadosOssReadaheadJob(this, block));
+
+  return true;
+}
+
+void
+RadosOssReadahead::prefetch(off_t offset, size_t blen)
+{
+  off_t end = offset + blen;
+
+  mCond.Lock();
+
+  // As much of the range as the memory limits allow
+  for (off_t blockOffset = blockStart(offset); blockOffset < end;
+       blockOffset += blockLength(blockOffset))
+  {
+    if (mBlocks.count(blockOffset) == 0 &&
+        !scheduleBlock(blockOffset, blockLength(blockOffset)))
+      break;
+  }
+
+  mCond.UnLock();
+}
+
+void
+RadosOssReadahead::dropBlocks(off_t offset, bool all)
+{
+  std::map<off_t, Block *>::iterator it = mBlocks.begin();
+
+  while (it != mBlocks.end())
+  {
+    Block *block = (*it).second;
+
+    if (!all && block->offset + (off_t) block->length > offset)
+      break;
+
+    if (block->ready)
+    {
+      freeBlock(block);
+      mBlocks.erase(it++);
+    }
+    else
+    {
+      it++;
+    }
+  }
+}
+
+void
+RadosOssReadahead::freeBlock(Block *block)
+{
+  mUsedMemory -= block->length;
+  mBudget->release(block->length);
+  free(block->data);
+  delete block;
+}
+
+void
+RadosOssReadahead::blockFinished(Block *block)
+{
+  mCond.Lock();
+  block->ready = true;
+  mInFlight--;
+  mCond.Broadcast();
+  mCond.UnLock();
+}
+
+void
+RadosOssReadahead::invalidate()
+{
+  mCond.Lock();
+
+  while (mInFlight > 0)
+    mCond.Wait();
+
+  dropBlocks(0, true);
+  mSequentialReads = 0;
+  mEof = false;
+
+  mCond.UnLock();
+}
@@ -0,0 +1,104 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_READAHEAD_HH__
+#define __RADOS_OSS_READAHEAD_HH__
+
+#include <XrdSys/XrdSysPthread.hh>
+#include <sys/types.h>
+#include <map>
+
+#include "RadosOssBlockCache.hh"
+#include "RadosOssThreadPool.hh"
+
+typedef struct {
+  size_t depth;
+  size_t blockSize;
+  size_t handleMemory;
+} RadosOssReadaheadConf;
+
+// Memory shared by all the handles of the plugin (e.g. for prefetched data).
+class RadosOssMemoryBudget
+{
+public:
+  RadosOssMemoryBudget() : mLimit(0), mUsed(0) {}
+
+  void setLimit(size_t limit) { mLimit = limit; }
+  bool reserve(size_t size);
+  void release(size_t size);
+
+private:
+  XrdSysMutex mMutex;
+  size_t mLimit;
+  size_t mUsed;
+};
+
+// Per handle read-ahead: once a few sequential reads are detected, the next
+// blocks (aligned to the stripe objects) are fetched in the background and
+// the following reads are served from them. Blocks can also be fetched on
+// request, e.g. for XRootD's preread hints.
+class RadosOssReadahead
+{
+public:
+  RadosOssReadahead(RadosOssFileReader *reader, size_t stripeSize,
+                    const RadosOssReadaheadConf &conf,
+                    RadosOssThreadPool *pool, RadosOssMemoryBudget *budget);
+  ~RadosOssReadahead();
+
+  ssize_t read(char *buff, off_t offset, size_t blen);
+  void prefetch(off_t offset, size_t blen);
+  void invalidate(void);
+
+private:
+  struct Block
+  {
+    off_t offset;
+    size_t length;
+    char *data;
+    ssize_t result;
+    bool ready;
+  };
+
+  friend class RadosOssReadaheadJob;
+
+  off_t blockStart(off_t offset) const;
+  size_t blockLength(off_t blockOffset) const;
+  size_t serveFromBlocks(char *buff, off_t offset, size_t blen, bool *eof);
+  void scheduleBlocks(off_t offset);
+  bool scheduleBlock(off_t blockOffset, size_t length);
+  void dropBlocks(off_t offset, bool all);
+  void freeBlock(Block *block);
+  void blockFinished(Block *block);
+
+  RadosOssFileReader *mReader;
+  size_t mStripeSize;
+  RadosOssReadaheadConf mConf;
+  RadosOssThreadPool *mPool;
+  RadosOssMemoryBudget *mBudget;
+  XrdSysCondVar mCond;
+  std::map<off_t, Block *> mBlocks;
+  size_t mUsedMemory;
+  size_t mInFlight;
+  off_t mNextOffset;
+  size_t mSequentialReads;
+  bool mEof;
+};
+
+#endif /* __RADOS_OSS_READAHEAD_HH__ */
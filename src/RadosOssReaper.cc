@@ -0,0 +1,351 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <map>
+#include <vector>
+#include <radosfs/Dir.hh>
+#include <radosfs/File.hh>
+
+#include "RadosOss.hh"
+#include "RadosOssDefines.hh"
+#include "RadosOssHash.hh"
+#include "RadosOssMetrics.hh"
+#include "RadosOssReaper.hh"
+
+extern XrdSysError OssEroute;
+
+class RadosOssRemoveJob : public RadosOssJob
+{
+public:
+  RadosOssRemoveJob(RadosOssReaper *reaper, const std::string &path)
+    : mReaper(reaper),
+      mPath(path)
+  {}
+
+  virtual void run(void)
+  {
+    RadosOssOpTimer timer(RADOS_OSS_OP_RADOS_REMOVE);
+    radosfs::File file(mReaper->mOss->radosFs(mPath), mPath,
+                       radosfs::File::MODE_WRITE);
+    int ret = timer.done(file.remove());
+
+    // Another server may have removed it when cleaning up the trash
+    if (ret != 0 && ret != -ENOENT)
+      OssEroute.Emsg("Reaper", -ret, "remove", mPath.c_str());
+
+    mReaper->removeFinished();
+  }
+
+private:
+  RadosOssReaper *mReaper;
+  std::string mPath;
+};
+
+RadosOssReaper::RadosOssReaper()
+  : mOss(0),
+    mNumThreads(0),
+    mPending(0),
+    mCounter(0)
+{}
+
+int
+RadosOssReaper::start(RadosOss *oss)
+{
+  std::vector<RadosOssPool> pools;
+  std::set<std::string> dirs;
+  std::set<std::string>::iterator it;
+
+  mOss = oss;
+
+  int ret = mPool.start(mNumThreads);
+
+  if (ret != 0)
+    return ret;
+
+  mOss->getPools(pools);
+
+  for (size_t i = 0; i < pools.size(); i++)
+    dirs.insert(trashDirOf(pools[i].prefix));
+
+  for (it = dirs.begin(); it != dirs.end(); it++)
+  {
+    radosfs::Dir dir(mOss->radosFs(*it), *it);
+    std::set<std::string> entries;
+    std::set<std::string>::iterator entry;
+
+    dir.refresh();
+
+    if (dir.entryList(entries) != 0)
+      continue;
+
+    for (entry = entries.begin(); entry != entries.end(); entry++)
+      queue(*it + *entry);
+  }
+
+  return 0;
+}
+
+void
+RadosOssReaper::stop()
+{
+  mPool.stop();
+}
+
+bool
+RadosOssReaper::isTrash(const std::string &name)
+{
+  return name == TRASH_DIR_NAME || name == TRASH_DIR_NAME "/";
+}
+
+std::string
+RadosOssReaper::trashDirOf(const std::string &prefix)
+{
+  if (prefix.empty() || prefix[prefix.length() - 1] != '/')
+    return prefix + "/" TRASH_DIR_NAME "/";
+
+  return prefix + TRASH_DIR_NAME "/";
+}
+
+// The trash is in the deepest of the prefixes of the file's data and
+// metadata pools, so moving the file there keeps it in both pools
+std::string
+RadosOssReaper::trashDir(const std::string &path)
+{
+  std::string prefix("/");
+  RadosOssPool pool;
+
+  if (mOss->getPoolFromPath(path, pool))
+    prefix = pool.prefix;
+
+  if (mOss->getMetadataPoolFromPath(path, pool) &&
+      pool.prefix.length() > prefix.length())
+    prefix = pool.prefix;
+
+  return trashDirOf(prefix);
+}
+
+int
+RadosOssReaper::createTrashDir(const std::string &dir)
+{
+  {
+    XrdSysMutexHelper lock(mMutex);
+
+    if (mTrashDirs.count(dir) > 0)
+      return 0;
+  }
+
+  radosfs::Dir trash(mOss->radosFs(dir), dir);
+  int ret = trash.create(TRASH_DIR_MODE, false, ROOT_UID, ROOT_UID);
+
+  if (ret != 0 && ret != -EEXIST)
+    return ret;
+
+  XrdSysMutexHelper lock(mMutex);
+  mTrashDirs.insert(dir);
+
+  return 0;
+}
+
+// Named after the path and the time so other servers use different names,
+// just trying the next one if that happens
+std::string
+RadosOssReaper::trashName(const std::string &path)
+{
+  char name[64];
+
+  mMutex.Lock();
+  unsigned int counter = mCounter++;
+  mMutex.UnLock();
+
+  snprintf(name, sizeof(name), "%016llx.%lx.%x.%x",
+           (unsigned long long) radosOssPathHash(path),
+           (long) time(0), (unsigned int) getpid(), counter);
+
+  return trashDir(path) + name;
+}
+
+int
+RadosOssReaper::moveToTrash(const std::string &path, std::string &trashPath)
+{
+  int ret = createTrashDir(trashDir(path));
+
+  if (ret != 0)
+    return ret;
+
+  radosfs::File file(mOss->radosFs(path), path, radosfs::File::MODE_WRITE);
+
+  for (int attempt = 0; attempt < TRASH_RENAME_ATTEMPTS; attempt++)
+  {
+    trashPath = trashName(path);
+    ret = file.rename(trashPath);
+
+    if (ret != -EEXIST)
+      break;
+  }
+
+  return ret;
+}
+
+// Moves the file to the trash, so it is gone once this returns, and queues
+// the removal of its data
+int
+RadosOssReaper::remove(const std::string &path)
+{
+  std::string trashPath;
+  int ret = moveToTrash(path, trashPath);
+
+  if (ret == 0)
+    queue(trashPath);
+
+  return ret;
+}
+
+// Creates, in the trash, a file with the first size bytes of path and its
+// mode, owner and attributes (but not the stored checksums)
+int
+RadosOssReaper::copyHead(const std::string &path, const std::string &newPath,
+                         unsigned long long size, const struct stat &statBuff)
+{
+  radosfs::File file(mOss->radosFs(path), path, radosfs::File::MODE_READ);
+  radosfs::File newFile(mOss->radosFs(newPath), newPath,
+                        radosfs::File::MODE_WRITE);
+  std::map<std::string, std::string> xattrs;
+  std::map<std::string, std::string>::const_iterator it;
+  int ret;
+
+  ret = newFile.create(statBuff.st_mode & 07777);
+
+  if (ret == 0)
+    ret = newFile.chown(statBuff.st_uid, statBuff.st_gid);
+
+  if (ret == 0)
+    ret = file.getXAttrsMap(xattrs);
+
+  for (it = xattrs.begin(); ret == 0 && it != xattrs.end(); it++)
+  {
+    if ((*it).first.compare(0, strlen(CHECKSUM_XATTR_PREFIX),
+                            CHECKSUM_XATTR_PREFIX) != 0)
+      ret = newFile.setXAttr((*it).first, (*it).second);
+  }
+
+  if (ret == 0 && size > 0)
+  {
+    std::vector<char> buff(size);
+    ssize_t length = file.read(&buff[0], 0, size);
+
+    if (length < 0)
+      ret = length;
+    else if (length > 0)
+      ret = newFile.writeSync(&buff[0], 0, length);
+
+    // A file shorter than size is extended like truncate does
+    if (ret == 0 && (unsigned long long) length < size)
+      ret = newFile.truncate(size);
+  }
+
+  return ret;
+}
+
+// Truncating a file makes RadosFS remove the stripe objects past the new
+// size one after the other. When only a few bytes are kept, the file is
+// instead replaced by a new one with those bytes, which takes a few
+// operations, and the old file is left to the reaper. Nothing is changed if
+// this fails, so the caller can still truncate the file itself.
+int
+RadosOssReaper::truncate(const std::string &path, unsigned long long size,
+                         const struct stat &statBuff)
+{
+  std::string newPath, trashPath;
+  int ret = createTrashDir(trashDir(path));
+
+  if (ret != 0)
+    return ret;
+
+  for (int attempt = 0; attempt < TRASH_RENAME_ATTEMPTS; attempt++)
+  {
+    newPath = trashName(path);
+    ret = copyHead(path, newPath, size, statBuff);
+
+    if (ret != -EEXIST)
+      break;
+  }
+
+  if (ret == 0)
+    ret = moveToTrash(path, trashPath);
+
+  if (ret == 0)
+  {
+    radosfs::File newFile(mOss->radosFs(newPath), newPath,
+                          radosfs::File::MODE_WRITE);
+    ret = newFile.rename(path);
+
+    if (ret == 0)
+    {
+      queue(trashPath);
+      return 0;
+    }
+
+    radosfs::File file(mOss->radosFs(trashPath), trashPath,
+                       radosfs::File::MODE_WRITE);
+
+    // Left in the trash (until the next start) so it can be recovered
+    if (file.rename(path) != 0)
+      OssEroute.Emsg("Reaper", "failed to restore", path.c_str(),
+                     trashPath.c_str());
+  }
+
+  // The copy, if it was created, is not needed anymore
+  if (ret != -EEXIST)
+    queue(newPath);
+
+  return ret;
+}
+
+void
+RadosOssReaper::queue(const std::string &trashPath)
+{
+  mMutex.Lock();
+  mPending++;
+  OssMetrics.setGauge(RADOS_OSS_GAUGE_REAPER_PENDING, mPending);
+  mMutex.UnLock();
+
+  mPool.enqueue(new RadosOssRemoveJob(this, trashPath));
+}
+
+size_t
+RadosOssReaper::pending()
+{
+  XrdSysMutexHelper lock(mMutex);
+
+  return mPending;
+}
+
+void
+RadosOssReaper::removeFinished()
+{
+  XrdSysMutexHelper lock(mMutex);
+
+  mPending--;
+  OssMetrics.setGauge(RADOS_OSS_GAUGE_REAPER_PENDING, mPending);
+}
@@ -0,0 +1,83 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_REAPER_HH__
+#define __RADOS_OSS_REAPER_HH__
+
+#include <XrdSys/XrdSysPthread.hh>
+#include <set>
+#include <string>
+#include <radosfs/Filesystem.hh>
+
+#include "RadosOssThreadPool.hh"
+
+class RadosOss;
+
+// Removes the data of unlinked files in the background, several files at a
+// time, so that Unlink does not wait for all the data objects of large
+// files to be deleted. Unlink moves the file to the trash directory of its
+// pool, so its path is gone (for every server) as soon as it returns, and
+// the reaper then removes the file from the trash. A file truncated to a
+// few bytes is likewise replaced by a new file holding them, and the old
+// one is left to the reaper. Files left in the trash by a previous run are
+// removed when the reaper starts.
+class RadosOssReaper
+{
+public:
+  RadosOssReaper();
+
+  void setNumThreads(size_t numThreads) { mNumThreads = numThreads; }
+  bool enabled(void) const { return mNumThreads > 0; }
+
+  int start(RadosOss *oss);
+  // Waits for all the pending removals
+  void stop(void);
+
+  int remove(const std::string &path);
+  int truncate(const std::string &path, unsigned long long size,
+               const struct stat &statBuff);
+  size_t pending(void);
+
+  // Whether a directory entry is the trash, which is not listed
+  static bool isTrash(const std::string &name);
+
+private:
+  friend class RadosOssRemoveJob;
+
+  static std::string trashDirOf(const std::string &prefix);
+  std::string trashDir(const std::string &path);
+  int createTrashDir(const std::string &dir);
+  std::string trashName(const std::string &path);
+  int moveToTrash(const std::string &path, std::string &trashPath);
+  int copyHead(const std::string &path, const std::string &newPath,
+               unsigned long long size, const struct stat &statBuff);
+  void queue(const std::string &trashPath);
+  void removeFinished(void);
+
+  RadosOss *mOss;
+  size_t mNumThreads;
+  RadosOssThreadPool mPool;
+  XrdSysMutex mMutex;
+  size_t mPending;
+  unsigned int mCounter;
+  std::set<std::string> mTrashDirs;
+};
+
+#endif /* __RADOS_OSS_REAPER_HH__ */
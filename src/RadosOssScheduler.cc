@@ -0,0 +1,457 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <algorithm>
+
+#include "RadosOssScheduler.hh"
+#include "RadosOssMetrics.hh"
+
+// What a request costs on top of its bytes when sharing the I/O among the
+// users, so that many small requests are not almost free
+#define SCHED_REQUEST_COST 65536
+
+struct RadosOssScheduler::User
+{
+  User(const RadosOssSchedConf &conf)
+    : weight(conf.weight > 0 ? conf.weight : 1),
+      bucket(conf.bandwidth, conf.iops),
+      lastFinish(0)
+  {}
+
+  uint64_t weight;
+  RadosOssTokenBucket bucket;
+  // Virtual time at which the user's last queued request is done
+  double lastFinish;
+  std::deque<Request *> requests;
+};
+
+struct RadosOssScheduler::Pool
+{
+  Pool(const RadosOssSchedConf &conf)
+    : bucket(conf.bandwidth, conf.iops)
+  {}
+
+  RadosOssTokenBucket bucket;
+};
+
+RadosOssTokenBucket::RadosOssTokenBucket(uint64_t bandwidth, uint64_t iops)
+  : mBandwidth(bandwidth),
+    mIops(iops),
+    mBytes(bandwidth),
+    mOps(iops),
+    mLastUs(RadosOssMetrics::nowUs())
+{}
+
+void
+RadosOssTokenBucket::refill(uint64_t nowUs)
+{
+  if (nowUs <= mLastUs)
+    return;
+
+  double seconds = (nowUs - mLastUs) / 1000000.0;
+
+  mBytes = std::min(mBytes + seconds * mBandwidth, (double) mBandwidth);
+  mOps = std::min(mOps + seconds * mIops, (double) mIops);
+  mLastUs = nowUs;
+}
+
+uint64_t
+RadosOssTokenBucket::waitUs(uint64_t nowUs)
+{
+  double seconds = 0;
+
+  refill(nowUs);
+
+  if (mBandwidth > 0 && mBytes < 0)
+    seconds = -mBytes / mBandwidth;
+
+  if (mIops > 0 && mOps < 0)
+    seconds = std::max(seconds, -mOps / mIops);
+
+  return seconds > 0 ? (uint64_t) (seconds * 1000000) + 1 : 0;
+}
+
+void
+RadosOssTokenBucket::take(size_t bytes)
+{
+  if (mBandwidth > 0)
+    mBytes -= bytes;
+
+  if (mIops > 0)
+    mOps -= 1;
+}
+
+RadosOssScheduler::RadosOssScheduler()
+  : mMaxInFlight((size_t) -1),
+    mEnabled(false),
+    mCond(0),
+    mVirtualTime(0),
+    mInFlight(0),
+    mQueued(0),
+    mNextAdmissionUs(0),
+    mRunning(false),
+    mStopping(false)
+{
+  mDefaultUserConf.weight = 1;
+  mDefaultUserConf.bandwidth = 0;
+  mDefaultUserConf.iops = 0;
+}
+
+RadosOssScheduler::~RadosOssScheduler()
+{
+  stop();
+
+  std::map<std::string, User *>::iterator userIt;
+  for (userIt = mUsers.begin(); userIt != mUsers.end(); userIt++)
+    delete (*userIt).second;
+
+  std::map<std::string, Pool *>::iterator poolIt;
+  for (poolIt = mPools.begin(); poolIt != mPools.end(); poolIt++)
+    delete (*poolIt).second;
+}
+
+void
+RadosOssScheduler::setMaxInFlight(size_t maxInFlight)
+{
+  mMaxInFlight = maxInFlight > 0 ? maxInFlight : (size_t) -1;
+  mEnabled = mEnabled || maxInFlight > 0;
+}
+
+// The user "*" sets the share and limits of the users not configured
+void
+RadosOssScheduler::setUserConf(const std::string &name,
+                               const RadosOssSchedConf &conf)
+{
+  if (name == "*")
+    mDefaultUserConf = conf;
+  else
+    mUserConfs[name] = conf;
+
+  mEnabled = mEnabled || conf.bandwidth > 0 || conf.iops > 0;
+}
+
+void
+RadosOssScheduler::setPoolConf(const std::string &name,
+                               const RadosOssSchedConf &conf)
+{
+  mPoolConfs[name] = conf;
+  mEnabled = mEnabled || conf.bandwidth > 0 || conf.iops > 0;
+}
+
+int
+RadosOssScheduler::start()
+{
+  int ret = XrdSysThread::Run(&mThread, RadosOssScheduler::timerThread,
+                              (void *) this, XRDSYSTHREAD_HOLD,
+                              "RadosOss I/O scheduler");
+
+  if (ret != 0)
+    return -ret;
+
+  mRunning = true;
+
+  return 0;
+}
+
+void
+RadosOssScheduler::stop()
+{
+  if (!mRunning)
+    return;
+
+  mCond.Lock();
+  mStopping = true;
+  mCond.Broadcast();
+  mCond.UnLock();
+
+  XrdSysThread::Join(mThread, 0);
+  mRunning = false;
+}
+
+RadosOssScheduler::User *
+RadosOssScheduler::user(const std::string &name)
+{
+  std::map<std::string, User *>::iterator it;
+  User *user;
+
+  mCond.Lock();
+
+  it = mUsers.find(name);
+
+  if (it != mUsers.end())
+  {
+    user = (*it).second;
+  }
+  else
+  {
+    std::map<std::string, RadosOssSchedConf>::const_iterator confIt;
+    confIt = mUserConfs.find(name);
+
+    user = new User(confIt != mUserConfs.end() ? (*confIt).second :
+                                                 mDefaultUserConf);
+    mUsers[name] = user;
+  }
+
+  mCond.UnLock();
+
+  return user;
+}
+
+RadosOssScheduler::Pool *
+RadosOssScheduler::pool(const std::string &name)
+{
+  std::map<std::string, RadosOssSchedConf>::const_iterator confIt;
+  std::map<std::string, Pool *>::iterator it;
+  Pool *pool = 0;
+
+  confIt = mPoolConfs.find(name);
+
+  if (confIt == mPoolConfs.end())
+    return 0;
+
+  mCond.Lock();
+
+  it = mPools.find(name);
+
+  if (it != mPools.end())
+  {
+    pool = (*it).second;
+  }
+  else
+  {
+    pool = new Pool((*confIt).second);
+    mPools[name] = pool;
+  }
+
+  mCond.UnLock();
+
+  return pool;
+}
+
+void
+RadosOssScheduler::acquire(User *user, Pool *pool, size_t bytes)
+{
+  std::vector<Request *> jobs;
+  Request request;
+
+  request.user = user;
+  request.pool = pool;
+  request.bytes = bytes;
+  request.job = 0;
+  request.threadPool = 0;
+
+  mCond.Lock();
+
+  enqueue(&request);
+  admit(jobs);
+
+  while (!request.admitted)
+    mCond.Wait();
+
+  mCond.UnLock();
+
+  runJobs(jobs);
+}
+
+void
+RadosOssScheduler::submit(User *user, Pool *pool, size_t bytes,
+                          RadosOssJob *job, RadosOssThreadPool *threadPool)
+{
+  std::vector<Request *> jobs;
+  Request *request = new Request;
+
+  request->user = user;
+  request->pool = pool;
+  request->bytes = bytes;
+  request->job = job;
+  request->threadPool = threadPool;
+
+  mCond.Lock();
+  enqueue(request);
+  admit(jobs);
+  mCond.UnLock();
+
+  runJobs(jobs);
+}
+
+void
+RadosOssScheduler::release()
+{
+  std::vector<Request *> jobs;
+
+  mCond.Lock();
+  mInFlight--;
+  admit(jobs);
+  mCond.UnLock();
+
+  runJobs(jobs);
+}
+
+size_t
+RadosOssScheduler::queued()
+{
+  mCond.Lock();
+  size_t queued = mQueued;
+  mCond.UnLock();
+
+  return queued;
+}
+
+// Must be called with the lock held. A user which was idle starts at the
+// current virtual time, so it gets its share right away but no credit for
+// the time it did not use.
+void
+RadosOssScheduler::enqueue(Request *request)
+{
+  User *user = request->user;
+  double start = std::max(mVirtualTime, user->lastFinish);
+
+  request->tag = start;
+  request->queuedUs = RadosOssMetrics::nowUs();
+  request->admitted = false;
+
+  user->lastFinish = start + (double) (request->bytes + SCHED_REQUEST_COST) /
+                             user->weight;
+  user->requests.push_back(request);
+  mActiveUsers.insert(user);
+  mQueued++;
+}
+
+// Must be called with the lock held. Admits the requests with the lowest
+// tags among the users and pools within their limits, and returns the
+// admitted jobs, which are enqueued once the lock is released.
+void
+RadosOssScheduler::admit(std::vector<Request *> &jobs)
+{
+  uint64_t nowUs = RadosOssMetrics::nowUs();
+  bool admitted = false;
+
+  mNextAdmissionUs = 0;
+
+  while (mInFlight < mMaxInFlight && !mActiveUsers.empty())
+  {
+    std::set<User *>::iterator it;
+    Request *next = 0;
+
+    for (it = mActiveUsers.begin(); it != mActiveUsers.end(); it++)
+    {
+      Request *request = (*it)->requests.front();
+      uint64_t waitUs = (*it)->bucket.waitUs(nowUs);
+
+      if (request->pool)
+        waitUs = std::max(waitUs, request->pool->bucket.waitUs(nowUs));
+
+      if (waitUs > 0)
+      {
+        if (mNextAdmissionUs == 0 || nowUs + waitUs < mNextAdmissionUs)
+          mNextAdmissionUs = nowUs + waitUs;
+
+        continue;
+      }
+
+      if (!next || request->tag < next->tag)
+        next = request;
+    }
+
+    if (!next)
+      break;
+
+    User *user = next->user;
+
+    user->requests.pop_front();
+
+    if (user->requests.empty())
+      mActiveUsers.erase(user);
+
+    user->bucket.take(next->bytes);
+
+    if (next->pool)
+      next->pool->bucket.take(next->bytes);
+
+    mVirtualTime = next->tag;
+    mInFlight++;
+    mQueued--;
+    admitted = true;
+
+    OssMetrics.record(RADOS_OSS_OP_SCHED_WAIT, nowUs - next->queuedUs,
+                      next->bytes, true);
+
+    if (next->job)
+      jobs.push_back(next);
+    else
+      next->admitted = true;
+  }
+
+  // Wakes the waiting requests and, if they wait for the limits, the timer
+  if (admitted || mNextAdmissionUs > 0)
+    mCond.Broadcast();
+}
+
+void
+RadosOssScheduler::runJobs(std::vector<Request *> &jobs)
+{
+  for (size_t i = 0; i < jobs.size(); i++)
+  {
+    jobs[i]->threadPool->enqueue(jobs[i]->job);
+    delete jobs[i];
+  }
+}
+
+void *
+RadosOssScheduler::timerThread(void *scheduler)
+{
+  ((RadosOssScheduler *) scheduler)->admitPeriodically();
+  return 0;
+}
+
+// Admits the requests which were waiting for the limits once they let them
+// in, as nothing else may happen meanwhile
+void
+RadosOssScheduler::admitPeriodically()
+{
+  mCond.Lock();
+
+  while (!mStopping)
+  {
+    if (mNextAdmissionUs == 0)
+    {
+      mCond.Wait();
+      continue;
+    }
+
+    uint64_t nowUs = RadosOssMetrics::nowUs();
+
+    if (nowUs < mNextAdmissionUs)
+    {
+      mCond.WaitMS((mNextAdmissionUs - nowUs + 999) / 1000);
+      continue;
+    }
+
+    std::vector<Request *> jobs;
+
+    admit(jobs);
+
+    mCond.UnLock();
+    runJobs(jobs);
+    mCond.Lock();
+  }
+
+  mCond.UnLock();
+}
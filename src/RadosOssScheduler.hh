@@ -0,0 +1,163 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_SCHEDULER_HH__
+#define __RADOS_OSS_SCHEDULER_HH__
+
+#include <XrdSys/XrdSysPthread.hh>
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "RadosOssThreadPool.hh"
+
+// Share and limits of a user or a pool; 0 means unlimited. The weight only
+// applies to users.
+typedef struct {
+  uint64_t weight;
+  uint64_t bandwidth; // bytes per second
+  uint64_t iops;
+} RadosOssSchedConf;
+
+// Rate limit refilled continuously, allowing bursts of up to one second's
+// worth. A request may take more than what is left, leaving the bucket in
+// debt, so requests larger than the burst still go through at the rate.
+class RadosOssTokenBucket
+{
+public:
+  RadosOssTokenBucket(uint64_t bandwidth, uint64_t iops);
+
+  bool limited(void) const { return mBandwidth > 0 || mIops > 0; }
+  // Microseconds until something can be taken
+  uint64_t waitUs(uint64_t nowUs);
+  void take(size_t bytes);
+
+private:
+  void refill(uint64_t nowUs);
+
+  uint64_t mBandwidth;
+  uint64_t mIops;
+  double mBytes;
+  double mOps;
+  uint64_t mLastUs;
+};
+
+// Admits the clients' reads and writes, at most maxInFlight at a time. When
+// more are waiting, they are admitted in (start-time) fair queuing order:
+// each user gets a share of the I/O proportional to its weight, whatever
+// the number of requests it sends, so a bulk transfer cannot starve the
+// other users. Users and pools may also be limited in bandwidth and IOPS.
+// A request only waits for the limits of its own user and pool.
+class RadosOssScheduler
+{
+public:
+  struct User;
+  struct Pool;
+
+  RadosOssScheduler();
+  ~RadosOssScheduler();
+
+  void setMaxInFlight(size_t maxInFlight);
+  void setUserConf(const std::string &name, const RadosOssSchedConf &conf);
+  void setPoolConf(const std::string &name, const RadosOssSchedConf &conf);
+  bool enabled(void) const { return mEnabled; }
+
+  int start(void);
+  void stop(void);
+
+  // Users are identified by the name in the clients' tident and they (and
+  // pools) live as long as the scheduler. A pool without limits is 0.
+  User * user(const std::string &name);
+  Pool * pool(const std::string &name);
+
+  // Waits for the request's turn
+  void acquire(User *user, Pool *pool, size_t bytes);
+  // Enqueues the job in the thread pool when it is its turn instead
+  void submit(User *user, Pool *pool, size_t bytes, RadosOssJob *job,
+              RadosOssThreadPool *threadPool);
+  // Called once an admitted request is done
+  void release(void);
+  size_t queued(void);
+
+private:
+  struct Request
+  {
+    User *user;
+    Pool *pool;
+    size_t bytes;
+    double tag;
+    uint64_t queuedUs;
+    RadosOssJob *job;
+    RadosOssThreadPool *threadPool;
+    bool admitted;
+  };
+
+  static void * timerThread(void *scheduler);
+  void admitPeriodically(void);
+  void enqueue(Request *request);
+  void admit(std::vector<Request *> &jobs);
+  static void runJobs(std::vector<Request *> &jobs);
+
+  size_t mMaxInFlight;
+  bool mEnabled;
+  RadosOssSchedConf mDefaultUserConf;
+  std::map<std::string, RadosOssSchedConf> mUserConfs;
+  std::map<std::string, RadosOssSchedConf> mPoolConfs;
+  XrdSysCondVar mCond;
+  std::map<std::string, User *> mUsers;
+  std::map<std::string, Pool *> mPools;
+  std::set<User *> mActiveUsers;
+  double mVirtualTime;
+  size_t mInFlight;
+  size_t mQueued;
+  // When the limits let the next request in, 0 if none is waiting for them
+  uint64_t mNextAdmissionUs;
+  pthread_t mThread;
+  bool mRunning;
+  bool mStopping;
+};
+
+// Holds a turn of the scheduler, if enabled, for its lifetime
+class RadosOssSchedSlot
+{
+public:
+  RadosOssSchedSlot(RadosOssScheduler *scheduler, RadosOssScheduler::User *user,
+                    RadosOssScheduler::Pool *pool, size_t bytes)
+    : mScheduler(user ? scheduler : 0)
+  {
+    if (mScheduler)
+      mScheduler->acquire(user, pool, bytes);
+  }
+
+  ~RadosOssSchedSlot()
+  {
+    if (mScheduler)
+      mScheduler->release();
+  }
+
+private:
+  RadosOssScheduler *mScheduler;
+};
+
+#endif /* __RADOS_OSS_SCHEDULER_HH__ */
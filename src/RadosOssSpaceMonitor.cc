@@ -0,0 +1,253 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <errno.h>
+#include <time.h>
+#include <set>
+#include <vector>
+
+#include "RadosOss.hh"
+#include "RadosOssSpaceMonitor.hh"
+
+RadosOssSpaceMonitor::RadosOssSpaceMonitor()
+  : mOss(0),
+    mInterval(0),
+    mCond(0),
+    mValid(false),
+    mUsedKb(0),
+    mAvailableKb(0),
+    mRunning(false),
+    mStopping(false)
+{}
+
+RadosOssSpaceMonitor::~RadosOssSpaceMonitor()
+{
+  stop();
+}
+
+// The first snapshot is taken before returning so StatFS always has one
+int
+RadosOssSpaceMonitor::start(RadosOss *oss, int interval)
+{
+  mOss = oss;
+  mInterval = interval > 0 ? interval : 1;
+
+  refresh();
+
+  int ret = XrdSysThread::Run(&mThread, RadosOssSpaceMonitor::monitorThread,
+                              (void *) this, XRDSYSTHREAD_HOLD,
+                              "RadosOss space monitor");
+
+  if (ret != 0)
+    return -ret;
+
+  mRunning = true;
+
+  return 0;
+}
+
+void
+RadosOssSpaceMonitor::stop()
+{
+  if (mRunning)
+  {
+    mCond.Lock();
+    mStopping = true;
+    mCond.Broadcast();
+    mCond.UnLock();
+
+    XrdSysThread::Join(mThread, 0);
+    mRunning = false;
+  }
+
+  std::map<std::string, rados_ioctx_t>::iterator it;
+  for (it = mIoctxs.begin(); it != mIoctxs.end(); it++)
+    rados_ioctx_destroy((*it).second);
+
+  mIoctxs.clear();
+}
+
+// Pools which are not in the last snapshot (e.g. just added by a reload or
+// whose stats could never be read) get the cluster's raw values
+RadosOssSpace
+RadosOssSpaceMonitor::space(const std::string &poolName)
+{
+  XrdSysMutexHelper lock(mSnapshotMutex);
+  std::map<std::string, PoolSpace>::const_iterator it;
+  RadosOssSpace space;
+
+  it = mPools.find(poolName);
+
+  space.valid = mValid;
+
+  if (it != mPools.end())
+  {
+    space.usedKb = (*it).second.usedKb;
+    space.totalKb = space.usedKb +
+                    (uint64_t) (mAvailableKb / (*it).second.copies);
+  }
+  else
+  {
+    space.usedKb = mUsedKb;
+    space.totalKb = mUsedKb + mAvailableKb;
+  }
+
+  return space;
+}
+
+void *
+RadosOssSpaceMonitor::monitorThread(void *monitor)
+{
+  ((RadosOssSpaceMonitor *) monitor)->refreshPeriodically();
+  return 0;
+}
+
+void
+RadosOssSpaceMonitor::refreshPeriodically()
+{
+  mCond.Lock();
+
+  while (!mStopping)
+  {
+    mCond.Wait(mInterval);
+
+    if (mStopping)
+      break;
+
+    mCond.UnLock();
+    refresh();
+    mCond.Lock();
+  }
+
+  mCond.UnLock();
+}
+
+void
+RadosOssSpaceMonitor::refresh()
+{
+  std::map<std::string, PoolSpace> poolsSpace;
+  std::set<std::string> failedPools;
+  std::vector<RadosOssPool> pools;
+  std::vector<RadosOssPool>::const_iterator it;
+  uint64_t totalKb, usedKb, availableKb;
+  int ret;
+
+  ret = mOss->radosFs()->statCluster(&totalKb, &usedKb, &availableKb, 0);
+
+  mOss->getPools(pools);
+
+  for (it = pools.begin(); it != pools.end(); it++)
+  {
+    PoolSpace space;
+
+    if ((*it).isMtdPool || poolsSpace.count((*it).name) > 0 ||
+        failedPools.count((*it).name) > 0)
+      continue;
+
+    if (poolSpace((*it).name, &space) == 0)
+      poolsSpace[(*it).name] = space;
+    else
+      failedPools.insert((*it).name);
+  }
+
+  // Close the pools which are no longer configured (or failed, they are
+  // opened again next time)
+  std::map<std::string, rados_ioctx_t>::iterator ioctxIt = mIoctxs.begin();
+
+  while (ioctxIt != mIoctxs.end())
+  {
+    if (poolsSpace.count((*ioctxIt).first) == 0)
+    {
+      rados_ioctx_destroy((*ioctxIt).second);
+      mIoctxs.erase(ioctxIt++);
+    }
+    else
+    {
+      ioctxIt++;
+    }
+  }
+
+  XrdSysMutexHelper lock(mSnapshotMutex);
+
+  // A failed refresh keeps the last snapshot rather than making the server
+  // look full to the redirector
+  if (ret == 0)
+  {
+    mValid = true;
+    mUsedKb = usedKb;
+    mAvailableKb = availableKb;
+  }
+
+  // Likewise, a pool whose stats could not be read keeps its last values
+  std::set<std::string>::const_iterator failedIt;
+  for (failedIt = failedPools.begin(); failedIt != failedPools.end();
+       failedIt++)
+  {
+    std::map<std::string, PoolSpace>::const_iterator last;
+    last = mPools.find(*failedIt);
+
+    if (last != mPools.end())
+      poolsSpace[*failedIt] = (*last).second;
+  }
+
+  mPools.swap(poolsSpace);
+}
+
+int
+RadosOssSpaceMonitor::poolSpace(const std::string &poolName,
+                                PoolSpace *space)
+{
+  std::map<std::string, rados_ioctx_t>::iterator it = mIoctxs.find(poolName);
+  struct rados_pool_stat_t poolStat;
+  rados_ioctx_t ioctx;
+  int ret;
+
+  if (it != mIoctxs.end())
+  {
+    ioctx = (*it).second;
+  }
+  else
+  {
+    if (!mOss->cluster())
+      return -ENOTCONN;
+
+    ret = rados_ioctx_create(mOss->cluster(), poolName.c_str(), &ioctx);
+
+    if (ret != 0)
+      return ret;
+
+    mIoctxs[poolName] = ioctx;
+  }
+
+  ret = rados_ioctx_pool_stat(ioctx, &poolStat);
+
+  if (ret == 0)
+  {
+    space->usedKb = poolStat.num_kb;
+    space->copies = 1;
+
+    if (poolStat.num_objects > 0 &&
+        poolStat.num_object_copies > poolStat.num_objects)
+      space->copies = (double) poolStat.num_object_copies /
+                      poolStat.num_objects;
+  }
+
+  return ret;
+}
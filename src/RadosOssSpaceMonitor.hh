@@ -0,0 +1,85 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_SPACE_MONITOR_HH__
+#define __RADOS_OSS_SPACE_MONITOR_HH__
+
+#include <XrdSys/XrdSysPthread.hh>
+#include <pthread.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <rados/librados.h>
+
+class RadosOss;
+
+typedef struct {
+  bool valid;
+  uint64_t totalKb;
+  uint64_t usedKb;
+} RadosOssSpace;
+
+// Keeps a snapshot of the space used in the cluster and in each data pool,
+// refreshed every interval seconds by a thread, so that StatFS (polled
+// constantly by the redirector) never waits on the monitors. The pools share
+// the cluster's available space, so a pool's total is its used space plus
+// the cluster's available space. A pool's used space is the data stored in
+// it while the cluster's is raw space, which holds every copy of the data,
+// so the available space is divided by the pool's number of copies.
+class RadosOssSpaceMonitor
+{
+public:
+  RadosOssSpaceMonitor();
+  ~RadosOssSpaceMonitor();
+
+  int start(RadosOss *oss, int interval);
+  void stop(void);
+
+  RadosOssSpace space(const std::string &poolName);
+
+private:
+  static void * monitorThread(void *monitor);
+  void refreshPeriodically(void);
+  void refresh(void);
+  struct PoolSpace
+  {
+    uint64_t usedKb;
+    // Raw space taken per byte stored (an upper bound for erasure coding)
+    double copies;
+  };
+
+  int poolSpace(const std::string &poolName, PoolSpace *space);
+
+  RadosOss *mOss;
+  int mInterval;
+  XrdSysCondVar mCond;
+  XrdSysMutex mSnapshotMutex;
+  bool mValid;
+  uint64_t mUsedKb;
+  uint64_t mAvailableKb;
+  std::map<std::string, PoolSpace> mPools;
+  // Only used by the thread refreshing the snapshot
+  std::map<std::string, rados_ioctx_t> mIoctxs;
+  pthread_t mThread;
+  bool mRunning;
+  bool mStopping;
+};
+
+#endif /* __RADOS_OSS_SPACE_MONITOR_HH__ */
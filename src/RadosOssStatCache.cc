@@ -0,0 +1,298 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <time.h>
+
+#include "RadosOssHash.hh"
+#include "RadosOssStatCache.hh"
+
+RadosOssStatCache::RadosOssStatCache()
+  : mMaxEntries(0),
+    mTtlMs(0),
+    mMaxMissing(0),
+    mMissingTtlMs(0),
+    mHits(0),
+    mMisses(0),
+    mMissingHits(0),
+    mPermissionHits(0)
+{
+}
+
+uint64_t
+RadosOssStatCache::nowMs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+std::string
+RadosOssStatCache::key(const std::string &path)
+{
+  size_t length = path.length();
+
+  while (length > 1 && path[length - 1] == '/')
+    length--;
+
+  return path.substr(0, length);
+}
+
+RadosOssStatCache::Shard &
+RadosOssStatCache::shard(const std::string &path)
+{
+  return mShards[radosOssPathHash(path) % STAT_CACHE_NUM_SHARDS];
+}
+
+// Returns the entry for path if it has not expired yet
+RadosOssStatCache::Entry *
+RadosOssStatCache::find(Table &table, const std::string &path)
+{
+  std::map<std::string, Entry>::iterator it = table.entries.find(path);
+
+  if (it == table.entries.end())
+    return 0;
+
+  if ((*it).second.expires > nowMs())
+    return &(*it).second;
+
+  table.order.erase((*it).second.order);
+  table.entries.erase(it);
+
+  return 0;
+}
+
+RadosOssStatCache::Entry &
+RadosOssStatCache::insert(Table &table, const std::string &path,
+                          size_t maxEntries, unsigned int ttlMs)
+{
+  size_t maxShardEntries = maxEntries / STAT_CACHE_NUM_SHARDS + 1;
+
+  erase(table, path);
+
+  while (table.entries.size() >= maxShardEntries)
+    erase(table, table.order.front());
+
+  Entry &entry = table.entries[path];
+  entry.expires = nowMs() + ttlMs;
+  entry.permissionsOnly = false;
+  entry.order = table.order.insert(table.order.end(), path);
+
+  return entry;
+}
+
+void
+RadosOssStatCache::erase(Table &table, const std::string &path)
+{
+  std::map<std::string, Entry>::iterator it = table.entries.find(path);
+
+  if (it != table.entries.end())
+  {
+    table.order.erase((*it).second.order);
+    table.entries.erase(it);
+  }
+}
+
+void
+RadosOssStatCache::erasePrefix(Table &table, const std::string &path,
+                               const std::string &prefix)
+{
+  erase(table, path);
+
+  std::map<std::string, Entry>::iterator it = table.entries.lower_bound(prefix);
+
+  while (it != table.entries.end() &&
+         (*it).first.compare(0, prefix.length(), prefix) == 0)
+  {
+    table.order.erase((*it).second.order);
+    table.entries.erase(it++);
+  }
+}
+
+bool
+RadosOssStatCache::get(const std::string &path, struct stat *buff)
+{
+  if (!enabled())
+    return false;
+
+  std::string cacheKey = key(path);
+  Shard &pathShard = shard(cacheKey);
+  XrdSysMutexHelper lock(pathShard.mutex);
+
+  Entry *entry = find(pathShard.existing, cacheKey);
+
+  if (entry && !entry->permissionsOnly)
+  {
+    *buff = entry->statBuff;
+    __sync_fetch_and_add(&mHits, 1);
+    return true;
+  }
+
+  __sync_fetch_and_add(&mMisses, 1);
+
+  return false;
+}
+
+// Like get, but also uses the entries whose size and times were dropped, so
+// only the type, mode and owner of what is returned may be relied on
+bool
+RadosOssStatCache::getPermissions(const std::string &path, struct stat *buff)
+{
+  if (!enabled())
+    return false;
+
+  std::string cacheKey = key(path);
+  Shard &pathShard = shard(cacheKey);
+  XrdSysMutexHelper lock(pathShard.mutex);
+
+  Entry *entry = find(pathShard.existing, cacheKey);
+
+  if (!entry)
+    return false;
+
+  *buff = entry->statBuff;
+
+  if (entry->permissionsOnly)
+    __sync_fetch_and_add(&mPermissionHits, 1);
+  else
+    __sync_fetch_and_add(&mHits, 1);
+
+  return true;
+}
+
+uint64_t
+RadosOssStatCache::generation(const std::string &path)
+{
+  Shard &pathShard = shard(key(path));
+  XrdSysMutexHelper lock(pathShard.mutex);
+
+  return pathShard.generation;
+}
+
+void
+RadosOssStatCache::put(const std::string &path, const struct stat &buff,
+                       uint64_t generation)
+{
+  if (!enabled())
+    return;
+
+  std::string cacheKey = key(path);
+  Shard &pathShard = shard(cacheKey);
+  XrdSysMutexHelper lock(pathShard.mutex);
+
+  if (pathShard.generation != generation)
+    return;
+
+  erase(pathShard.missing, cacheKey);
+  insert(pathShard.existing, cacheKey, mMaxEntries, mTtlMs).statBuff = buff;
+}
+
+bool
+RadosOssStatCache::isMissing(const std::string &path)
+{
+  if (!missingEnabled())
+    return false;
+
+  std::string cacheKey = key(path);
+  Shard &pathShard = shard(cacheKey);
+  XrdSysMutexHelper lock(pathShard.mutex);
+
+  if (find(pathShard.missing, cacheKey))
+  {
+    __sync_fetch_and_add(&mMissingHits, 1);
+    return true;
+  }
+
+  return false;
+}
+
+void
+RadosOssStatCache::putMissing(const std::string &path, uint64_t generation)
+{
+  if (!missingEnabled())
+    return;
+
+  std::string cacheKey = key(path);
+  Shard &pathShard = shard(cacheKey);
+  XrdSysMutexHelper lock(pathShard.mutex);
+
+  if (pathShard.generation != generation)
+    return;
+
+  erase(pathShard.existing, cacheKey);
+  insert(pathShard.missing, cacheKey, mMaxMissing, mMissingTtlMs);
+}
+
+void
+RadosOssStatCache::invalidate(const std::string &path)
+{
+  if (!enabled() && !missingEnabled())
+    return;
+
+  std::string cacheKey = key(path);
+  Shard &pathShard = shard(cacheKey);
+  XrdSysMutexHelper lock(pathShard.mutex);
+
+  pathShard.generation++;
+  erase(pathShard.existing, cacheKey);
+  erase(pathShard.missing, cacheKey);
+}
+
+// For a directory whose entries changed: its size and times are dropped but
+// the entry is kept for the permission checks
+void
+RadosOssStatCache::invalidateAttributes(const std::string &path)
+{
+  if (!enabled() && !missingEnabled())
+    return;
+
+  std::string cacheKey = key(path);
+  Shard &pathShard = shard(cacheKey);
+  XrdSysMutexHelper lock(pathShard.mutex);
+  std::map<std::string, Entry>::iterator it =
+    pathShard.existing.entries.find(cacheKey);
+
+  pathShard.generation++;
+  erase(pathShard.missing, cacheKey);
+
+  if (it != pathShard.existing.entries.end())
+    (*it).second.permissionsOnly = true;
+}
+
+// Drops path and everything under it (e.g. a renamed directory), which may be
+// in any shard
+void
+RadosOssStatCache::invalidatePrefix(const std::string &path)
+{
+  if (!enabled() && !missingEnabled())
+    return;
+
+  std::string cacheKey = key(path);
+  std::string prefix = cacheKey == "/" ? cacheKey : cacheKey + "/";
+
+  for (int i = 0; i < STAT_CACHE_NUM_SHARDS; i++)
+  {
+    XrdSysMutexHelper lock(mShards[i].mutex);
+
+    mShards[i].generation++;
+    erasePrefix(mShards[i].existing, cacheKey, prefix);
+    erasePrefix(mShards[i].missing, cacheKey, prefix);
+  }
+}
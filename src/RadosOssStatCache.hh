@@ -0,0 +1,124 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_STAT_CACHE_HH__
+#define __RADOS_OSS_STAT_CACHE_HH__
+
+#include <XrdSys/XrdSysPthread.hh>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <string>
+
+#define STAT_CACHE_NUM_SHARDS 16
+
+// Bounded cache of stat results, split in shards (by path hash) so that
+// concurrent lookups rarely contend for the same lock. Entries expire after
+// a TTL and are evicted in insertion order when a shard is full.
+// Paths known not to exist are kept apart, with their own size and TTL.
+// A directory is cached under its path without the trailing '/', so
+// "/a/" and "/a" share the same entry.
+// Every invalidation bumps the generation of the shards it touches; a stat
+// done in RADOS is only cached if the generation of its path's shard, taken
+// before the stat, did not change meanwhile, so a result older than a
+// concurrent invalidation is never put back.
+// Adding or removing an entry of a directory only changes its size and times,
+// so its cached stat is then kept for the permission checks alone (its mode
+// and owner are still right) until a new stat replaces it.
+class RadosOssStatCache
+{
+public:
+  RadosOssStatCache();
+
+  void setMaxEntries(size_t maxEntries) { mMaxEntries = maxEntries; }
+  void setTtl(unsigned int ttlMs) { mTtlMs = ttlMs; }
+  void setMaxMissingEntries(size_t maxEntries) { mMaxMissing = maxEntries; }
+  void setMissingTtl(unsigned int ttlMs) { mMissingTtlMs = ttlMs; }
+  bool enabled(void) const { return mMaxEntries > 0 && mTtlMs > 0; }
+  bool missingEnabled(void) const
+  { return mMaxMissing > 0 && mMissingTtlMs > 0; }
+
+  bool get(const std::string &path, struct stat *buff);
+  uint64_t generation(const std::string &path);
+  void put(const std::string &path, const struct stat &buff,
+           uint64_t generation);
+  bool isMissing(const std::string &path);
+  void putMissing(const std::string &path, uint64_t generation);
+  bool getPermissions(const std::string &path, struct stat *buff);
+  void invalidate(const std::string &path);
+  void invalidateAttributes(const std::string &path);
+  void invalidatePrefix(const std::string &path);
+
+  unsigned long long hits(void) const { return mHits; }
+  unsigned long long misses(void) const { return mMisses; }
+  unsigned long long missingHits(void) const { return mMissingHits; }
+  unsigned long long permissionHits(void) const { return mPermissionHits; }
+
+  static uint64_t nowMs(void);
+
+private:
+  struct Entry
+  {
+    struct stat statBuff;
+    uint64_t expires;
+    // Only the type, mode and owner are still valid
+    bool permissionsOnly;
+    std::list<std::string>::iterator order;
+  };
+
+  struct Table
+  {
+    std::map<std::string, Entry> entries;
+    std::list<std::string> order;
+  };
+
+  struct Shard
+  {
+    Shard() : generation(0) {}
+
+    XrdSysMutex mutex;
+    Table existing;
+    Table missing;
+    uint64_t generation;
+  };
+
+  static std::string key(const std::string &path);
+  Shard & shard(const std::string &path);
+  Entry * find(Table &table, const std::string &path);
+  Entry & insert(Table &table, const std::string &path, size_t maxEntries,
+                 unsigned int ttlMs);
+  void erase(Table &table, const std::string &path);
+  void erasePrefix(Table &table, const std::string &path,
+                   const std::string &prefix);
+
+  Shard mShards[STAT_CACHE_NUM_SHARDS];
+  size_t mMaxEntries;
+  unsigned int mTtlMs;
+  size_t mMaxMissing;
+  unsigned int mMissingTtlMs;
+  unsigned long long mHits;
+  unsigned long long mMisses;
+  unsigned long long mMissingHits;
+  // Permission checks served by entries kept only for them
+  unsigned long long mPermissionHits;
+};
+
+#endif /* __RADOS_OSS_STAT_CACHE_HH__ */
@@ -0,0 +1,155 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <errno.h>
+
+#include "RadosOssThreadPool.hh"
+
+RadosOssThreadPool::RadosOssThreadPool()
+  : mJobsCond(0),
+    mStopping(false)
+{
+}
+
+RadosOssThreadPool::~RadosOssThreadPool()
+{
+  stop();
+}
+
+int
+RadosOssThreadPool::start(size_t numThreads)
+{
+  for (size_t i = 0; i < numThreads; i++)
+  {
+    pthread_t tid;
+    int ret = XrdSysThread::Run(&tid, RadosOssThreadPool::workerThread,
+                                (void *) this, XRDSYSTHREAD_HOLD,
+                                "RadosOss worker");
+    if (ret != 0)
+      return -ret;
+
+    mThreads.push_back(tid);
+  }
+
+  return 0;
+}
+
+void
+RadosOssThreadPool::stop()
+{
+  mJobsCond.Lock();
+  mStopping = true;
+  mJobsCond.Broadcast();
+  mJobsCond.UnLock();
+
+  std::vector<pthread_t>::iterator it;
+  for (it = mThreads.begin(); it != mThreads.end(); it++)
+    XrdSysThread::Join(*it, 0);
+
+  mThreads.clear();
+}
+
+void
+RadosOssThreadPool::enqueue(RadosOssJob *job)
+{
+  if (mThreads.empty())
+  {
+    job->run();
+    delete job;
+    return;
+  }
+
+  mJobsCond.Lock();
+  mJobs.push_back(job);
+  mJobsCond.Signal();
+  mJobsCond.UnLock();
+}
+
+// Jobs waiting for a free thread
+size_t
+RadosOssThreadPool::queued()
+{
+  mJobsCond.Lock();
+  size_t numJobs = mJobs.size();
+  mJobsCond.UnLock();
+
+  return numJobs;
+}
+
+void *
+RadosOssThreadPool::workerThread(void *pool)
+{
+  ((RadosOssThreadPool *) pool)->processJobs();
+  return 0;
+}
+
+void
+RadosOssThreadPool::processJobs()
+{
+  while (true)
+  {
+    RadosOssJob *job;
+
+    mJobsCond.Lock();
+
+    while (mJobs.empty() && !mStopping)
+      mJobsCond.Wait();
+
+    if (mJobs.empty())
+    {
+      mJobsCond.UnLock();
+      break;
+    }
+
+    job = mJobs.front();
+    mJobs.pop_front();
+
+    mJobsCond.UnLock();
+
+    job->run();
+    delete job;
+  }
+}
+
+void
+RadosOssOpCounter::add()
+{
+  mCond.Lock();
+  mCount++;
+  mCond.UnLock();
+}
+
+void
+RadosOssOpCounter::done()
+{
+  mCond.Lock();
+  if (--mCount == 0)
+    mCond.Broadcast();
+  mCond.UnLock();
+}
+
+void
+RadosOssOpCounter::waitForAll()
+{
+  mCond.Lock();
+  while (mCount > 0)
+    mCond.Wait();
+  mCond.UnLock();
+}
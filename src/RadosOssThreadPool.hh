@@ -0,0 +1,76 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_THREAD_POOL_HH__
+#define __RADOS_OSS_THREAD_POOL_HH__
+
+#include <XrdSys/XrdSysPthread.hh>
+#include <deque>
+#include <vector>
+
+class RadosOssJob
+{
+public:
+  virtual ~RadosOssJob() {}
+  virtual void run(void) = 0;
+};
+
+// Fixed set of worker threads running RadosOssJob objects in FIFO order.
+// Jobs are owned by the pool once enqueued and deleted after they run.
+// If the pool has not been started, jobs run in the caller's thread.
+class RadosOssThreadPool
+{
+public:
+  RadosOssThreadPool();
+  ~RadosOssThreadPool();
+
+  int start(size_t numThreads);
+  void stop(void);
+  void enqueue(RadosOssJob *job);
+  size_t numThreads(void) const { return mThreads.size(); }
+  size_t queued(void);
+
+private:
+  static void * workerThread(void *pool);
+  void processJobs(void);
+
+  XrdSysCondVar mJobsCond;
+  std::deque<RadosOssJob *> mJobs;
+  std::vector<pthread_t> mThreads;
+  bool mStopping;
+};
+
+// Counts outstanding operations so that their owner can wait for all of them
+// to finish (e.g. before a file handle is closed).
+class RadosOssOpCounter
+{
+public:
+  RadosOssOpCounter() : mCond(0), mCount(0) {}
+
+  void add(void);
+  void done(void);
+  void waitForAll(void);
+
+private:
+  XrdSysCondVar mCond;
+  size_t mCount;
+};
+
+#endif /* __RADOS_OSS_THREAD_POOL_HH__ */
@@ -0,0 +1,363 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <XrdSys/XrdSysError.hh>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "RadosOssTrace.hh"
+#include "RadosOssDefines.hh"
+
+extern XrdSysError OssEroute;
+
+RadosOssTrace OssTrace;
+
+RadosOssTrace::RadosOssTrace()
+  : mFd(-1),
+    mEnabled(false),
+    mLastHandle(0),
+    mDropped(0),
+    mCond(0),
+    mStopping(false)
+{
+  pthread_key_create(&mSlotKey, RadosOssTrace::releaseSlot);
+}
+
+RadosOssTrace::~RadosOssTrace()
+{
+  stop();
+}
+
+uint64_t
+RadosOssTrace::newHandle()
+{
+  return __sync_add_and_fetch(&mLastHandle, 1);
+}
+
+int
+RadosOssTrace::start(const std::string &path)
+{
+  RadosOssTraceHeader header;
+
+  mFd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (mFd < 0)
+    return -errno;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, RADOS_OSS_TRACE_MAGIC, sizeof(header.magic));
+  header.version = RADOS_OSS_TRACE_VERSION;
+  header.recordSize = sizeof(RadosOssTraceRecord);
+
+  if (write(mFd, &header, sizeof(header)) != sizeof(header))
+  {
+    int ret = -errno;
+    close(mFd);
+    mFd = -1;
+    return ret;
+  }
+
+  int ret = XrdSysThread::Run(&mWriterThread, RadosOssTrace::writerThread,
+                              (void *) this, XRDSYSTHREAD_HOLD,
+                              "RadosOss trace writer");
+
+  if (ret != 0)
+  {
+    close(mFd);
+    mFd = -1;
+    return -ret;
+  }
+
+  mEnabled = true;
+
+  return 0;
+}
+
+void
+RadosOssTrace::stop()
+{
+  if (!mEnabled)
+    return;
+
+  mCond.Lock();
+  mEnabled = false;
+  mStopping = true;
+  mCond.Broadcast();
+  mCond.UnLock();
+
+  XrdSysThread::Join(mWriterThread, 0);
+
+  close(mFd);
+  mFd = -1;
+
+  // Records of the calls which were finishing while the writer stopped
+  XrdSysMutexHelper lock(mSlotsMutex);
+
+  for (size_t i = 0; i < mSlots.size(); i++)
+  {
+    XrdSysMutexHelper slotLock(mSlots[i]->mutex);
+    mDropped += mSlots[i]->buffer->size();
+    mSlots[i]->buffer->clear();
+  }
+
+  if (mDropped > 0)
+  {
+    char dropped[32];
+    snprintf(dropped, sizeof(dropped), "%llu", (unsigned long long) mDropped);
+    OssEroute.Say("--- Ceph Oss Rados --- Records dropped from the trace: ",
+                  dropped);
+  }
+}
+
+RadosOssTrace::Buffer *
+RadosOssTrace::newBuffer()
+{
+  Buffer *buffer = new Buffer;
+  buffer->reserve(TRACE_BUFFER_RECORDS);
+
+  return buffer;
+}
+
+RadosOssTrace::ThreadSlot *
+RadosOssTrace::threadSlot()
+{
+  ThreadSlot *slot = (ThreadSlot *) pthread_getspecific(mSlotKey);
+
+  if (slot)
+    return slot;
+
+  mSlotsMutex.Lock();
+
+  // Slots of threads which exited are reused, with the records left in them
+  if (!mFreeSlots.empty())
+  {
+    slot = mFreeSlots.back();
+    mFreeSlots.pop_back();
+  }
+  else
+  {
+    slot = new ThreadSlot;
+    slot->trace = this;
+    slot->buffer = newBuffer();
+    mSlots.push_back(slot);
+  }
+
+  mSlotsMutex.UnLock();
+
+  pthread_setspecific(mSlotKey, slot);
+
+  return slot;
+}
+
+void
+RadosOssTrace::releaseSlot(void *threadSlot)
+{
+  ThreadSlot *slot = (ThreadSlot *) threadSlot;
+  RadosOssTrace *trace = slot->trace;
+
+  trace->mSlotsMutex.Lock();
+  trace->mFreeSlots.push_back(slot);
+  trace->mSlotsMutex.UnLock();
+}
+
+// Must be called with the lock held; takes the buffer
+void
+RadosOssTrace::queueBuffer(Buffer *buffer)
+{
+  if (buffer->empty())
+  {
+    delete buffer;
+    return;
+  }
+
+  if (mFullBuffers.size() >= TRACE_MAX_PENDING_BUFFERS)
+  {
+    mDropped += buffer->size();
+    delete buffer;
+    return;
+  }
+
+  mFullBuffers.push_back(buffer);
+  mCond.Signal();
+}
+
+// Takes the records of all the threads, for the writer
+void
+RadosOssTrace::collectBuffers()
+{
+  std::vector<Buffer *> buffers;
+
+  mSlotsMutex.Lock();
+
+  for (size_t i = 0; i < mSlots.size(); i++)
+  {
+    ThreadSlot *slot = mSlots[i];
+    XrdSysMutexHelper slotLock(slot->mutex);
+
+    if (!slot->buffer->empty())
+    {
+      buffers.push_back(slot->buffer);
+      slot->buffer = newBuffer();
+    }
+  }
+
+  mSlotsMutex.UnLock();
+
+  mCond.Lock();
+
+  for (size_t i = 0; i < buffers.size(); i++)
+    queueBuffer(buffers[i]);
+
+  mCond.UnLock();
+}
+
+void
+RadosOssTrace::record(const RadosOssTraceRecord &record,
+                      const XrdOucIOVec *segments, int numSegments)
+{
+  RadosOssTraceRecord segment;
+  uint32_t thread = (uint32_t) XrdSysThread::Num();
+  Buffer *full = 0;
+
+  if (!mEnabled)
+    return;
+
+  if (numSegments > 0)
+  {
+    memset(&segment, 0, sizeof(segment));
+    segment.start = record.start;
+    segment.pathHash = record.pathHash;
+    segment.handle = record.handle;
+    segment.thread = thread;
+    segment.op = RADOS_OSS_TRACE_SEGMENT;
+  }
+
+  ThreadSlot *slot = threadSlot();
+
+  slot->mutex.Lock();
+
+  slot->buffer->push_back(record);
+  slot->buffer->back().thread = thread;
+
+  // The segments always follow their ReadV, even if that means going over
+  // the size of the buffer
+  for (int i = 0; i < numSegments; i++)
+  {
+    segment.offset = segments[i].offset;
+    segment.length = segments[i].size;
+    slot->buffer->push_back(segment);
+  }
+
+  if (slot->buffer->size() >= TRACE_BUFFER_RECORDS)
+  {
+    full = slot->buffer;
+    slot->buffer = newBuffer();
+  }
+
+  slot->mutex.UnLock();
+
+  if (full)
+  {
+    mCond.Lock();
+    queueBuffer(full);
+    mCond.UnLock();
+  }
+}
+
+void *
+RadosOssTrace::writerThread(void *trace)
+{
+  ((RadosOssTrace *) trace)->writePeriodically();
+  return 0;
+}
+
+// Full buffers are written as soon as they are queued and the threads'
+// partly filled ones every second, so the trace is never far behind
+void
+RadosOssTrace::writePeriodically()
+{
+  std::vector<Buffer *> buffers;
+  bool stopping = false;
+
+  mCond.Lock();
+
+  while (!stopping)
+  {
+    if (mFullBuffers.empty() && !mStopping)
+      mCond.Wait(1);
+
+    stopping = mStopping;
+
+    if (mFullBuffers.empty() || stopping)
+    {
+      mCond.UnLock();
+      collectBuffers();
+      mCond.Lock();
+    }
+
+    buffers.swap(mFullBuffers);
+
+    mCond.UnLock();
+
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+      int ret = writeBuffer(*buffers[i]);
+
+      if (ret != 0)
+        OssEroute.Emsg("Failed to write the trace", ":", strerror(-ret));
+
+      delete buffers[i];
+    }
+
+    buffers.clear();
+
+    mCond.Lock();
+  }
+
+  mCond.UnLock();
+}
+
+int
+RadosOssTrace::writeBuffer(const Buffer &buffer)
+{
+  const char *data = (const char *) &buffer[0];
+  size_t length = buffer.size() * sizeof(RadosOssTraceRecord);
+
+  while (length > 0)
+  {
+    ssize_t ret = write(mFd, data, length);
+
+    if (ret < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      return -errno;
+    }
+
+    data += ret;
+    length -= ret;
+  }
+
+  return 0;
+}
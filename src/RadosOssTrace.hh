@@ -0,0 +1,117 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_TRACE_HH__
+#define __RADOS_OSS_TRACE_HH__
+
+#include <XrdOuc/XrdOucIOVec.hh>
+#include <XrdSys/XrdSysPthread.hh>
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define RADOS_OSS_TRACE_MAGIC "RDOSSTRC"
+#define RADOS_OSS_TRACE_VERSION 1
+// Op of the records which follow a ReadV one, one per segment
+#define RADOS_OSS_TRACE_SEGMENT 0xffff
+
+// Written once at the beginning of a trace file. Records are stored in the
+// byte order of the host which wrote them.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+} RadosOssTraceHeader;
+
+// One call to the plugin. Paths are only kept as hashes; operations on open
+// files and directories refer to the handle given by their Open/Opendir.
+typedef struct {
+  uint64_t start; // us, from the monotonic clock
+  uint64_t pathHash; // the source path for renames
+  uint64_t handle; // 0 for operations on paths
+  int64_t offset; // the size for truncates, the destination hash for renames
+  uint64_t length; // the mode for creations and chmod
+  int32_t result;
+  uint32_t duration; // us
+  uint32_t thread;
+  uint32_t flags; // open flags, mkpath option or number of ReadV segments
+  uint16_t op; // a RadosOssOp or RADOS_OSS_TRACE_SEGMENT
+  uint16_t reserved[3];
+} RadosOssTraceRecord;
+
+// Optional binary trace of the calls to the plugin, meant to be replayed
+// later. Every thread appends its records to a buffer of its own, so
+// recording never contends with other threads. Full buffers are handed to a
+// background thread which writes them, and which also takes the partly
+// filled ones every second; if it cannot keep up, records are dropped
+// instead of slowing down the requests.
+class RadosOssTrace
+{
+public:
+  RadosOssTrace();
+  ~RadosOssTrace();
+
+  int start(const std::string &path);
+  void stop(void);
+  bool enabled(void) const { return mEnabled; }
+
+  void record(const RadosOssTraceRecord &record,
+              const XrdOucIOVec *segments=0, int numSegments=0);
+  uint64_t newHandle(void);
+
+private:
+  typedef std::vector<RadosOssTraceRecord> Buffer;
+
+  struct ThreadSlot
+  {
+    RadosOssTrace *trace;
+    // Only taken by the writer besides the slot's thread
+    XrdSysMutex mutex;
+    Buffer *buffer;
+  };
+
+  ThreadSlot * threadSlot(void);
+  static void releaseSlot(void *slot);
+  static Buffer * newBuffer(void);
+  static void * writerThread(void *trace);
+  void writePeriodically(void);
+  int writeBuffer(const Buffer &buffer);
+  void queueBuffer(Buffer *buffer);
+  void collectBuffers(void);
+
+  int mFd;
+  bool mEnabled;
+  uint64_t mLastHandle;
+  uint64_t mDropped;
+  pthread_key_t mSlotKey;
+  // Only protects the lists of slots, which change when threads come or go
+  XrdSysMutex mSlotsMutex;
+  std::vector<ThreadSlot *> mSlots;
+  std::vector<ThreadSlot *> mFreeSlots;
+  XrdSysCondVar mCond;
+  std::vector<Buffer *> mFullBuffers;
+  pthread_t mWriterThread;
+  bool mStopping;
+};
+
+extern RadosOssTrace OssTrace;
+
+#endif /* __RADOS_OSS_TRACE_HH__ */
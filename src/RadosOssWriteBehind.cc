@@ -0,0 +1,201 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "RadosOssWriteBehind.hh"
+#include "RadosOssMetrics.hh"
+
+class RadosOssFlushJob : public RadosOssJob
+{
+public:
+  RadosOssFlushJob(RadosOssWriteBehind *writeBehind,
+                   RadosOssWriteBehind::Buffer *buffer)
+    : mWriteBehind(writeBehind),
+      mBuffer(buffer)
+  {}
+
+  virtual void run(void)
+  {
+    RadosOssOpTimer timer(RADOS_OSS_OP_RADOS_WRITE, true);
+    int ret = mWriteBehind->mFile->writeSync(mBuffer->data, mBuffer->offset,
+                                             mBuffer->length);
+
+    // writeSync returns 0 on success
+    timer.done(ret == 0 ? (ssize_t) mBuffer->length : ret);
+    mWriteBehind->flushFinished(mBuffer, ret);
+  }
+
+private:
+  RadosOssWriteBehind *mWriteBehind;
+  RadosOssWriteBehind::Buffer *mBuffer;
+};
+
+RadosOssWriteBehind::RadosOssWriteBehind(radosfs::File *file,
+                                         size_t stripeSize,
+                                         const RadosOssWriteBehindConf &conf,
+                                         RadosOssThreadPool *pool)
+  : mFile(file),
+    mStripeSize(stripeSize),
+    mConf(conf),
+    mPool(pool),
+    mCond(0),
+    mBuffer(0),
+    mInFlight(0),
+    mError(0)
+{
+  if (mConf.bufferSize == 0 || mConf.bufferSize > mStripeSize)
+    mConf.bufferSize = mStripeSize;
+
+  if (mConf.maxInFlight == 0)
+    mConf.maxInFlight = 1;
+}
+
+RadosOssWriteBehind::~RadosOssWriteBehind()
+{
+  sync();
+}
+
+size_t
+RadosOssWriteBehind::bufferCapacity(off_t offset) const
+{
+  off_t stripeStart = offset - offset % mStripeSize;
+  off_t offsetInStripe = offset - stripeStart;
+  off_t blockEnd = stripeStart + offsetInStripe -
+                   offsetInStripe % mConf.bufferSize + mConf.bufferSize;
+
+  return std::min(blockEnd, stripeStart + (off_t) mStripeSize) - offset;
+}
+
+ssize_t
+RadosOssWriteBehind::write(const char *buff, off_t offset, size_t blen)
+{
+  size_t written = 0;
+
+  mCond.Lock();
+
+  if (mError != 0)
+  {
+    int ret = mError;
+    mCond.UnLock();
+    return ret;
+  }
+
+  if (mBuffer && offset != mBuffer->offset + (off_t) mBuffer->length)
+  {
+    flushBuffer();
+    // Buffers in flight may overlap this write so they need to land first
+    waitForFlushes(0);
+  }
+
+  while (written < blen)
+  {
+    if (!mBuffer)
+    {
+      mBuffer = new Buffer;
+      mBuffer->offset = offset + written;
+      mBuffer->length = 0;
+      mBuffer->capacity = bufferCapacity(mBuffer->offset);
+      mBuffer->data = (char *) malloc(mBuffer->capacity);
+    }
+
+    size_t length = std::min(blen - written,
+                             mBuffer->capacity - mBuffer->length);
+    memcpy(mBuffer->data + mBuffer->length, buff + written, length);
+    mBuffer->length += length;
+    written += length;
+
+    if (mBuffer->length == mBuffer->capacity)
+      flushBuffer();
+  }
+
+  mCond.UnLock();
+
+  return blen;
+}
+
+void
+RadosOssWriteBehind::flushBuffer()
+{
+  if (!mBuffer)
+    return;
+
+  waitForFlushes(mConf.maxInFlight - 1);
+
+  mInFlight++;
+  mPool->enqueue(new RadosOssFlushJob(this, mBuffer));
+  mBuffer = 0;
+}
+
+void
+RadosOssWriteBehind::waitForFlushes(size_t maxInFlight)
+{
+  while (mInFlight > maxInFlight)
+    mCond.Wait();
+}
+
+void
+RadosOssWriteBehind::flushFinished(Buffer *buffer, int ret)
+{
+  mCond.Lock();
+
+  if (ret < 0 && mError == 0)
+    mError = ret;
+
+  free(buffer->data);
+  delete buffer;
+
+  mInFlight--;
+  mCond.Broadcast();
+
+  mCond.UnLock();
+}
+
+int
+RadosOssWriteBehind::sync()
+{
+  int ret;
+
+  mCond.Lock();
+
+  flushBuffer();
+  waitForFlushes(0);
+
+  ret = mError;
+  mError = 0;
+
+  mCond.UnLock();
+
+  return ret;
+}
+
+bool
+RadosOssWriteBehind::hasPendingData()
+{
+  bool pending;
+
+  mCond.Lock();
+  pending = mBuffer != 0 || mInFlight > 0;
+  mCond.UnLock();
+
+  return pending;
+}
@@ -0,0 +1,77 @@
+/************************************************************************
+ * Rados OSS Plugin for XRootD                                          *
+ * Copyright © 2013-2015 CERN/Switzerland                                    *
+ *                                                                      *
+ * Author: Joaquim Rocha <joaquim.rocha@cern.ch>                        *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __RADOS_OSS_WRITE_BEHIND_HH__
+#define __RADOS_OSS_WRITE_BEHIND_HH__
+
+#include <XrdSys/XrdSysPthread.hh>
+#include <sys/types.h>
+#include <radosfs/File.hh>
+
+#include "RadosOssThreadPool.hh"
+
+typedef struct {
+  bool enabled;
+  size_t bufferSize;
+  size_t maxInFlight;
+} RadosOssWriteBehindConf;
+
+// Per handle write-behind: sequential writes are gathered in buffers which
+// never cross a stripe object and full buffers are written in the
+// background, several at a time. Errors are kept until the next sync.
+class RadosOssWriteBehind
+{
+public:
+  RadosOssWriteBehind(radosfs::File *file, size_t stripeSize,
+                      const RadosOssWriteBehindConf &conf,
+                      RadosOssThreadPool *pool);
+  ~RadosOssWriteBehind();
+
+  ssize_t write(const char *buff, off_t offset, size_t blen);
+  int sync(void);
+  bool hasPendingData(void);
+
+private:
+  struct Buffer
+  {
+    off_t offset;
+    size_t length;
+    size_t capacity;
+    char *data;
+  };
+
+  friend class RadosOssFlushJob;
+
+  size_t bufferCapacity(off_t offset) const;
+  void flushBuffer(void);
+  void waitForFlushes(size_t maxInFlight);
+  void flushFinished(Buffer *buffer, int ret);
+
+  radosfs::File *mFile;
+  size_t mStripeSize;
+  RadosOssWriteBehindConf mConf;
+  RadosOssThreadPool *mPool;
+  XrdSysCondVar mCond;
+  Buffer *mBuffer;
+  size_t mInFlight;
+  int mError;
+};
+
+#endif /* __RADOS_OSS_WRITE_BEHIND_HH__ */
@@ -12,10 +12,11 @@ BuildRoot:     %{_tmppath}/%{name}-root
 
 BuildRequires: cmake >= 2.6
 BuildRequires: radosfs-devel >= 0.4
+BuildRequires: librados2-devel
 BuildRequires: xrootd4-server-devel >= 4.0
 BuildRequires: xrootd4-private-devel >= 4.0
 
-Requires: radosfs >= 0.4 xrootd4 >= 4.0
+Requires: radosfs >= 0.4 librados2 xrootd4 >= 4.0
 
 
 %description